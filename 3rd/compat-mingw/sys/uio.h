@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stddef.h>
+
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+int writev(int fd, const struct iovec *iov, int iovcnt);
@@ -1,4 +1,5 @@
 #include "unistd.h"
+#include "sys/uio.h"
 
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #define WIN32_LEAN_AND_MEAN
@@ -293,6 +294,26 @@ int write(int fd, const void* ptr, unsigned int sz) {
     }
 }
 
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    WSABUF vecs[64];
+    if (iovcnt > 64)
+        iovcnt = 64;
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        vecs[i].buf = (char*)iov[i].iov_base;
+        vecs[i].len = (ULONG)iov[i].iov_len;
+    }
+
+    DWORD bytesSent;
+    if (WSASend(fd, vecs, iovcnt, &bytesSent, 0, NULL, NULL)) {
+        int wsa_error = WSAGetLastError();
+        set_errno_from_wsa_error(wsa_error);
+        return -1;
+    } else {
+        return bytesSent;
+    }
+}
+
 int read(int fd, void* buffer, unsigned int sz) {
 
     WSABUF vecs[1];
@@ -11,15 +11,27 @@ protocol = protocol or "http"
 
 if mode == "agent" then
 
-local function response(id, write, ...)
-	local ok, err = httpd.write_response(write, ...)
-	if not ok then
-		-- if err == sockethelper.socket_error , that means socket closed.
-		skynet.error(string.format("fd = %d, %s", id, err))
+local function handle(url, method, header, body)
+	local tmp = {}
+	if header.host then
+		table.insert(tmp, string.format("host: %s", header.host))
 	end
+	local path, query = urllib.parse(url)
+	table.insert(tmp, string.format("path: %s", path))
+	if query then
+		local q = urllib.parse_query(query)
+		for k, v in pairs(q) do
+			table.insert(tmp, string.format("query: %s= %s", k,v))
+		end
+	end
+	table.insert(tmp, "-----header----")
+	for k,v in pairs(header) do
+		table.insert(tmp, string.format("%s = %s",k,v))
+	end
+	table.insert(tmp, "-----body----\n" .. body)
+	return 200, table.concat(tmp,"\n")
 end
 
-
 local SSLCTX_SERVER = nil
 local function gen_interface(protocol, fd)
 	if protocol == "http" then
@@ -59,37 +71,12 @@ skynet.start(function()
 		if interface.init then
 			interface.init()
 		end
+		-- keep the connection alive for 100 requests at most, close it after idle 10s.
 		-- limit request body size to 8192 (you can pass nil to unlimit)
-		local code, url, method, header, body = httpd.read_request(interface.read, 8192)
-		if code then
-			if code ~= 200 then
-				response(id, interface.write, code)
-			else
-				local tmp = {}
-				if header.host then
-					table.insert(tmp, string.format("host: %s", header.host))
-				end
-				local path, query = urllib.parse(url)
-				table.insert(tmp, string.format("path: %s", path))
-				if query then
-					local q = urllib.parse_query(query)
-					for k, v in pairs(q) do
-						table.insert(tmp, string.format("query: %s= %s", k,v))
-					end
-				end
-				table.insert(tmp, "-----header----")
-				for k,v in pairs(header) do
-					table.insert(tmp, string.format("%s = %s",k,v))
-				end
-				table.insert(tmp, "-----body----\n" .. body)
-				response(id, interface.write, code, table.concat(tmp,"\n"))
-			end
-		else
-			if url == sockethelper.socket_error then
-				skynet.error("socket closed")
-			else
-				skynet.error(url)
-			end
+		local n, err = httpd.keepalive(id, interface, handle, { requests = 100, idle = 1000, bodylimit = 8192 })
+		if err then
+			-- if err == sockethelper.socket_error , that means socket closed.
+			skynet.error(string.format("fd = %d, %d requests, %s", id, n, err))
 		end
 		socket.close(id)
 		if interface.close then
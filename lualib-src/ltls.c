@@ -1,7 +1,9 @@
+#define _GNU_SOURCE	// dladdr
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h> 
+#include <dlfcn.h>
 #include <openssl/err.h>
 #include <openssl/dh.h>
 #include <openssl/ssl.h>
@@ -10,6 +12,10 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "skynet.h"
+#include "skynet_socket.h"
+#include "socket_server.h"
+
 
 static bool TLS_IS_INIT = false;
 
@@ -399,6 +405,148 @@ lnew_tls(lua_State* L) {
     return 1;
 }
 
+// the tls layer in socket thread (socket_server_tls), the tls object is SSL*
+
+static int
+_sock_input(void* tls, const void* data, int sz) {
+    BIO* in_bio = SSL_get_rbio((SSL*)tls);
+    while(sz > 0) {
+        int written = BIO_write(in_bio, data, sz);
+        if(written <= 0) {
+            return SOCKET_TLS_ERROR;
+        }
+        data = (const char*)data + written;
+        sz -= written;
+    }
+    return 0;
+}
+
+static int
+_sock_read(void* tls, void* buffer, int sz) {
+    SSL* ssl = (SSL*)tls;
+    int read = SSL_read(ssl, buffer, sz);
+    if(read > 0) {
+        return read;
+    }
+    int err = SSL_get_error(ssl, read);
+    ERR_clear_error();
+    if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        return 0;
+    }
+    if(err == SSL_ERROR_ZERO_RETURN) {
+        return SOCKET_TLS_CLOSE;
+    }
+    return SOCKET_TLS_ERROR;
+}
+
+static int
+_sock_write(void* tls, const void* data, int sz) {
+    SSL* ssl = (SSL*)tls;
+    if(!SSL_is_init_finished(ssl) || sz <= 0) {
+        return 0;
+    }
+    const char* p = (const char*)data;
+    int n = sz;
+    while(n > 0) {
+        int written = SSL_write(ssl, p, n);
+        if(written <= 0) {
+            ERR_clear_error();
+            return SOCKET_TLS_ERROR;
+        }
+        p += written;
+        n -= written;
+    }
+    return sz;
+}
+
+static int
+_sock_pending(void* tls) {
+    return (int)BIO_ctrl_pending(SSL_get_wbio((SSL*)tls));
+}
+
+static int
+_sock_output(void* tls, void* buffer, int sz) {
+    return BIO_read(SSL_get_wbio((SSL*)tls), buffer, sz);
+}
+
+static void
+_sock_shutdown(void* tls) {
+    SSL* ssl = (SSL*)tls;
+    if(SSL_is_init_finished(ssl)) {
+        SSL_shutdown(ssl);
+        ERR_clear_error();
+    }
+}
+
+static void
+_sock_release(void* tls) {
+    SSL_free((SSL*)tls);
+}
+
+static const struct socket_tls_interface SOCKET_TLS = {
+    _sock_input,
+    _sock_read,
+    _sock_write,
+    _sock_pending,
+    _sock_output,
+    _sock_shutdown,
+    _sock_release,
+};
+
+// The socket server calls SOCKET_TLS after attach, but the lua state unloads ltls.so (dlclose) when the service exits.
+// Load it again with RTLD_NODELETE, so it's never unloaded.
+static bool
+_pin_module() {
+    static volatile bool pinned = false;
+    if (pinned)
+        return true;
+    Dl_info info;
+    if (dladdr((void *)&SOCKET_TLS, &info) == 0 || info.dli_fname == NULL)
+        return false;
+    // the handle is never closed
+    if (dlopen(info.dli_fname, RTLD_NOW | RTLD_NODELETE) == NULL)
+        return false;
+    pinned = true;
+    return true;
+}
+
+// attach(ssl_ctx, id, method, hostname) : encrypt the socket in socket thread, the service reads and writes plaintext.
+// server : before socket.start ; client : after connected.
+static int
+lattach(lua_State* L) {
+    if (!_pin_module()) {
+        return luaL_error(L, "Can't pin ltls module : %s", dlerror());
+    }
+    struct ssl_ctx* ctx_p = _check_sslctx(L, 1);
+    int id = luaL_checkinteger(L, 2);
+    const char* method = luaL_optstring(L, 3, "nil");
+    lua_getfield(L, LUA_REGISTRYINDEX, "skynet_context");
+    struct skynet_context* ctx = lua_touserdata(L, -1);
+    if(ctx == NULL) {
+        return luaL_error(L, "Init skynet context first");
+    }
+
+    struct tls_context tls;
+    tls.is_close = false;
+    if(strcmp(method, "client") == 0) {
+        _init_client_context(L, &tls, ctx_p);
+        if (!lua_isnoneornil(L, 4)) {
+            const char* hostname = luaL_checkstring(L, 4);
+            SSL_set_tlsext_host_name(tls.ssl, hostname);
+        }
+        // the client hello, sent when the tls layer is attached
+        SSL_do_handshake(tls.ssl);
+        ERR_clear_error();
+    }else if(strcmp(method, "server") == 0) {
+        _init_server_context(L, &tls, ctx_p);
+    } else {
+        return luaL_error(L, "invalid method:%s e.g[server, client]", method);
+    }
+    // the SSL holds a reference of SSL_CTX, the socket server releases it.
+    skynet_socket_tls(ctx, id, tls.ssl, &SOCKET_TLS);
+    return 0;
+}
+
 int
 luaopen_ltls_c(lua_State* L) {
     if(!TLS_IS_INIT) {
@@ -407,6 +555,7 @@ luaopen_ltls_c(lua_State* L) {
     luaL_Reg l[] = {
         {"newctx", lnew_ctx},
         {"newtls", lnew_tls},
+        {"attach", lattach},
         {NULL, NULL},
     };
     luaL_checkversion(L);
@@ -11,10 +11,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #define QUEUESIZE 1024
-#define HASHSIZE 4096
+#define SLOTSIZE 64
 #define SMALLSTRING 2048
+// the default max size of package with 4 bytes header
+#define MAXPACKAGE (16 * 1024 * 1024)
+// the fd is discarding the data after an error
+#define READ_DISCARD INT_MIN
 
 #define TYPE_DATA 1
 #define TYPE_MORE 2
@@ -25,7 +30,8 @@
 #define TYPE_INIT 7
 
 /*
-	Each package is uint16 + data , uint16 (serialized in big-endian) is the number of bytes comprising the data .
+	Each package is uint16 (or uint32, see netpack.queue) + data ,
+	uint16 (serialized in big-endian) is the number of bytes comprising the data .
  */
 
 struct netpack {
@@ -37,15 +43,20 @@ struct netpack {
 struct uncomplete {
 	struct netpack pack;
 	struct uncomplete * next;
-	int read;
-	int header;
+	int read;	// -n : n bytes of header are read
+	uint8_t header[4];
 };
 
 struct queue {
 	int cap;
 	int head;
 	int tail;
-	struct uncomplete * hash[HASHSIZE];
+	int header;	// 2 or 4
+	int max;	// max size of package
+	// the uncomplete packages indexed by the low bits of fd (socket id is unique in the low bits among the alive sockets)
+	int slot_cap;
+	int slot_n;
+	struct uncomplete ** slot;
 	struct netpack queue[QUEUESIZE];
 };
 
@@ -66,10 +77,13 @@ lclear(lua_State *L) {
 		return 0;
 	}
 	int i;
-	for (i=0;i<HASHSIZE;i++) {
-		clear_list(q->hash[i]);
-		q->hash[i] = NULL;
+	for (i=0;i<q->slot_cap;i++) {
+		clear_list(q->slot[i]);
 	}
+	skynet_free(q->slot);
+	q->slot = NULL;
+	q->slot_cap = 0;
+	q->slot_n = 0;
 	if (q->head > q->tail) {
 		q->tail += q->cap;
 	}
@@ -83,49 +97,84 @@ lclear(lua_State *L) {
 }
 
 static inline int
-hash_fd(int fd) {
-	int a = fd >> 24;
-	int b = fd >> 12;
-	int c = fd;
-	return (int)(((uint32_t)(a + b + c)) % HASHSIZE);
+slot_fd(struct queue *q, int fd) {
+	return (int)((uint32_t)fd & (uint32_t)(q->slot_cap - 1));
 }
 
 static struct uncomplete *
 find_uncomplete(struct queue *q, int fd) {
-	if (q == NULL)
+	if (q == NULL || q->slot_n == 0)
 		return NULL;
-	int h = hash_fd(fd);
-	struct uncomplete * uc = q->hash[h];
-	if (uc == NULL)
-		return NULL;
-	if (uc->pack.id == fd) {
-		q->hash[h] = uc->next;
-		return uc;
-	}
-	struct uncomplete * last = uc;
-	while (last->next) {
-		uc = last->next;
+	struct uncomplete ** p = &q->slot[slot_fd(q, fd)];
+	struct uncomplete * uc;
+	while ((uc = *p)) {
 		if (uc->pack.id == fd) {
-			last->next = uc->next;
+			*p = uc->next;
+			--q->slot_n;
 			return uc;
 		}
-		last = uc;
+		p = &uc->next;
 	}
 	return NULL;
 }
 
+static void
+insert_uncomplete(struct queue *q, struct uncomplete *uc) {
+	if (q->slot_n >= q->slot_cap) {
+		// rehash
+		int cap = q->slot_cap ? q->slot_cap * 2 : SLOTSIZE;
+		struct uncomplete ** slot = skynet_malloc(cap * sizeof(*slot));
+		memset(slot, 0, cap * sizeof(*slot));
+		int i;
+		for (i=0;i<q->slot_cap;i++) {
+			struct uncomplete * u = q->slot[i];
+			while (u) {
+				struct uncomplete * next = u->next;
+				int h = (int)((uint32_t)u->pack.id & (uint32_t)(cap - 1));
+				u->next = slot[h];
+				slot[h] = u;
+				u = next;
+			}
+		}
+		skynet_free(q->slot);
+		q->slot = slot;
+		q->slot_cap = cap;
+	}
+	int h = slot_fd(q, uc->pack.id);
+	uc->next = q->slot[h];
+	q->slot[h] = uc;
+	++q->slot_n;
+}
+
+static int
+lgc(lua_State *L) {
+	return lclear(L);
+}
+
+static struct queue *
+new_queue(lua_State *L, int cap) {
+	struct queue *q = lua_newuserdatauv(L, sizeof(struct queue) + (cap - QUEUESIZE) * sizeof(struct netpack), 0);
+	q->cap = cap;
+	q->head = 0;
+	q->tail = 0;
+	q->header = 2;
+	q->max = 0xffff;
+	q->slot_cap = 0;
+	q->slot_n = 0;
+	q->slot = NULL;
+	if (luaL_newmetatable(L, "netpack_queue")) {
+		lua_pushcfunction(L, lgc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	return q;
+}
+
 static struct queue *
 get_queue(lua_State *L) {
 	struct queue *q = lua_touserdata(L,1);
 	if (q == NULL) {
-		q = lua_newuserdatauv(L, sizeof(struct queue), 0);
-		q->cap = QUEUESIZE;
-		q->head = 0;
-		q->tail = 0;
-		int i;
-		for (i=0;i<HASHSIZE;i++) {
-			q->hash[i] = NULL;
-		}
+		q = new_queue(L, QUEUESIZE);
 		lua_replace(L, 1);
 	}
 	return q;
@@ -133,12 +182,17 @@ get_queue(lua_State *L) {
 
 static void
 expand_queue(lua_State *L, struct queue *q) {
-	struct queue *nq = lua_newuserdatauv(L, sizeof(struct queue) + q->cap * sizeof(struct netpack), 0);
-	nq->cap = q->cap + QUEUESIZE;
+	struct queue *nq = new_queue(L, q->cap + QUEUESIZE);
 	nq->head = 0;
 	nq->tail = q->cap;
-	memcpy(nq->hash, q->hash, sizeof(nq->hash));
-	memset(q->hash, 0, sizeof(q->hash));
+	nq->header = q->header;
+	nq->max = q->max;
+	nq->slot_cap = q->slot_cap;
+	nq->slot_n = q->slot_n;
+	nq->slot = q->slot;
+	q->slot_cap = 0;
+	q->slot_n = 0;
+	q->slot = NULL;
 	int i;
 	for (i=0;i<q->cap;i++) {
 		int idx = (q->head + i) % q->cap;
@@ -170,49 +224,69 @@ push_data(lua_State *L, int fd, void *buffer, int size, int clone) {
 static struct uncomplete *
 save_uncomplete(lua_State *L, int fd) {
 	struct queue *q = get_queue(L);
-	int h = hash_fd(fd);
 	struct uncomplete * uc = skynet_malloc(sizeof(struct uncomplete));
 	memset(uc, 0, sizeof(*uc));
-	uc->next = q->hash[h];
 	uc->pack.id = fd;
-	q->hash[h] = uc;
+	insert_uncomplete(q, uc);
 
 	return uc;
 }
 
-static inline int
-read_size(uint8_t * buffer) {
-	int r = (int)buffer[0] << 8 | (int)buffer[1];
+static inline int64_t
+read_size(uint8_t * buffer, int header) {
+	int64_t r = 0;
+	int i;
+	for (i=0;i<header;i++) {
+		r = r << 8 | buffer[i];
+	}
 	return r;
 }
 
-static void
-push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
-	if (size == 1) {
+// save the uncomplete header or package, returns false if the package is too large
+static int
+save_more(lua_State *L, int fd, uint8_t *buffer, int size) {
+	struct queue *q = get_queue(L);
+	int header = q->header;
+	if (size < header) {
 		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = -1;
-		uc->header = *buffer;
-		return;
+		uc->read = -size;
+		memcpy(uc->header, buffer, size);
+		return 1;
 	}
-	int pack_size = read_size(buffer);
-	buffer += 2;
-	size -= 2;
-
-	if (size < pack_size) {
-		struct uncomplete * uc = save_uncomplete(L, fd);
-		uc->read = size;
-		uc->pack.size = pack_size;
-		uc->pack.buffer = skynet_malloc(pack_size);
-		memcpy(uc->pack.buffer, buffer, size);
-		return;
+	int64_t pack_size = read_size(buffer, header);
+	if (pack_size > q->max) {
+		return 0;
 	}
-	push_data(L, fd, buffer, pack_size, 1);
+	struct uncomplete * uc = save_uncomplete(L, fd);
+	size -= header;
+	uc->read = size;
+	uc->pack.size = (int)pack_size;
+	uc->pack.buffer = skynet_malloc(pack_size);
+	memcpy(uc->pack.buffer, buffer + header, size);
+	return 1;
+}
 
-	buffer += pack_size;
-	size -= pack_size;
-	if (size > 0) {
-		push_more(L, fd, buffer, size);
+// push the complete packages into queue, and save the last uncomplete one. returns false if a package is too large
+static int
+push_more(lua_State *L, int fd, uint8_t *buffer, int size) {
+	while (size > 0) {
+		struct queue *q = get_queue(L);
+		int header = q->header;
+		if (size < header) {
+			return save_more(L, fd, buffer, size);
+		}
+		int64_t pack_size = read_size(buffer, header);
+		if (pack_size > q->max) {
+			return 0;
+		}
+		if (size - header < pack_size) {
+			return save_more(L, fd, buffer, size);
+		}
+		push_data(L, fd, buffer + header, (int)pack_size, 1);
+		buffer += header + pack_size;
+		size -= header + (int)pack_size;
 	}
+	return 1;
 }
 
 static void
@@ -225,33 +299,64 @@ close_uncomplete(lua_State *L, int fd) {
 	}
 }
 
+// discard the data of fd until it's closed, and report an error
+static int
+package_error(lua_State *L, int fd) {
+	struct uncomplete * uc = find_uncomplete(lua_touserdata(L,1), fd);
+	if (uc) {
+		skynet_free(uc->pack.buffer);
+		uc->pack.buffer = NULL;
+		insert_uncomplete(get_queue(L), uc);
+	} else {
+		uc = save_uncomplete(L, fd);
+	}
+	uc->read = READ_DISCARD;
+	lua_pushvalue(L, lua_upvalueindex(TYPE_ERROR));
+	lua_pushinteger(L, fd);
+	lua_pushliteral(L, "package too large");
+	return 4;
+}
+
 static int
 filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
-	struct queue *q = lua_touserdata(L,1);
+	struct queue *q = get_queue(L);
+	int header = q->header;
 	struct uncomplete * uc = find_uncomplete(q, fd);
 	if (uc) {
+		if (uc->read == READ_DISCARD) {
+			insert_uncomplete(q, uc);
+			return 1;
+		}
 		// fill uncomplete
 		if (uc->read < 0) {
-			// read size
-			assert(uc->read == -1);
-			int pack_size = *buffer;
-			pack_size |= uc->header << 8 ;
-			++buffer;
-			--size;
-			uc->pack.size = pack_size;
+			// read header
+			int n = -uc->read;
+			while (n < header && size > 0) {
+				uc->header[n++] = *buffer++;
+				--size;
+			}
+			if (n < header) {
+				uc->read = -n;
+				insert_uncomplete(q, uc);
+				return 1;
+			}
+			int64_t pack_size = read_size(uc->header, header);
+			if (pack_size > q->max) {
+				skynet_free(uc);
+				return package_error(L, fd);
+			}
+			uc->pack.size = (int)pack_size;
 			uc->pack.buffer = skynet_malloc(pack_size);
 			uc->read = 0;
 		}
 		int need = uc->pack.size - uc->read;
 		if (size < need) {
-			memcpy(uc->pack.buffer + uc->read, buffer, size);
+			memcpy((uint8_t *)uc->pack.buffer + uc->read, buffer, size);
 			uc->read += size;
-			int h = hash_fd(fd);
-			uc->next = q->hash[h];
-			q->hash[h] = uc;
+			insert_uncomplete(q, uc);
 			return 1;
 		}
-		memcpy(uc->pack.buffer + uc->read, buffer, need);
+		memcpy((uint8_t *)uc->pack.buffer + uc->read, buffer, need);
 		buffer += need;
 		size -= need;
 		if (size == 0) {
@@ -265,28 +370,25 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 		// more data
 		push_data(L, fd, uc->pack.buffer, uc->pack.size, 0);
 		skynet_free(uc);
-		push_more(L, fd, buffer, size);
+		if (!push_more(L, fd, buffer, size))
+			return package_error(L, fd);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	} else {
-		if (size == 1) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = -1;
-			uc->header = *buffer;
+		if (size < header) {
+			save_more(L, fd, buffer, size);
 			return 1;
 		}
-		int pack_size = read_size(buffer);
-		buffer+=2;
-		size-=2;
-
-		if (size < pack_size) {
-			struct uncomplete * uc = save_uncomplete(L, fd);
-			uc->read = size;
-			uc->pack.size = pack_size;
-			uc->pack.buffer = skynet_malloc(pack_size);
-			memcpy(uc->pack.buffer, buffer, size);
+		int64_t pack_size = read_size(buffer, header);
+		if (pack_size > q->max) {
+			return package_error(L, fd);
+		}
+		if (size - header < pack_size) {
+			save_more(L, fd, buffer, size);
 			return 1;
 		}
+		buffer += header;
+		size -= header;
 		if (size == pack_size) {
 			// just one package
 			lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
@@ -298,10 +400,11 @@ filter_data_(lua_State *L, int fd, uint8_t * buffer, int size) {
 			return 5;
 		}
 		// more data
-		push_data(L, fd, buffer, pack_size, 1);
+		push_data(L, fd, buffer, (int)pack_size, 1);
 		buffer += pack_size;
-		size -= pack_size;
-		push_more(L, fd, buffer, size);
+		size -= (int)pack_size;
+		if (!push_more(L, fd, buffer, size))
+			return package_error(L, fd);
 		lua_pushvalue(L, lua_upvalueindex(TYPE_MORE));
 		return 2;
 	}
@@ -311,8 +414,8 @@ static inline int
 filter_data(lua_State *L, int fd, uint8_t * buffer, int size) {
 	int ret = filter_data_(L, fd, buffer, size);
 	// buffer is the data of socket message, it malloc at socket_server.c : function forward_message .
-	// it should be free before return,
-	skynet_free(buffer);
+	// it should be free before return, put it back to read buffer pool.
+	skynet_socket_free_buffer(buffer, size);
 	return ret;
 }
 
@@ -354,6 +457,13 @@ lfilter(lua_State *L) {
 		// ignore listen id (message->id)
 		assert(size == -1);	// never padding string
 		return filter_data(L, message->id, (uint8_t *)buffer, message->ud);
+	case SKYNET_SOCKET_TYPE_FRAME:
+		// the package is split by socket thread (see socket.frame), forward it without copy
+		lua_pushvalue(L, lua_upvalueindex(TYPE_DATA));
+		lua_pushinteger(L, message->id);
+		lua_pushlightuserdata(L, buffer);
+		lua_pushinteger(L, message->ud);
+		return 5;
 	case SKYNET_SOCKET_TYPE_CONNECT:
 		lua_pushvalue(L, lua_upvalueindex(TYPE_INIT));
 		lua_pushinteger(L, message->id);
@@ -413,6 +523,57 @@ lpop(lua_State *L) {
 	return 3;
 }
 
+/*
+	userdata queue
+	return
+		table { fd1, msg1, size1, fd2, msg2, size2, ... } all the packages in queue (nil if empty)
+ */
+static int
+lbatch(lua_State *L) {
+	struct queue * q = lua_touserdata(L, 1);
+	if (q == NULL || q->head == q->tail)
+		return 0;
+	int n = q->tail - q->head;
+	if (n < 0)
+		n += q->cap;
+	lua_createtable(L, n * 3, 0);
+	int i = 0;
+	while (q->head != q->tail) {
+		struct netpack *np = &q->queue[q->head];
+		if (++q->head >= q->cap) {
+			q->head = 0;
+		}
+		lua_pushinteger(L, np->id);
+		lua_rawseti(L, -2, ++i);
+		lua_pushlightuserdata(L, np->buffer);
+		lua_rawseti(L, -2, ++i);
+		lua_pushinteger(L, np->size);
+		lua_rawseti(L, -2, ++i);
+	}
+	return 1;
+}
+
+/*
+	integer header (2 or 4, default 2)
+	integer max (the max size of package, default 16M for 4 bytes header)
+	return userdata queue
+ */
+static int
+lqueue(lua_State *L) {
+	int header = luaL_optinteger(L, 1, 2);
+	if (header != 2 && header != 4) {
+		return luaL_error(L, "Invalid package header size %d", header);
+	}
+	lua_Integer max = luaL_optinteger(L, 2, header == 2 ? 0xffff : MAXPACKAGE);
+	if (max <= 0 || max > (header == 2 ? 0xffff : INT_MAX - 4)) {
+		return luaL_error(L, "Invalid max package size %d", (int)max);
+	}
+	struct queue *q = new_queue(L, QUEUESIZE);
+	q->header = header;
+	q->max = (int)max;
+	return 1;
+}
+
 /*
 	string msg | lightuserdata/integer
 
@@ -432,25 +593,37 @@ tolstring(lua_State *L, size_t *sz, int index) {
 }
 
 static inline void
-write_size(uint8_t * buffer, int len) {
-	buffer[0] = (len >> 8) & 0xff;
-	buffer[1] = len & 0xff;
+write_size(uint8_t * buffer, size_t len, int header) {
+	int i;
+	for (i=0;i<header;i++) {
+		buffer[i] = (len >> ((header - 1 - i) * 8)) & 0xff;
+	}
 }
 
+/*
+	string msg | lightuserdata/integer
+	integer header (2 or 4, default 2)
+
+	lightuserdata/integer
+ */
 static int
 lpack(lua_State *L) {
 	size_t len;
 	const char * ptr = tolstring(L, &len, 1);
-	if (len >= 0x10000) {
+	int header = luaL_optinteger(L, lua_isuserdata(L, 1) ? 3 : 2, 2);
+	if (header != 2 && header != 4) {
+		return luaL_error(L, "Invalid package header size %d", header);
+	}
+	if (len > (header == 2 ? 0xffff : INT_MAX - 4)) {
 		return luaL_error(L, "Invalid size (too long) of data : %d", (int)len);
 	}
 
-	uint8_t * buffer = skynet_malloc(len + 2);
-	write_size(buffer, len);
-	memcpy(buffer+2, ptr, len);
+	uint8_t * buffer = skynet_malloc(len + header);
+	write_size(buffer, len, header);
+	memcpy(buffer+header, ptr, len);
 
 	lua_pushlightuserdata(L, buffer);
-	lua_pushinteger(L, len + 2);
+	lua_pushinteger(L, len + header);
 
 	return 2;
 }
@@ -473,6 +646,8 @@ luaopen_skynet_netpack(lua_State *L) {
 	luaL_checkversion(L);
 	luaL_Reg l[] = {
 		{ "pop", lpop },
+		{ "batch", lbatch },
+		{ "queue", lqueue },
 		{ "pack", lpack },
 		{ "clear", lclear },
 		{ "tostring", ltostring },
@@ -16,15 +16,23 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "skynet.h"
 #include "skynet_socket.h"
+#include "buffer_pool.h"
 
 #define BACKLOG 32
 // 2 ** 12 == 4096
 #define LARGE_PAGE_NODE 12
 #define POOL_SIZE_WARNING 32
 #define BUFFER_LIMIT (256 * 1024)
+#define CONTIGUOUS_MIN 4096
+// the contiguous block larger than it is freed when the buffer is empty
+#define CONTIGUOUS_KEEP (64 * 1024)
 
 struct buffer_node {
 	char * msg;
@@ -32,11 +40,20 @@ struct buffer_node {
 	struct buffer_node *next;
 };
 
+// the separator not longer than it remembers the scan position of readline
+#define SCAN_SEP 8
+
 struct socket_buffer {
 	int size;
 	int offset;
 	struct buffer_node *head;
 	struct buffer_node *tail;
+	int scan;	// readline 已经扫描过的字节数 (不包含分隔符的起点), 读出数据后清零
+	int scan_seplen;
+	char scan_sep[SCAN_SEP];
+	bool contiguous;	// 连续模式: 数据拷贝到 contiguous_node 的一块连续内存中, 不使用 pool
+	int cap;	// 连续内存的容量
+	struct buffer_node contiguous_node;
 };
 
 static int
@@ -47,7 +64,7 @@ lfreepool(lua_State *L) {
 	for (i=0;i<sz;i++) {
 		struct buffer_node *node = &pool[i];
 		if (node->msg) {
-			skynet_free(node->msg);
+			skynet_socket_free_buffer(node->msg, node->sz);
 			node->msg = NULL;
 		}
 	}
@@ -79,10 +96,52 @@ lnewbuffer(lua_State *L) {
 	sb->offset = 0;
 	sb->head = NULL;
 	sb->tail = NULL;
+	sb->scan = 0;
+	sb->scan_seplen = 0;
+	sb->contiguous = false;
+	sb->cap = 0;
+	sb->contiguous_node.msg = NULL;
+	sb->contiguous_node.sz = 0;
+	sb->contiguous_node.next = NULL;
 	
 	return 1;
 }
 
+/*
+	Contiguous mode (socket.contiguous) : the data is copied into one growable block when it's pushed,
+	so the buffer has one node only, and the reads never stitch nodes. It's not a wrapping ring, the unread bytes
+	are moved to the front (or the block grows) when the tail reaches the end, so the unread bytes are always
+	contiguous and socket.read(n) is one memcpy.
+ */
+
+// returns the space for sz bytes at the tail of the contiguous block
+static char *
+contiguous_reserve(struct socket_buffer *sb, int sz) {
+	struct buffer_node *node = &sb->contiguous_node;
+	if (sb->head == NULL) {
+		sb->head = sb->tail = node;
+		sb->offset = 0;
+		node->sz = 0;
+	}
+	if (node->sz + sz > sb->cap) {
+		int used = node->sz - sb->offset;
+		if (sb->offset > 0) {
+			memmove(node->msg, node->msg + sb->offset, used);
+			node->sz = used;
+			sb->offset = 0;
+		}
+		// keep it half empty at least, so the bytes moved are not more than the bytes read since last move
+		if ((used + sz) * 2 > sb->cap) {
+			int cap = sb->cap ? sb->cap : CONTIGUOUS_MIN;
+			while (cap < (used + sz) * 2)
+				cap *= 2;
+			node->msg = skynet_realloc(node->msg, cap);
+			sb->cap = cap;
+		}
+	}
+	return node->msg + node->sz;
+}
+
 /*
 	userdata send_buffer
 	table pool
@@ -113,6 +172,14 @@ lpushbuffer(lua_State *L) {
 	int pool_index = 2;
 	luaL_checktype(L,pool_index,LUA_TTABLE);
 	int sz = luaL_checkinteger(L,4);
+	if (sb->contiguous) {
+		memcpy(contiguous_reserve(sb, sz), msg, sz);
+		skynet_socket_free_buffer(msg, sz);
+		sb->contiguous_node.sz += sz;
+		sb->size += sz;
+		lua_pushinteger(L, sb->size);
+		return 1;
+	}
 	lua_rawgeti(L,pool_index,1);
 	struct buffer_node * free_node = lua_touserdata(L,-1);	// sb poolt msg size free_node
 	lua_pop(L,1);
@@ -157,6 +224,18 @@ static void
 return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
 	struct buffer_node *free_node = sb->head;
 	sb->offset = 0;
+	sb->scan = 0;
+	if (free_node == &sb->contiguous_node) {
+		// keep the memory for next push, unless it's too large
+		sb->head = sb->tail = NULL;
+		free_node->sz = 0;
+		if (sb->cap > CONTIGUOUS_KEEP) {
+			skynet_free(free_node->msg);
+			free_node->msg = NULL;
+			sb->cap = 0;
+		}
+		return;
+	}
 	sb->head = free_node->next;
 	if (sb->head == NULL) {
 		sb->tail = NULL;
@@ -164,7 +243,7 @@ return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
 	lua_rawgeti(L,pool,1);
 	free_node->next = lua_touserdata(L,-1);
 	lua_pop(L,1);
-	skynet_free(free_node->msg);
+	skynet_socket_free_buffer(free_node->msg, free_node->sz);
 	free_node->msg = NULL;
 
 	free_node->sz = 0;
@@ -172,9 +251,67 @@ return_free_node(lua_State *L, int pool, struct socket_buffer *sb) {
 	lua_rawseti(L, pool, 1);
 }
 
+static int
+lgcbuffer(lua_State *L) {
+	struct socket_buffer * sb = lua_touserdata(L, 1);
+	skynet_free(sb->contiguous_node.msg);
+	sb->contiguous_node.msg = NULL;
+	sb->cap = 0;
+	return 0;
+}
+
+/*
+	userdata send_buffer
+	table pool
+
+	Switch the buffer to contiguous mode, the buffered nodes are copied and returned to pool.
+ */
+static int
+lcontiguous(lua_State *L) {
+	struct socket_buffer * sb = lua_touserdata(L, 1);
+	if (sb == NULL) {
+		return luaL_error(L, "Need buffer object at param 1");
+	}
+	luaL_checktype(L,2,LUA_TTABLE);
+	if (sb->contiguous)
+		return 0;
+	if (luaL_newmetatable(L, "socket_buffer")) {
+		lua_pushcfunction(L, lgcbuffer);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, 1);
+	int size = sb->size;
+	char * msg = NULL;
+	int cap = 0;
+	if (size > 0) {
+		cap = CONTIGUOUS_MIN;
+		while (cap < size)
+			cap *= 2;
+		msg = skynet_malloc(cap);
+		int n = 0;
+		while (sb->head) {
+			struct buffer_node *current = sb->head;
+			memcpy(msg + n, current->msg + sb->offset, current->sz - sb->offset);
+			n += current->sz - sb->offset;
+			return_free_node(L,2,sb);
+		}
+	}
+	sb->contiguous = true;
+	sb->cap = cap;
+	struct buffer_node *node = &sb->contiguous_node;
+	node->msg = msg;
+	node->sz = size;
+	node->next = NULL;
+	if (size > 0) {
+		sb->head = sb->tail = node;
+	}
+	return 0;
+}
+
 static void
 pop_lstring(lua_State *L, struct socket_buffer *sb, int sz, int skip) {
 	struct buffer_node * current = sb->head;
+	sb->scan = 0;
 	if (sz < current->sz - sb->offset) {
 		lua_pushlstring(L, current->msg + sb->offset, sz-skip);
 		sb->offset+=sz;
@@ -214,6 +351,23 @@ pop_lstring(lua_State *L, struct socket_buffer *sb, int sz, int skip) {
 	luaL_pushresult(&b);
 }
 
+// drop sz bytes from the head of socket buffer
+static void
+skip_buffer(lua_State *L, struct socket_buffer *sb, int sz) {
+	sb->size -= sz;
+	sb->scan = 0;
+	while (sz > 0) {
+		struct buffer_node *current = sb->head;
+		int bytes = current->sz - sb->offset;
+		if (bytes > sz) {
+			sb->offset += sz;
+			return;
+		}
+		sz -= bytes;
+		return_free_node(L,2,sb);
+	}
+}
+
 static int
 lheader(lua_State *L) {
 	size_t len;
@@ -300,8 +454,8 @@ lreadall(lua_State *L) {
 static int
 ldrop(lua_State *L) {
 	void * msg = lua_touserdata(L,1);
-	luaL_checkinteger(L,2);
-	skynet_free(msg);
+	int sz = luaL_checkinteger(L,2);
+	skynet_socket_free_buffer(msg, sz);
 	return 0;
 }
 
@@ -324,10 +478,45 @@ check_sep(struct buffer_node * node, int from, const char *sep, int seplen) {
 	}
 }
 
+// find sep from the position from, returns the position or -1 if not found
+static int
+find_sep(struct socket_buffer *sb, int from, const char *sep, int seplen) {
+	int last = sb->size - seplen;	// the last position sep can start
+	struct buffer_node *current = sb->head;
+	int pos = 0;	// the position of the first byte of current node
+	int offset = sb->offset;
+	while (current && pos + current->sz - offset <= from) {
+		pos += current->sz - offset;
+		current = current->next;
+		offset = 0;
+	}
+	while (current && from <= last) {
+		const char * base = current->msg + offset;
+		const char * end = base + current->sz - offset;
+		if (end - base > last - pos + 1)
+			end = base + last - pos + 1;
+		const char * p = base + (from - pos);
+		// memchr is vectorized by libc, check the whole sep at the first byte only
+		while ((p = memchr(p, sep[0], end - p))) {
+			if (seplen == 1 || check_sep(current, (int)(p - current->msg), sep, seplen))
+				return pos + (int)(p - base);
+			++p;
+		}
+		pos += current->sz - offset;
+		from = pos;
+		current = current->next;
+		offset = 0;
+	}
+	return -1;
+}
+
 /*
 	userdata send_buffer
 	table pool , nil for check
 	string sep
+
+	The scan position is remembered if the sep is not found (or only checked), so the next call doesn't
+	scan the same bytes again when the buffer only grows.
  */
 static int
 lreadline(lua_State *L) {
@@ -339,33 +528,290 @@ lreadline(lua_State *L) {
 	bool check = !lua_istable(L, 2);
 	size_t seplen = 0;
 	const char *sep = luaL_checklstring(L,3,&seplen);
-	int i;
-	struct buffer_node *current = sb->head;
-	if (current == NULL)
+	if (sb->head == NULL || seplen == 0)
+		return 0;
+	int from = 0;
+	bool remember = seplen <= SCAN_SEP;
+	if (remember) {
+		if (sb->scan_seplen == (int)seplen && memcmp(sb->scan_sep, sep, seplen) == 0) {
+			from = sb->scan;
+		} else {
+			sb->scan_seplen = (int)seplen;
+			memcpy(sb->scan_sep, sep, seplen);
+		}
+	}
+	int i = find_sep(sb, from, sep, (int)seplen);
+	if (i < 0) {
+		if (remember) {
+			// the positions before it are checked
+			int scan = sb->size - (int)seplen + 1;
+			sb->scan = scan > 0 ? scan : 0;
+		}
 		return 0;
-	int from = sb->offset;
-	int bytes = current->sz - from;
-	for (i=0;i<=sb->size - (int)seplen;i++) {
-		if (check_sep(current, from, sep, seplen)) {
-			if (check) {
-				lua_pushboolean(L,true);
+	}
+	if (check) {
+		if (remember)
+			sb->scan = i;
+		lua_pushboolean(L,true);
+	} else {
+		pop_lstring(L, sb, i+seplen, seplen);
+		sb->size -= i+seplen;
+	}
+	return 1;
+}
+
+/*
+	HTTP/1.x request header parser, it works on the nodes of socket buffer directly.
+
+	The end of header (an empty line) is found by memchr (vectorized by libc) for '\n', and the header is parsed
+	in place if it's in one node (copied to a temporary buffer if not). Lines end with "\r\n" or "\n".
+ */
+
+// find the end of header (the position after the empty line) from the position from, returns 0 if not found
+static int
+find_header_end(struct socket_buffer *sb, int from) {
+	struct buffer_node *current = sb->head;
+	int pos = 0;	// the position of the first byte of current node
+	int offset = sb->offset;
+	while (current && pos + current->sz - offset <= from) {
+		pos += current->sz - offset;
+		current = current->next;
+		offset = 0;
+	}
+	int last = -3;	// the position of last '\n'
+	bool cr = false;	// the byte after last '\n' is '\r'
+	while (current) {
+		const char * base = current->msg + offset;
+		int sz = current->sz - offset;
+		const char * p = base + (from > pos ? from - pos : 0);
+		const char * end = base + sz;
+		const char * nl;
+		while ((nl = memchr(p, '\n', end - p))) {
+			int n = pos + (int)(nl - base);
+			// an empty line : "\n" or "\r\n" after the last '\n'
+			if (n == last + 1 || (n == last + 2 && cr))
+				return n + 1;
+			last = n;
+			p = nl + 1;
+			if (p < end) {
+				cr = (*p == '\r');
 			} else {
-				pop_lstring(L, sb, i+seplen, seplen);
-				sb->size -= i+seplen;
+				cr = (current->next && current->next->sz > 0 && current->next->msg[0] == '\r');
 			}
-			return 1;
 		}
-		++from;
-		--bytes;
-		if (bytes == 0) {
+		pos += sz;
+		current = current->next;
+		offset = 0;
+	}
+	return 0;
+}
+
+// returns the next line [*line, *line + *sz), and strip '\r'
+static char *
+next_line(char * p, char * end, char **line, int *sz) {
+	char * nl = memchr(p, '\n', end - p);
+	if (nl == NULL)
+		nl = end;
+	*line = p;
+	*sz = (int)(nl - p);
+	if (*sz > 0 && p[*sz-1] == '\r')
+		--*sz;
+	return nl < end ? nl + 1 : end;
+}
+
+static inline bool
+is_space(char c) {
+	return c == ' ' || c == '\t';
+}
+
+// parse "METHOD url HTTP/x.y", push method, url, version
+static bool
+parse_request_line(lua_State *L, const char * line, int sz) {
+	int i = 0;
+	while (i < sz && ((line[i] >= 'a' && line[i] <= 'z') || (line[i] >= 'A' && line[i] <= 'Z')))
+		++i;
+	if (i == 0 || i >= sz || !is_space(line[i]))
+		return false;
+	int method = i;
+	while (i < sz && is_space(line[i]))
+		++i;
+	int url = i;
+	int e = sz;
+	while (e > url && ((line[e-1] >= '0' && line[e-1] <= '9') || line[e-1] == '.'))
+		--e;
+	int version = e;
+	if (version == sz || version - url < 6 || memcmp(line + version - 5, "HTTP/", 5) != 0)
+		return false;
+	e = version - 5;
+	if (!is_space(line[e-1]))
+		return false;
+	while (e > url && is_space(line[e-1]))
+		--e;
+	char tmp[16];
+	int vsz = sz - version;
+	if (vsz >= (int)sizeof(tmp))
+		return false;
+	memcpy(tmp, line + version, vsz);
+	tmp[vsz] = '\0';
+	lua_pushlstring(L, line, method);
+	lua_pushlstring(L, line + url, e - url);
+	if (lua_stringtonumber(L, tmp) == 0) {
+		lua_pop(L, 2);
+		return false;
+	}
+	return true;
+}
+
+// parse the header lines into the table at the top of stack, the names are lowercased. see internal.parseheader
+static bool
+parse_header_lines(lua_State *L, char * p, char * end) {
+	int header = lua_gettop(L);
+	int name = 0;	// the stack index of last name
+	while (p < end) {
+		char * line;
+		int sz;
+		p = next_line(p, end, &line, &sz);
+		if (sz == 0)
+			break;
+		if (line[0] == '\t') {
+			// append last line
+			if (name == 0)
+				return false;
+			lua_pushvalue(L, name);
+			if (lua_rawget(L, header) != LUA_TSTRING)
+				return false;
+			lua_pushlstring(L, line + 1, sz - 1);
+			lua_concat(L, 2);
+			lua_pushvalue(L, name);
+			lua_insert(L, -2);
+			lua_rawset(L, header);
+			continue;
+		}
+		char * colon = memchr(line, ':', sz);
+		if (colon == NULL)
+			return false;
+		int i;
+		int nsz = (int)(colon - line);
+		for (i=0;i<nsz;i++) {
+			if (line[i] >= 'A' && line[i] <= 'Z')
+				line[i] += 'a' - 'A';
+		}
+		if (name)
+			lua_settop(L, header);
+		lua_pushlstring(L, line, nsz);
+		name = lua_gettop(L);
+		char * value = colon + 1;
+		char * vend = line + sz;
+		while (value < vend && is_space(*value))
+			++value;
+		lua_pushvalue(L, name);
+		int t = lua_rawget(L, header);
+		if (t == LUA_TNIL) {
+			lua_pop(L, 1);
+			lua_pushvalue(L, name);
+			lua_pushlstring(L, value, vend - value);
+			lua_rawset(L, header);
+		} else if (t == LUA_TTABLE) {
+			lua_pushlstring(L, value, vend - value);
+			lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+			lua_pop(L, 1);
+		} else {
+			// the second value of the same name, convert it to a table
+			lua_createtable(L, 2, 0);
+			lua_insert(L, -2);
+			lua_rawseti(L, -2, 1);
+			lua_pushlstring(L, value, vend - value);
+			lua_rawseti(L, -2, 2);
+			lua_pushvalue(L, name);
+			lua_insert(L, -2);
+			lua_rawset(L, header);
+		}
+	}
+	lua_settop(L, header);
+	return true;
+}
+
+/*
+	userdata send_buffer
+	table pool
+	integer limit (the max size of header)
+	integer from (the bytes scanned by last call, optional)
+
+	return method, url, version, header
+		or nil, scanned : uncomplete, call it again with scanned when more data arrives
+		or false, 413 (the header is too large) or 400 (bad request)
+ */
+static int
+lreadrequest(lua_State *L) {
+	struct socket_buffer * sb = lua_touserdata(L, 1);
+	if (sb == NULL) {
+		return luaL_error(L, "Need buffer object at param 1");
+	}
+	luaL_checktype(L,2,LUA_TTABLE);
+	int limit = luaL_checkinteger(L, 3);
+	int from = luaL_optinteger(L, 4, 0);
+	// the empty line may start before from
+	from = from > 3 ? from - 3 : 0;
+	int len = sb->head ? find_header_end(sb, from) : 0;
+	if (len == 0) {
+		if (sb->size >= limit) {
+			lua_pushboolean(L, 0);
+			lua_pushinteger(L, 413);
+			return 2;
+		}
+		lua_pushnil(L);
+		lua_pushinteger(L, sb->size);
+		return 2;
+	}
+	if (len > limit) {
+		lua_pushboolean(L, 0);
+		lua_pushinteger(L, 413);
+		return 2;
+	}
+	struct buffer_node * current = sb->head;
+	char * header;
+	char * tmp = NULL;
+	if (current->sz - sb->offset >= len) {
+		// parse in place, these bytes are consumed by the header
+		header = current->msg + sb->offset;
+	} else {
+		tmp = skynet_malloc(len);
+		int n = 0;
+		int offset = sb->offset;
+		while (n < len) {
+			int sz = current->sz - offset;
+			if (sz > len - n)
+				sz = len - n;
+			memcpy(tmp + n, current->msg + offset, sz);
+			n += sz;
 			current = current->next;
-			from = 0;
-			if (current == NULL)
-				break;
-			bytes = current->sz;
+			offset = 0;
 		}
+		header = tmp;
 	}
-	return 0;
+	char * end = header + len;
+	char * p = header;
+	char * line;
+	int sz;
+	// skip the empty lines before request line
+	do {
+		p = next_line(p, end, &line, &sz);
+	} while (sz == 0 && p < end);
+	int top = lua_gettop(L);
+	bool ok = sz > 0 && parse_request_line(L, line, sz);
+	if (ok) {
+		lua_newtable(L);
+		ok = parse_header_lines(L, p, end);
+	}
+	skynet_free(tmp);
+	skip_buffer(L, sb, len);
+	if (!ok) {
+		lua_settop(L, top);
+		lua_pushboolean(L, 0);
+		lua_pushinteger(L, 400);
+		return 2;
+	}
+	return 4;
 }
 
 static int
@@ -414,6 +860,11 @@ lunpack(lua_State *L) {
 static const char *
 address_port(lua_State *L, char *tmp, const char * addr, int port_index, int *port) {
 	const char * host;
+	if (strncmp(addr, "unix:", 5) == 0) {
+		// unix domain socket : "unix:path", no port
+		*port = 0;
+		return addr;
+	}
 	if (lua_isnoneornil(L,port_index)) {
 		host = strchr(addr, '[');
 		if (host) {
@@ -456,7 +907,7 @@ lconnect(lua_State *L) {
 	char tmp[sz];
 	int port = 0;
 	const char * host = address_port(L, tmp, addr, 2, &port);
-	if (port == 0) {
+	if (port == 0 && strncmp(host, "unix:", 5) != 0) {
 		return luaL_error(L, "Invalid port");
 	}
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -487,8 +938,14 @@ llisten(lua_State *L) {
 	const char * host = luaL_checkstring(L,1);
 	int port = luaL_checkinteger(L,2);
 	int backlog = luaL_optinteger(L,3,BACKLOG);
+	int reuseport = lua_toboolean(L,4);
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
-	int id = skynet_socket_listen(ctx, host,port,backlog);
+	int id;
+	if (reuseport) {
+		id = skynet_socket_listen_reuseport(ctx, host,port,backlog);
+	} else {
+		id = skynet_socket_listen(ctx, host,port,backlog);
+	}
 	if (id < 0) {
 		return luaL_error(L, "Listen error");
 	}
@@ -602,6 +1059,46 @@ lsendlow(lua_State *L) {
 	return 1;
 }
 
+/*
+	integer id
+	string filename
+	integer offset (default 0)
+	integer size (default to the end of file)
+ */
+static int
+lsendfile(lua_State *L) {
+#if defined(_WIN32)
+	return luaL_error(L, "sendfile is not supported");
+#else
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	const char * filename = luaL_checkstring(L, 2);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		lua_pushboolean(L, 0);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	lua_Integer size = (lua_Integer)st.st_size - offset;
+	size = luaL_optinteger(L, 4, size);
+	if (offset < 0 || size < 0 || offset + size > (lua_Integer)st.st_size) {
+		close(fd);
+		return luaL_error(L, "Invalid range (offset = %d, size = %d) of %s", (int)offset, (int)size, filename);
+	}
+	int err = skynet_socket_sendfile(ctx, id, fd, offset, size);
+	lua_pushboolean(L, !err);
+	return 1;
+#endif
+}
+
 static int
 lbind(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -635,6 +1132,84 @@ lnodelay(lua_State *L) {
 	return 0;
 }
 
+#define COALESCE_SIZE (64 * 1024)
+
+/*
+	integer id
+	integer size (default COALESCE_SIZE), false or 0 turns it off
+ */
+static int
+lcoalesce(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int size;
+	if (lua_isboolean(L, 2)) {
+		size = lua_toboolean(L, 2) ? COALESCE_SIZE : 0;
+	} else {
+		size = luaL_optinteger(L, 2, COALESCE_SIZE);
+	}
+	skynet_socket_coalesce(ctx, id, size);
+	return 0;
+}
+
+#define ZEROCOPY_SIZE (64 * 1024)
+
+/*
+	integer id
+	integer size (default ZEROCOPY_SIZE), false or 0 turns it off
+ */
+static int
+lzerocopy(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int size;
+	if (lua_isboolean(L, 2)) {
+		size = lua_toboolean(L, 2) ? ZEROCOPY_SIZE : 0;
+	} else {
+		size = luaL_optinteger(L, 2, ZEROCOPY_SIZE);
+	}
+	skynet_socket_zerocopy(ctx, id, size);
+	return 0;
+}
+
+/*
+	integer id
+	integer read bytes per second
+	integer read packets per second
+	integer write bytes per second
+	nil or 0 means unlimited
+ */
+static int
+lratelimit(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int read = luaL_optinteger(L, 2, 0);
+	int packet = luaL_optinteger(L, 3, 0);
+	int write = luaL_optinteger(L, 4, 0);
+	skynet_socket_ratelimit(ctx, id, read, packet, write);
+	return 0;
+}
+
+/*
+	integer id
+	integer header size (2 or 4), nil or 0 turns it off
+	integer max size of frame, nil or 0 for the limit of header
+	boolean batch
+ */
+static int
+lframe(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int header = luaL_optinteger(L, 2, 0);
+	if (header != 0 && header != 2 && header != 4) {
+		return luaL_error(L, "Invalid frame header size %d", header);
+	}
+	int max = luaL_optinteger(L, 3, 0);
+	int batch = lua_toboolean(L, 4);
+	skynet_socket_frame(ctx, id, header, max, batch);
+	return 0;
+}
+
 static int
 ludp(lua_State *L) {
 	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
@@ -738,6 +1313,12 @@ ludp_address(lua_State *L) {
 	const void * src = addr+3;
 	char tmp[256];
 	int family;
+	if (sz == 1) {
+		// unix domain datagram, the peer is unnamed
+		lua_pushliteral(L, "unix:");
+		lua_pushinteger(L, 0);
+		return 2;
+	}
 	if (sz == 1+2+4) {
 		family = AF_INET;
 	} else {
@@ -754,6 +1335,84 @@ ludp_address(lua_State *L) {
 	return 2;
 }
 
+/*
+	integer id
+	boolean batch (default true)
+ */
+static int
+ludp_batch(lua_State *L) {
+	struct skynet_context * ctx = lua_touserdata(L, lua_upvalueindex(1));
+	int id = luaL_checkinteger(L, 1);
+	int batch = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+	skynet_socket_udp_batch(ctx, id, batch);
+	return 0;
+}
+
+struct udp_batch {
+	char * buffer;
+	int sz;
+	int offset;
+};
+
+static void
+udp_batch_release(struct udp_batch *b) {
+	if (b->buffer) {
+		skynet_socket_free_buffer(b->buffer, b->sz);
+		b->buffer = NULL;
+	}
+}
+
+static int
+ludp_batch_gc(lua_State *L) {
+	udp_batch_release(lua_touserdata(L, 1));
+	return 0;
+}
+
+static int
+ludp_batch_next(lua_State *L) {
+	struct udp_batch *b = lua_touserdata(L, lua_upvalueindex(1));
+	if (b->buffer == NULL)
+		return 0;
+	const char *data, *addr;
+	int datasz, addrsz;
+	int offset = skynet_socket_udp_next(b->buffer, b->sz, b->offset, &data, &datasz, &addr, &addrsz);
+	if (offset < 0) {
+		udp_batch_release(b);
+		return 0;
+	}
+	lua_pushlstring(L, data, datasz);
+	lua_pushlstring(L, addr, addrsz);
+	b->offset = offset;
+	if (offset >= b->sz) {
+		// the last one
+		udp_batch_release(b);
+	}
+	return 2;
+}
+
+/*
+	lightuserdata msg (SKYNET_SOCKET_TYPE_UDPBATCH)
+	integer size
+
+	return iterator of (string data, string address), msg is released after the last one (or by gc)
+ */
+static int
+ludp_unpack(lua_State *L) {
+	char * msg = lua_touserdata(L, 1);
+	int sz = luaL_checkinteger(L, 2);
+	struct udp_batch *b = lua_newuserdatauv(L, sizeof(*b), 0);
+	b->buffer = msg;
+	b->sz = sz;
+	b->offset = 0;
+	if (luaL_newmetatable(L, "UDPBATCH")) {
+		lua_pushcfunction(L, ludp_batch_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	lua_pushcclosure(L, ludp_batch_next, 1);
+	return 1;
+}
+
 static void
 getinfo(lua_State *L, struct socket_info *si) {
 	lua_newtable(L);
@@ -802,20 +1461,45 @@ getinfo(lua_State *L, struct socket_info *si) {
 	lua_setfield(L, -2, "rtime");
 	lua_pushinteger(L, si->wtime);
 	lua_setfield(L, -2, "wtime");
+	lua_pushinteger(L, si->wcall);
+	lua_setfield(L, -2, "wcall");
 	lua_pushboolean(L, si->reading);
 	lua_setfield(L, -2, "reading");
 	lua_pushboolean(L, si->writing);
 	lua_setfield(L, -2, "writing");
+	if (si->tcpinfo) {
+		lua_pushinteger(L, si->rtt);
+		lua_setfield(L, -2, "rtt");
+		lua_pushinteger(L, si->rttvar);
+		lua_setfield(L, -2, "rttvar");
+		lua_pushinteger(L, si->retransmits);
+		lua_setfield(L, -2, "retransmits");
+		lua_pushinteger(L, si->cwnd);
+		lua_setfield(L, -2, "cwnd");
+		lua_pushinteger(L, si->unacked);
+		lua_setfield(L, -2, "unacked");
+	}
 	if (si->name[0]) {
 		lua_pushstring(L, si->name);
 		lua_setfield(L, -2, "peer");
 	}
 }
 
+// info([tcpinfo]) returns the list of all sockets, info(tcpinfo, id) returns the info of socket id or nil
 static int
 linfo(lua_State *L) {
+	int tcpinfo = lua_toboolean(L, 1);
+	if (!lua_isnoneornil(L, 2)) {
+		int id = luaL_checkinteger(L, 2);
+		struct socket_info * si = skynet_socket_info_id(id, tcpinfo);
+		if (si == NULL)
+			return 0;
+		getinfo(L, si);
+		socket_info_release(si);
+		return 1;
+	}
 	lua_newtable(L);
-	struct socket_info * si = skynet_socket_info();
+	struct socket_info * si = skynet_socket_info(tcpinfo);
 	struct socket_info * temp = si;
 	int n = 0;
 	while (temp) {
@@ -827,6 +1511,40 @@ linfo(lua_State *L) {
 	return 1;
 }
 
+static int
+lpoolstat(lua_State *L) {
+	struct buffer_pool_stat stat;
+	skynet_socket_buffer_stat(&stat);
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, stat.alloc);
+	lua_setfield(L, -2, "alloc");
+	lua_pushinteger(L, stat.hit);
+	lua_setfield(L, -2, "hit");
+	lua_pushinteger(L, stat.free);
+	lua_setfield(L, -2, "free");
+	lua_pushinteger(L, stat.recycle);
+	lua_setfield(L, -2, "recycle");
+	lua_pushinteger(L, stat.bytes);
+	lua_setfield(L, -2, "bytes");
+	return 1;
+}
+
+static int
+lpollstat(lua_State *L) {
+	struct socket_poll_stat stat;
+	skynet_socket_pollstat(&stat);
+	lua_createtable(L, 0, 4);
+	lua_pushinteger(L, stat.spin);
+	lua_setfield(L, -2, "spin");
+	lua_pushinteger(L, stat.hit);
+	lua_setfield(L, -2, "hit");
+	lua_pushinteger(L, stat.spin_us);
+	lua_setfield(L, -2, "spin_us");
+	lua_pushinteger(L, stat.block);
+	lua_setfield(L, -2, "block");
+	return 1;
+}
+
 static int
 lresolve(lua_State *L) {
 	const char * host = luaL_checkstring(L, 1);
@@ -865,10 +1583,15 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "drop", ldrop },
 		{ "readall", lreadall },
 		{ "clear", lclearbuffer },
+		{ "contiguous", lcontiguous },
 		{ "readline", lreadline },
+		{ "readrequest", lreadrequest },
 		{ "str2p", lstr2p },
 		{ "header", lheader },
 		{ "info", linfo },
+		{ "poolstat", lpoolstat },
+		{ "pollstat", lpollstat },
+		{ "udp_unpack", ludp_unpack },
 
 		{ "unpack", lunpack },
 		{ NULL, NULL },
@@ -881,16 +1604,22 @@ luaopen_skynet_socketdriver(lua_State *L) {
 		{ "listen", llisten },
 		{ "send", lsend },
 		{ "lsend", lsendlow },
+		{ "sendfile", lsendfile },
 		{ "bind", lbind },
 		{ "start", lstart },
 		{ "pause", lpause },
 		{ "nodelay", lnodelay },
+		{ "coalesce", lcoalesce },
+		{ "zerocopy", lzerocopy },
+		{ "ratelimit", lratelimit },
+		{ "frame", lframe },
 		{ "udp", ludp },
 		{ "udp_connect", ludp_connect },
 		{ "udp_dial", ludp_dial},
 		{ "udp_listen", ludp_listen},
 		{ "udp_send", ludp_send },
 		{ "udp_address", ludp_address },
+		{ "udp_batch", ludp_batch },
 		{ "resolve", lresolve },
 		{ NULL, NULL },
 	};
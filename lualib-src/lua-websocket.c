@@ -0,0 +1,344 @@
+#define LUA_LIB
+
+#include "skynet_malloc.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define UNMASK_AVX2
+#endif
+
+/*
+	WebSocket frame codec (RFC 6455) for lualib/http/websocket.lua
+
+	The payload of client frame is masked by a 4 bytes key, it's unmasked by SIMD (AVX2 if the cpu supports, or SSE2),
+	or 8 bytes a time for other platforms.
+
+	A codec object keeps a buffer for each connection, the fragments of a message are unmasked and joined in it
+	without temporary strings. The payload of an unfragmented frame is unmasked into the result string directly.
+ */
+
+// the buffer larger than it is freed after a message is popped
+#define KEEP_BUFFER (64 * 1024)
+
+struct codec {
+	char * buffer;
+	size_t sz;
+	size_t cap;
+};
+
+// xor 8 bytes a time, i is a multiple of 4 (the phase of key is 0)
+static void
+unmask_scalar(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t key[4], size_t i) {
+	uint32_t k32;
+	memcpy(&k32, key, 4);
+	uint64_t k64 = (uint64_t)k32 << 32 | k32;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t v;
+		memcpy(&v, src + i, 8);
+		v ^= k64;
+		memcpy(dst + i, &v, 8);
+	}
+	for (; i < n; i++) {
+		dst[i] = src[i] ^ key[i & 3];
+	}
+}
+
+#if defined(__SSE2__)
+
+static void
+unmask_sse2(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t key[4], size_t i) {
+	uint32_t k32;
+	memcpy(&k32, key, 4);
+	__m128i k = _mm_set1_epi32((int)k32);
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, k));
+	}
+	unmask_scalar(dst, src, n, key, i);
+}
+
+#endif
+
+#ifdef UNMASK_AVX2
+
+__attribute__((target("avx2")))
+static void
+unmask_avx2(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t key[4]) {
+	uint32_t k32;
+	memcpy(&k32, key, 4);
+	__m256i k = _mm256_set1_epi32((int)k32);
+	size_t i;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, k));
+	}
+	unmask_scalar(dst, src, n, key, i);
+}
+
+static int
+has_avx2(void) {
+	static int avx2 = -1;
+	if (avx2 < 0) {
+		__builtin_cpu_init();
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return avx2;
+}
+
+#endif
+
+static void
+unmask(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t key[4]) {
+#ifdef UNMASK_AVX2
+	if (n >= 64 && has_avx2()) {
+		unmask_avx2(dst, src, n, key);
+		return;
+	}
+#endif
+#if defined(__SSE2__)
+	unmask_sse2(dst, src, n, key, 0);
+#else
+	unmask_scalar(dst, src, n, key, 0);
+#endif
+}
+
+static char *
+reserve(struct codec *c, size_t n) {
+	size_t need = c->sz + n;
+	if (need > c->cap) {
+		size_t cap = c->cap == 0 ? 1024 : c->cap;
+		while (cap < need) {
+			cap *= 2;
+		}
+		c->buffer = skynet_realloc(c->buffer, cap);
+		c->cap = cap;
+	}
+	return c->buffer + c->sz;
+}
+
+// copy (or unmask if masked, the first 4 bytes of data is the key) the payload to the end of buffer, returns the size of payload
+static size_t
+put_payload(lua_State *L, struct codec *c, int index, bool masked) {
+	size_t sz;
+	const uint8_t * data = (const uint8_t *)luaL_checklstring(L, index, &sz);
+	if (masked) {
+		if (sz < 4)
+			luaL_error(L, "Invalid masked payload");
+		sz -= 4;
+		unmask((uint8_t *)reserve(c, sz), data + 4, sz, data);
+	} else {
+		memcpy(reserve(c, sz), data, sz);
+	}
+	return sz;
+}
+
+static struct codec *
+check_codec(lua_State *L) {
+	return (struct codec *)luaL_checkudata(L, 1, "WSCODEC");
+}
+
+static int
+lcodec_gc(lua_State *L) {
+	struct codec *c = check_codec(L);
+	skynet_free(c->buffer);
+	c->buffer = NULL;
+	c->sz = c->cap = 0;
+	return 0;
+}
+
+/*
+	userdata codec
+	string key .. payload
+	return string payload
+ */
+static int
+lcodec_unmask(lua_State *L) {
+	check_codec(L);
+	size_t sz;
+	const uint8_t * data = (const uint8_t *)luaL_checklstring(L, 2, &sz);
+	if (sz < 4)
+		return luaL_error(L, "Invalid masked payload");
+	sz -= 4;
+	// unmask into a lua buffer, the codec buffer is only for the fragments, so it doesn't keep the space of a large frame
+	luaL_Buffer b;
+	unmask((uint8_t *)luaL_buffinitsize(L, &b, sz), data + 4, sz, data);
+	luaL_pushresultsize(&b, sz);
+	return 1;
+}
+
+/*
+	userdata codec
+	string payload (key .. payload if masked)
+	boolean masked
+	return integer size of joined fragments
+ */
+static int
+lcodec_append(lua_State *L) {
+	struct codec *c = check_codec(L);
+	c->sz += put_payload(L, c, 2, lua_toboolean(L, 3));
+	lua_pushinteger(L, c->sz);
+	return 1;
+}
+
+/*
+	userdata codec
+	return string (the joined fragments)
+ */
+static int
+lcodec_message(lua_State *L) {
+	struct codec *c = check_codec(L);
+	lua_pushlstring(L, c->buffer ? c->buffer : "", c->sz);
+	c->sz = 0;
+	if (c->cap > KEEP_BUFFER) {
+		skynet_free(c->buffer);
+		c->buffer = NULL;
+		c->cap = 0;
+	}
+	return 1;
+}
+
+static int
+lnew(lua_State *L) {
+	struct codec *c = (struct codec *)lua_newuserdatauv(L, sizeof(*c), 0);
+	c->buffer = NULL;
+	c->sz = 0;
+	c->cap = 0;
+	if (luaL_newmetatable(L, "WSCODEC")) {
+		luaL_Reg l[] = {
+			{ "unmask", lcodec_unmask },
+			{ "append", lcodec_append },
+			{ "message", lcodec_message },
+			{ NULL, NULL },
+		};
+		luaL_newlib(L, l);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, lcodec_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+/*
+	string 2 bytes header
+	return boolean fin, integer opcode, boolean mask, integer payload length (or -2/-8 : the bytes of extended length)
+ */
+static int
+lheader(lua_State *L) {
+	size_t sz;
+	const uint8_t * h = (const uint8_t *)luaL_checklstring(L, 1, &sz);
+	if (sz != 2)
+		return luaL_error(L, "Invalid websocket header");
+	lua_pushboolean(L, h[0] & 0x80);
+	lua_pushinteger(L, h[0] & 0x0f);
+	lua_pushboolean(L, h[1] & 0x80);
+	int len = h[1] & 0x7f;
+	if (len == 126) {
+		len = -2;
+	} else if (len == 127) {
+		len = -8;
+	}
+	lua_pushinteger(L, len);
+	return 4;
+}
+
+/*
+	string extended length (2 or 8 bytes big-endian)
+	return integer
+ */
+static int
+llength(lua_State *L) {
+	size_t sz;
+	const uint8_t * s = (const uint8_t *)luaL_checklstring(L, 1, &sz);
+	if (sz != 2 && sz != 8)
+		return luaL_error(L, "Invalid websocket payload length");
+	uint64_t len = 0;
+	size_t i;
+	for (i=0;i<sz;i++) {
+		len = len << 8 | s[i];
+	}
+	if (len > (uint64_t)LUA_MAXINTEGER)
+		return luaL_error(L, "Invalid websocket payload length");
+	lua_pushinteger(L, (lua_Integer)len);
+	return 1;
+}
+
+/*
+	integer opcode
+	string payload (optional)
+	integer masking key (optional)
+	return string frame (fin is 1)
+ */
+static int
+lframe(lua_State *L) {
+	int op = (int)luaL_checkinteger(L, 1);
+	size_t sz = 0;
+	const uint8_t * payload = (const uint8_t *)luaL_optlstring(L, 2, "", &sz);
+	bool masked = !lua_isnoneornil(L, 3);
+	uint8_t key[4];
+	if (masked) {
+		uint32_t k = (uint32_t)luaL_checkinteger(L, 3);
+		key[0] = k >> 24;
+		key[1] = k >> 16;
+		key[2] = k >> 8;
+		key[3] = k;
+	}
+	uint8_t header[14];
+	int n = 2;
+	header[0] = 0x80 | (op & 0x0f);
+	uint8_t mask = masked ? 0x80 : 0;
+	if (sz < 126) {
+		header[1] = mask | (uint8_t)sz;
+	} else if (sz <= 0xffff) {
+		header[1] = mask | 126;
+		header[2] = sz >> 8;
+		header[3] = sz;
+		n = 4;
+	} else {
+		header[1] = mask | 127;
+		int i;
+		for (i=0;i<8;i++) {
+			header[2+i] = (uint64_t)sz >> (56 - i * 8);
+		}
+		n = 10;
+	}
+	if (masked) {
+		memcpy(header + n, key, 4);
+		n += 4;
+	}
+	luaL_Buffer b;
+	uint8_t * buffer = (uint8_t *)luaL_buffinitsize(L, &b, n + sz);
+	memcpy(buffer, header, n);
+	if (masked) {
+		unmask(buffer + n, payload, sz, key);
+	} else {
+		memcpy(buffer + n, payload, sz);
+	}
+	luaL_pushresultsize(&b, n + sz);
+	return 1;
+}
+
+LUAMOD_API int
+luaopen_skynet_websocket(lua_State *L) {
+	luaL_checkversion(L);
+	luaL_Reg l[] = {
+		{ "new", lnew },
+		{ "header", lheader },
+		{ "length", llength },
+		{ "frame", lframe },
+		{ NULL, NULL },
+	};
+	luaL_newlib(L, l);
+	return 1;
+}
@@ -8,6 +8,10 @@ local table = table
 local pcall = pcall
 local error = error
 local pairs = pairs
+local ipairs = ipairs
+local type = type
+local coroutine = coroutine
+local math = math
 
 local httpc = {}
 
@@ -109,7 +113,283 @@ local function close_interface(interface, fd)
 	end
 end
 
+--[[
+	keep-alive pool, enabled by httpc.keepalive. httpc.request and httpc.head reuse the connections (http and https),
+	httpc.request_stream always uses a new connection.
+
+	A connection is pooled by "protocol://host:port" after the response is read completely, unless the server says
+	"connection: close" (or HTTP/1.0 without keep-alive) or the body is read until the connection closed.
+	The idle connection is closed after the idle timeout, and it's checked (disconnected or expired) before reuse.
+
+	With pipelining, the idempotent requests (GET, HEAD, ...) are sent on a busy connection when the host has max
+	connections already, and the responses are read in order.
+]]
+
+local keepalive	-- nil : disabled
+local pool = {}	-- "protocol://host:port" -> { n = connections, idle = { conn }, busy = { [conn] = true }, waiting = { co } }
+
+local idempotent = {
+	GET = true,
+	HEAD = true,
+	PUT = true,
+	DELETE = true,
+	OPTIONS = true,
+	TRACE = true,
+}
+
+local function drop_connection(p, c)
+	p.n = p.n - 1
+	p.busy[c] = nil
+	close_interface(c.interface, c.fd)
+end
+
+local function close_idle(p)
+	for _, c in ipairs(p.idle) do
+		drop_connection(p, c)
+	end
+	p.idle = {}
+end
+
+--[[
+	conf (nil or false to disable, the idle connections are closed) :
+		timeout : close the connection after idle timeout (in 1/100s), default 6000
+		max : the max connections per host, default 16
+		pipeline : the max requests on one connection at the same time, default 1 (no pipelining)
+]]
+function httpc.keepalive(conf)
+	if conf then
+		keepalive = {
+			timeout = conf.timeout or 6000,
+			max = conf.max or 16,
+			pipeline = conf.pipeline or 1,
+		}
+	else
+		keepalive = nil
+		for _, p in pairs(pool) do
+			close_idle(p)
+		end
+	end
+end
+
+local function healthy(c)
+	return not c.broken
+		and not socket.closed(c.fd)
+		and skynet.now() - c.last < keepalive.timeout
+end
+
+local function wakeup_waiting(p)
+	local co = table.remove(p.waiting, 1)
+	if co then
+		skynet.wakeup(co)
+	end
+end
+
+-- returns the connection, and true if it's reused
+local function acquire(p, hostname, method, fresh)
+	while true do
+		local idle = p.idle
+		local max = keepalive and keepalive.max or math.huge
+		if fresh then
+			if p.n >= max and #idle > 0 then
+				drop_connection(p, table.remove(idle, 1))
+			end
+		else
+			-- the most recently used connection first
+			while #idle > 0 do
+				local c = table.remove(idle)
+				c.idle = nil
+				if healthy(c) then
+					c.inflight = 1
+					p.busy[c] = true
+					return c, true
+				end
+				drop_connection(p, c)
+			end
+		end
+		if p.n < max then
+			p.n = p.n + 1
+			local ok, fd, interface, host = pcall(connect, hostname, httpc.timeout)
+			if not ok then
+				p.n = p.n - 1
+				wakeup_waiting(p)
+				error(fd)
+			end
+			interface.finish = true	-- the timeout is checked for each request (see watch)
+			-- don't delay the small requests on the connection
+			socket.nodelay(fd)
+			local c = {
+				fd = fd,
+				interface = interface,
+				host = host,
+				inflight = 1,
+				queue = {},	-- the coroutines wait for reading response
+				serial = 0,
+				last = skynet.now(),
+			}
+			p.busy[c] = true
+			return c, false
+		end
+		if not fresh and keepalive and keepalive.pipeline > 1 and idempotent[method] then
+			local best
+			for c in pairs(p.busy) do
+				if c.keep and not c.broken and c.inflight < keepalive.pipeline and (best == nil or c.inflight < best.inflight) then
+					best = c
+				end
+			end
+			if best then
+				best.inflight = best.inflight + 1
+				return best, true
+			end
+		end
+		local co = coroutine.running()
+		table.insert(p.waiting, co)
+		skynet.wait(co)
+	end
+end
+
+local function release(p, c, keep)
+	c.inflight = c.inflight - 1
+	if not keep or not keepalive then
+		c.broken = true
+	end
+	if c.broken then
+		if c.inflight == 0 then
+			drop_connection(p, c)
+		else
+			-- the pipelined requests fail
+			socket.shutdown(c.fd)
+		end
+	elseif c.inflight == 0 then
+		p.busy[c] = nil
+		c.idle = true
+		c.last = skynet.now()
+		c.serial = c.serial + 1
+		table.insert(p.idle, c)
+		local serial = c.serial
+		skynet.timeout(keepalive.timeout, function()
+			if c.idle and c.serial == serial then
+				for i, v in ipairs(p.idle) do
+					if v == c then
+						table.remove(p.idle, i)
+						break
+					end
+				end
+				c.idle = nil
+				drop_connection(p, c)
+			end
+		end)
+	end
+	wakeup_waiting(p)
+end
+
+-- shutdown the connection if the request is not finished in timeout
+local function watch(c, timeout)
+	local token = {}
+	if timeout then
+		skynet.timeout(timeout, function()
+			if not token.done then
+				token.timeout = true
+				c.broken = true
+				socket.shutdown(c.fd)
+			end
+		end)
+	end
+	return token
+end
+
+local function next_turn(c)
+	local co = table.remove(c.queue, 1)
+	if co then
+		skynet.wakeup(co)
+	else
+		c.reading = false
+	end
+end
+
+-- the responses of pipelined requests are read in order
+local function wait_turn(c)
+	if c.reading then
+		local co = coroutine.running()
+		table.insert(c.queue, co)
+		skynet.wait(co)
+	else
+		c.reading = true
+	end
+	if c.broken then
+		next_turn(c)
+		error(socket.socket_error("connection closed fd = " .. c.fd))
+	end
+end
+
+local function keep_connection(version, header)
+	local conn = header.connection
+	if type(conn) == "string" then
+		conn = conn:lower()
+		if conn == "close" then
+			return false
+		elseif conn == "keep-alive" then
+			return true
+		end
+	end
+	return version ~= "1.0"
+end
+
+local function roundtrip(c, method, url, recvheader, header, content)
+	local interface = c.interface
+	internal.writerequest(interface, method, c.host, url, header, content)
+	wait_turn(c)
+	local ok, statuscode, body, header, version = pcall(internal.readresponse, interface, recvheader)
+	if ok then
+		if method == "HEAD" then
+			-- no body
+			interface.remain = body
+			body = ""
+		else
+			ok, body = pcall(internal.response, interface, statuscode, body, header)
+		end
+	end
+	c.keep = ok and interface.remain ~= nil and keep_connection(version, header)
+	next_turn(c)
+	if ok then
+		return statuscode, body
+	else
+		error(body or statuscode)
+	end
+end
+
+local function pooled_request(method, hostname, url, recvheader, header, content)
+	local protocol, host = check_protocol(hostname)
+	if not host:find ":%d+$" then
+		host = host .. (protocol == "http" and ":80" or ":443")
+	end
+	local key = protocol .. "://" .. host:lower()
+	local p = pool[key]
+	if not p then
+		p = { n = 0, idle = {}, busy = {}, waiting = {} }
+		pool[key] = p
+	end
+	local fresh
+	while true do
+		local c, reused = acquire(p, hostname, method, fresh)
+		local token = watch(c, httpc.timeout)
+		local ok, statuscode, body = pcall(roundtrip, c, method, url, recvheader, header, content)
+		token.done = true
+		release(p, c, ok and c.keep)
+		if ok then
+			return statuscode, body
+		end
+		-- the reused connection may be closed by server, retry once with a new connection
+		if not reused or fresh or token.timeout or not idempotent[method] then
+			error(statuscode)
+		end
+		fresh = true
+	end
+end
+
 function httpc.request(method, hostname, url, recvheader, header, content)
+	if keepalive then
+		return pooled_request(method, hostname, url, recvheader, header, content)
+	end
 	local fd, interface, host = connect(hostname, httpc.timeout)
 	local ok , statuscode, body , header = pcall(internal.request, interface, method, host, url, recvheader, header, content)
 	if ok then
@@ -124,6 +404,9 @@ function httpc.request(method, hostname, url, recvheader, header, content)
 end
 
 function httpc.head(hostname, url, recvheader, header, content)
+	if keepalive then
+		return (pooled_request("HEAD", hostname, url, recvheader, header, content))
+	end
 	local fd, interface, host = connect(hostname, httpc.timeout)
 	local ok , statuscode = pcall(internal.request, interface, "HEAD", host, url, recvheader, header, content)
 	close_interface(interface, fd)
@@ -1,12 +1,16 @@
+local skynet = require "skynet"
 local internal = require "http.internal"
+local sockethelper = require "http.sockethelper"
 
 local string = string
+local table = table
 local type = type
 local assert = assert
 local tonumber = tonumber
 local pcall = pcall
 local ipairs = ipairs
 local pairs = pairs
+local setmetatable = setmetatable
 
 local httpd = {}
 
@@ -53,22 +57,39 @@ local http_status_msg = {
 	[505] = "HTTP Version not supported",
 }
 
-local function readall(readbytes, bodylimit)
+local function readheader(readbytes, pre)
 	local tmpline = {}
-	local body = internal.recvheader(readbytes, tmpline, "")
+	local body = internal.recvheader(readbytes, tmpline, pre or "")
 	if not body then
-		return 413	-- Request Entity Too Large
+		return false, 413	-- Request Entity Too Large
 	end
 	local request = assert(tmpline[1])
 	local method, url, httpver = request:match "^(%a+)%s+(.-)%s+HTTP/([%d%.]+)$"
 	assert(method and url and httpver)
 	httpver = assert(tonumber(httpver))
-	if httpver < 1.0 or httpver > 1.1 then
-		return 505	-- HTTP Version not supported
-	end
 	local header = internal.parseheader(tmpline,2,{})
 	if not header then
-		return 400	-- Bad request
+		return false, 400	-- Bad request
+	end
+	return method, url, httpver, header, body
+end
+
+-- pre is the bytes read after the last request (pipelined), returns the bytes after this request at last
+local function readall(readbytes, bodylimit, pre)
+	local method, url, httpver, header
+	local body = ""
+	if pre == nil or pre == "" then
+		-- parse the header in socket buffer if readbytes is a sockethelper.readfunc, the body is left in socket buffer
+		method, url, httpver, header = sockethelper.readrequest(readbytes, internal.LIMIT)
+	end
+	if method == nil then
+		method, url, httpver, header, body = readheader(readbytes, pre)
+	end
+	if not method then
+		return url
+	end
+	if httpver < 1.0 or httpver > 1.1 then
+		return 505	-- HTTP Version not supported
 	end
 	local length = header["content-length"]
 	if length then
@@ -81,8 +102,9 @@ local function readall(readbytes, bodylimit)
 		end
 	end
 
+	local remain = ""
 	if mode == "chunked" then
-		body, header = internal.recvchunkedbody(readbytes, bodylimit, header, body)
+		body, header, remain = internal.recvchunkedbody(readbytes, bodylimit, header, body)
 		if not body then
 			return 413
 		end
@@ -93,15 +115,20 @@ local function readall(readbytes, bodylimit)
 				return 413
 			end
 			if #body >= length then
+				remain = body:sub(length+1)
 				body = body:sub(1,length)
 			else
 				local padding = readbytes(length - #body)
 				body = body .. padding
 			end
+		else
+			-- no body
+			remain = body
+			body = ""
 		end
 	end
 
-	return 200, url, method, header, body
+	return 200, url, method, header, body, httpver, remain
 end
 
 function httpd.read_request(...)
@@ -113,26 +140,70 @@ function httpd.read_request(...)
 	end
 end
 
-local function writeall(writefunc, statuscode, bodyfunc, header)
-	local statusline = string.format("HTTP/1.1 %03d %s\r\n", statuscode, http_status_msg[statuscode] or "")
-	writefunc(statusline)
+local statusline = setmetatable({}, { __index = function(t, statuscode)
+	local line = string.format("HTTP/1.1 %03d %s\r\n", statuscode, http_status_msg[statuscode] or "")
+	t[statuscode] = line
+	return line
+end })
+
+-- the body smaller than it is sent with the header in one buffer
+local INLINE_BODY = 16 * 1024
+
+-- the pieces of response header, it's reused because the header is written without yield
+local response = {}
+
+-- write the pieces in one buffer : the socket concats the table in C, or concat it for other writefunc (tls)
+local function flush(writefunc, n)
+	local ok, err
+	if sockethelper.writetable(writefunc) then
+		ok, err = pcall(writefunc, response)
+	else
+		ok, err = pcall(writefunc, table.concat(response, "", 1, n))
+	end
+	for i = 1, n do
+		response[i] = nil
+	end
+	if not ok then
+		error(err)
+	end
+end
+
+local function writeall(writefunc, statuscode, bodyfunc, header, connection)
+	local r = response
+	r[1] = statusline[statuscode]
+	local n = 1
 	if header then
 		for k,v in pairs(header) do
 			if type(v) == "table" then
 				for _,v in ipairs(v) do
-					writefunc(string.format("%s: %s\r\n", k,v))
+					r[n+1], r[n+2], r[n+3], r[n+4] = k, ": ", v, "\r\n"
+					n = n + 4
 				end
 			else
-				writefunc(string.format("%s: %s\r\n", k,v))
+				r[n+1], r[n+2], r[n+3], r[n+4] = k, ": ", v, "\r\n"
+				n = n + 4
 			end
 		end
 	end
+	if connection then
+		r[n+1], r[n+2], r[n+3] = "connection: ", connection, "\r\n"
+		n = n + 3
+	end
 	local t = type(bodyfunc)
 	if t == "string" then
-		writefunc(string.format("content-length: %d\r\n\r\n", #bodyfunc))
-		writefunc(bodyfunc)
+		local sz = #bodyfunc
+		r[n+1], r[n+2], r[n+3] = "content-length: ", sz, "\r\n\r\n"
+		n = n + 3
+		if sz <= INLINE_BODY then
+			r[n+1] = bodyfunc
+			flush(writefunc, n+1)
+		else
+			flush(writefunc, n)
+			writefunc(bodyfunc)
+		end
 	elseif t == "function" then
-		writefunc("transfer-encoding: chunked\r\n")
+		r[n+1] = "transfer-encoding: chunked\r\n"
+		flush(writefunc, n+1)
 		while true do
 			local s = bodyfunc()
 			if s then
@@ -147,7 +218,8 @@ local function writeall(writefunc, statuscode, bodyfunc, header)
 		end
 	else
 		assert(t == "nil")
-		writefunc("\r\n")
+		r[n+1] = "\r\n"
+		flush(writefunc, n+1)
 	end
 end
 
@@ -155,4 +227,98 @@ function httpd.write_response(...)
 	return pcall(writeall, ...)
 end
 
+local function keep_connection(httpver, header)
+	local conn = header.connection
+	if type(conn) == "string" then
+		conn = conn:lower()
+		if conn == "close" then
+			return false
+		elseif conn == "keep-alive" then
+			return true
+		end
+	end
+	return httpver >= 1.1
+end
+
+-- shutdown the connection if it waits for a request longer than idle, one timer for all the requests
+local function watch(fd, state, idle)
+	local function check()
+		if state.closed then
+			return
+		end
+		local waiting = state.waiting
+		local now = skynet.now()
+		if waiting and now - waiting >= idle then
+			state.timeout = true
+			sockethelper.shutdown(fd)
+		else
+			skynet.timeout(waiting and idle - (now - waiting) or idle, check)
+		end
+	end
+	skynet.timeout(idle, check)
+end
+
+local function serve(state, interface, handler, requests, bodylimit)
+	local read, write = interface.read, interface.write
+	local remain
+	local n = 0
+	while n < requests do
+		state.waiting = skynet.now()
+		local ok, code, url, method, header, body, httpver
+		ok, code, url, method, header, body, httpver, remain = pcall(readall, read, bodylimit, remain)
+		state.waiting = nil
+		if not ok then
+			if state.timeout or (n > 0 and code == sockethelper.socket_error) then
+				-- idle timeout, or closed by client
+				return n
+			end
+			return n, code
+		end
+		if code ~= 200 then
+			httpd.write_response(write, code, nil, nil, "close")
+			return n, code
+		end
+		n = n + 1
+		local keep = n < requests and keep_connection(httpver, header)
+		local connection = not keep and "close" or httpver < 1.1 and "keep-alive" or nil
+		local err
+		ok, code, body, header = pcall(handler, url, method, header, body)
+		if ok then
+			ok, err = httpd.write_response(write, code, body, header, connection)
+		else
+			err = code
+			httpd.write_response(write, 500, nil, nil, "close")
+		end
+		if not ok then
+			return n, err
+		end
+		if not keep then
+			break
+		end
+	end
+	return n
+end
+
+--[[
+	Serve the requests on a keep-alive connection until it's closed, the pipelined requests are read in turn.
+
+	fd : the socket id, it's shutdown if the connection is idle too long
+	interface : { read = readbytes, write = writefunc }, see sockethelper and tlshelper
+	handler : function(url, method, header, body) returns statuscode, bodyfunc, header (the same as httpd.write_response)
+	conf :
+		requests : the max requests per connection, default 100
+		idle : the max time to wait for a request (in 1/100s), default 1000
+		bodylimit : limit request body size, default nil (unlimit)
+
+	returns the number of requests, and the error (nil if the connection is closed normally)
+	The caller closes the connection after it returns.
+]]
+function httpd.keepalive(fd, interface, handler, conf)
+	local state = {}
+	watch(fd, state, conf and conf.idle or 1000)
+	local n, err = serve(state, interface, handler, conf and conf.requests or 100, conf and conf.bodylimit)
+	state.closed = true
+	return n, err
+end
+
 return httpd
@@ -10,6 +10,7 @@ local pairs = pairs
 local M = {}
 
 local LIMIT = 8192
+M.LIMIT = LIMIT	-- the max size of header
 
 local function chunksize(readbytes, body)
 	while true do
@@ -144,9 +145,11 @@ function M.recvchunkedbody(readbytes, bodylimit, header, body)
 
 	header = M.parseheader(tmpline,1,header)
 
-	return result, header
+	return result, header, body
 end
 
+-- interface.remain is the bytes after the body (the next response of keep-alive connection),
+-- or nil if the body is read until the connection closed
 local function recvbody(interface, code, header, body)
 	local length = header["content-length"]
 	if length then
@@ -154,12 +157,15 @@ local function recvbody(interface, code, header, body)
 	end
 	if length then
 		if #body >= length then
+			interface.remain = body:sub(length+1)
 			body = body:sub(1,length)
 		else
 			local padding = interface.read(length - #body)
 			body = body .. padding
+			interface.remain = ""
 		end
 	elseif code == 204 or code == 304 or code < 200 then
+		interface.remain = body
 		body = ""
 		-- See https://stackoverflow.com/questions/15991173/is-the-content-length-header-required-for-a-http-1-0-response
 	else
@@ -169,8 +175,7 @@ local function recvbody(interface, code, header, body)
 	return body
 end
 
-function M.request(interface, method, host, url, recvheader, header, content)
-	local read = interface.read
+function M.writerequest(interface, method, host, url, header, content)
 	local write = interface.write
 	local header_content = ""
 	if header then
@@ -197,22 +202,32 @@ function M.request(interface, method, host, url, recvheader, header, content)
 		local request_header = string.format("%s %s HTTP/1.1\r\n%sContent-length:0\r\n\r\n", method, url, header_content)
 		write(request_header)
 	end
+end
 
+-- returns code, body (the bytes after header), header, version
+function M.readresponse(interface, recvheader)
 	local tmpline = {}
-	local body = M.recvheader(read, tmpline, "")
+	local remain = interface.remain or ""
+	interface.remain = nil
+	local body = M.recvheader(interface.read, tmpline, remain)
 	if not body then
 		error("Recv header failed")
 	end
 
 	local statusline = tmpline[1]
-	local code, info = statusline:match "HTTP/[%d%.]+%s+([%d]+)%s+(.*)$"
+	local version, code, info = statusline:match "HTTP/([%d%.]+)%s+([%d]+)%s+(.*)$"
 	code = assert(tonumber(code))
 
 	local header = M.parseheader(tmpline,2,recvheader or {})
 	if not header then
 		error("Invalid HTTP response header")
 	end
-	return code, body, header
+	return code, body, header, version
+end
+
+function M.request(interface, method, host, url, recvheader, header, content)
+	M.writerequest(interface, method, host, url, header, content)
+	return M.readresponse(interface, recvheader)
 end
 
 function M.response(interface, code, body, header)
@@ -224,7 +239,7 @@ function M.response(interface, code, body, header)
 	end
 
 	if mode == "chunked" then
-		body, header = M.recvchunkedbody(interface.read, nil, header, body)
+		body, header, interface.remain = M.recvchunkedbody(interface.read, nil, header, body)
 		if not body then
 			error("Invalid response body")
 		end
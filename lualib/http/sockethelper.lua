@@ -57,11 +57,14 @@ local function preread(fd, str)
 	end
 end
 
+-- readfunc => fd, the request header can be parsed in socket buffer directly (see sockethelper.readrequest)
+local readfunc_fd = setmetatable({}, { __mode = "k" })
+
 function sockethelper.readfunc(fd, pre)
 	if pre then
 		return preread(fd, pre)
 	end
-	return function (sz)
+	local f = function (sz)
 		local ret = readbytes(fd, sz)
 		if ret then
 			return ret
@@ -69,17 +72,42 @@ function sockethelper.readfunc(fd, pre)
 			error(socket_error("read failed fd = " .. fd))
 		end
 	end
+	readfunc_fd[f] = fd
+	return f
+end
+
+-- returns nil if readbytes is not created by sockethelper.readfunc, see socket.readrequest
+function sockethelper.readrequest(readbytes, limit)
+	local fd = readfunc_fd[readbytes]
+	if not fd then
+		return
+	end
+	local method, url, version, header = socket.readrequest(fd, limit)
+	if method == false and url == nil then
+		error(socket_error("read failed fd = " .. fd))
+	end
+	return method, url, version, header
 end
 
 sockethelper.readall = socket.readall
+sockethelper.nodelay = socket.nodelay
+
+-- writefunc created by sockethelper.writefunc accepts a table of strings (concat in C), see sockethelper.writetable
+local writefunc_table = setmetatable({}, { __mode = "k" })
 
 function sockethelper.writefunc(fd)
-	return function(content)
+	local f = function(content)
 		local ok = writebytes(fd, content)
 		if not ok then
 			error(socket_error("write failed fd = " .. fd))
 		end
 	end
+	writefunc_table[f] = true
+	return f
+end
+
+function sockethelper.writetable(writebytes)
+	return writefunc_table[writebytes]
 end
 
 function sockethelper.connect(host, port, timeout)
@@ -125,4 +153,9 @@ function sockethelper.shutdown(fd)
 	socket.shutdown(fd)
 end
 
+-- the socket is closed or disconnected (by peer)
+function sockethelper.closed(fd)
+	return socket.invalid(fd) or socket.disconnected(fd)
+end
+
 return sockethelper
@@ -96,4 +96,10 @@ function tlshelper.newtls(method, ssl_ctx, hostname)
     return c.newtls(method, ssl_ctx, hostname)
 end
 
+-- encrypt the socket in socket thread, then use fd as a plain socket (socket.read/write, sockethelper).
+-- method "server" : call it before socket.start(fd) ; "client" : after socket.open.
+function tlshelper.attach(fd, ssl_ctx, method, hostname)
+    return c.attach(ssl_ctx, fd, method, hostname)
+end
+
 return tlshelper
\ No newline at end of file
@@ -1,6 +1,7 @@
 local internal = require "http.internal"
 local socket = require "skynet.socket"
 local crypt = require "skynet.crypt"
+local wscodec = require "skynet.websocket"
 local httpd = require "http.httpd"
 local skynet = require "skynet"
 local sockethelper = require "http.sockethelper"
@@ -208,33 +209,9 @@ local op_code = {
     [0x0A]     = "pong",
 }
 
+-- the header, masking key and (masked) payload are packed into one string by wscodec, fin is 1
 local function write_frame(self, op, payload_data, masking_key)
-    payload_data = payload_data or ""
-    local payload_len = #payload_data
-    local op_v = assert(op_code[op])
-    local v1 = 0x80 | op_v -- fin is 1 with opcode
-    local s
-    local mask = masking_key and 0x80 or 0x00
-    -- mask set to 0
-    if payload_len < 126 then
-        s = string.pack("I1I1", v1, mask | payload_len)
-    elseif payload_len <= 0xffff then
-        s = string.pack("I1I1>I2", v1, mask | 126, payload_len)
-    else
-        s = string.pack("I1I1>I8", v1, mask | 127, payload_len)
-    end
-    self.write(s)
-
-    -- write masking_key
-    if masking_key then
-        s = string.pack(">I4", masking_key)
-        self.write(s)
-        payload_data = crypt.xor_str(payload_data, s)
-    end
-
-    if payload_len > 0 then
-        self.write(payload_data)
-    end
+    self.write(wscodec.frame(assert(op_code[op]), payload_data, masking_key or nil))
 end
 
 
@@ -249,23 +226,13 @@ local function read_close(payload_data)
 end
 
 
+-- returns fin, op, payload_data, mask. If mask is true, payload_data is masking key .. masked payload, see unmask.
 local function read_frame(self)
-    local s = self.read(2)
-    local v1, v2 = string.unpack("I1I1", s)
-    local fin  = (v1 & 0x80) ~= 0
-    -- unused flag
-    -- local rsv1 = (v1 & 0x40) ~= 0
-    -- local rsv2 = (v1 & 0x20) ~= 0
-    -- local rsv3 = (v1 & 0x10) ~= 0
-    local op   =  v1 & 0x0f
-    local mask = (v2 & 0x80) ~= 0
-    local payload_len = (v2 & 0x7f)
-    if payload_len == 126 then
-        s = self.read(2)
-        payload_len = string.unpack(">I2", s)
-    elseif payload_len == 127 then
-        s = self.read(8)
-        payload_len = string.unpack(">I8", s)
+    -- rsv1, rsv2, rsv3 are unused
+    local fin, op, mask, payload_len = wscodec.header(self.read(2))
+    if payload_len < 0 then
+        -- 2 or 8 bytes extended payload length
+        payload_len = wscodec.length(self.read(-payload_len))
     end
 
     if self.mode == "server" and payload_len > MAX_FRAME_SIZE then
@@ -273,10 +240,17 @@ local function read_frame(self)
     end
 
     -- print(string.format("fin:%s, op:%s, mask:%s, payload_len:%s", fin, op_code[op], mask, payload_len))
-    local masking_key = mask and self.read(4) or false
-    local payload_data = payload_len>0 and self.read(payload_len) or ""
-    payload_data = masking_key and crypt.xor_str(payload_data, masking_key) or payload_data
-    return fin, assert(op_code[op]), payload_data
+    -- read masking key and payload at once
+    local sz = mask and payload_len + 4 or payload_len
+    local payload_data = sz > 0 and self.read(sz) or ""
+    return fin, assert(op_code[op]), payload_data, mask
+end
+
+local function unmask(self, payload_data, mask)
+    if mask then
+        return self.codec:unmask(payload_data)
+    end
+    return payload_data
 end
 
 
@@ -294,40 +268,35 @@ local function resolve_accept(self, options)
 
     local header = err
     try_handle(self, "handshake", header, url)
-    local recv_count = 0
-    local recv_buf = {}
+    local codec = self.codec
     local first_op
     while true do
         if _isws_closed(self.id) then
             try_handle(self, "close")
             return
         end
-        local fin, op, payload_data = read_frame(self)
+        local fin, op, payload_data, mask = read_frame(self)
         if op == "close" then
-            local code, reason = read_close(payload_data)
+            local code, reason = read_close(unmask(self, payload_data, mask))
             write_frame(self, "close")
             try_handle(self, "close", code, reason)
             break
         elseif op == "ping" then
-            write_frame(self, "pong", payload_data)
+            write_frame(self, "pong", unmask(self, payload_data, mask))
             try_handle(self, "ping")
         elseif op == "pong" then
             try_handle(self, "pong")
         else
-            if fin and #recv_buf == 0 then
-                try_handle(self, "message", payload_data, op)
+            if fin and not first_op then
+                try_handle(self, "message", unmask(self, payload_data, mask), op)
             else
-                recv_buf[#recv_buf+1] = payload_data
-                recv_count = recv_count + #payload_data
-                if recv_count > MAX_FRAME_SIZE then
+                -- the fragments are joined in codec
+                if codec:append(payload_data, mask) > MAX_FRAME_SIZE then
                     error("payload_len is too large")
                 end
                 first_op = first_op or op
                 if fin then
-                    local s = table.concat(recv_buf)
-                    try_handle(self, "message", s, first_op)
-                    recv_buf = {}  -- clear recv_buf
-                    recv_count = 0
+                    try_handle(self, "message", codec:message(), first_op)
                     first_op = nil
                 end
             end
@@ -370,6 +339,7 @@ local function _new_client_ws(socket_id, protocol, hostname)
     end
 
     obj.mode = "client"
+    obj.codec = wscodec.new()
     obj.id = assert(socket_id)
     obj.guid = GLOBAL_GUID
     ws_pool[socket_id] = obj
@@ -416,6 +386,7 @@ local function _new_server_ws(socket_id, handle, protocol)
     end
 
     obj.mode = "server"
+    obj.codec = wscodec.new()
     obj.id = assert(socket_id)
     obj.handle = handle
     obj.guid = GLOBAL_GUID
@@ -503,23 +474,22 @@ end
 
 function M.read(id)
     local ws_obj = assert(ws_pool[id])
-    local recv_buf
+    local joining
     while true do
-        local fin, op, payload_data = read_frame(ws_obj)
+        local fin, op, payload_data, mask = read_frame(ws_obj)
         if op == "close" then
             _close_websocket(ws_obj)
-            return false, payload_data
+            return false, unmask(ws_obj, payload_data, mask)
         elseif op == "ping" then
-            write_frame(ws_obj, "pong", payload_data)
+            write_frame(ws_obj, "pong", unmask(ws_obj, payload_data, mask))
         elseif op ~= "pong" then  -- op is frame, text binary
-            if fin and not recv_buf then
-                return payload_data
+            if fin and not joining then
+                return unmask(ws_obj, payload_data, mask)
             else
-                recv_buf = recv_buf or {}
-                recv_buf[#recv_buf+1] = payload_data
+                joining = true
+                ws_obj.codec:append(payload_data, mask)
                 if fin then
-                    local s = table.concat(recv_buf)
-                    return s
+                    return ws_obj.codec:message()
                 end
             end
         end
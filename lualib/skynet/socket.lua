@@ -1,6 +1,5 @@
 local driver = require "skynet.socketdriver"
 local skynet = require "skynet"
-local skynet_core = require "skynet.core"
 local assert = assert
 
 local BUFFER_LIMIT = 128 * 1024
@@ -173,14 +172,28 @@ socket_message[6] = function(id, size, data, address)
 	local s = socket_pool[id]
 	if s == nil or s.callback == nil then
 		skynet.error("socket: drop udp package from " .. id)
-		driver.drop(data, size)
+		driver.drop(data, size + #address)
 		return
 	end
 	local str = skynet.tostring(data, size)
-	skynet_core.trash(data, size)
+	driver.drop(data, size + #address)
 	s.callback(str, address)
 end
 
+-- SKYNET_SOCKET_TYPE_UDPBATCH = 9, see socket.udp_batch
+socket_message[9] = function(id, size, data)
+	local s = socket_pool[id]
+	if s == nil or s.callback == nil then
+		skynet.error("socket: drop udp packages from " .. id)
+		driver.drop(data, size)
+		return
+	end
+	local callback = s.callback
+	for str, address in driver.udp_unpack(data, size) do
+		callback(str, address)
+	end
+end
+
 local function default_warning(id, size)
 	local s = socket_pool[id]
 	if not s then
@@ -198,6 +211,9 @@ socket_message[7] = function(id, size)
 	end
 end
 
+-- SKYNET_SOCKET_TYPE_FRAME, the frame without header is read as stream data (use batch mode of socket.frame instead)
+socket_message[8] = socket_message[1]
+
 skynet.register_protocol {
 	name = "socket",
 	id = skynet.PTYPE_SOCKET,	-- PTYPE_SOCKET = 6
@@ -380,6 +396,28 @@ function socket.readline(id, sep)
 	end
 end
 
+-- Read and parse the header of http request in socket buffer (for http.httpd), limit is the max size of header.
+-- returns method, url, version, header, or false, code (413 : too large, 400 : bad request), or false when disconnected.
+function socket.readrequest(id, limit)
+	local s = socket_pool[id]
+	assert(s)
+	local from
+	while true do
+		local method, url, version, header = driver.readrequest(s.buffer, s.pool, limit, from)
+		if method ~= nil then
+			return method, url, version, header
+		end
+		if s.closing or not s.connected then
+			return false
+		end
+		-- url is the bytes scanned, don't scan them again
+		from = url
+		assert(not s.read_required)
+		s.read_required = 0
+		suspend(s)
+	end
+end
+
 function socket.block(id)
 	local s = socket_pool[id]
 	if not s or not s.connected then
@@ -393,8 +431,31 @@ end
 
 socket.write = assert(driver.send)
 socket.lwrite = assert(driver.lsend)
+socket.sendfile = assert(driver.sendfile)
+socket.nodelay = assert(driver.nodelay)
+-- socket.coalesce(id [, size]) : batch small writes of the socket, size (default 64K) is the pending bytes to flush at once.
+socket.coalesce = assert(driver.coalesce)
+-- socket.zerocopy(id [, size]) : send the buffers not less than size (default 64K) with MSG_ZEROCOPY (linux only), false or 0 turns it off.
+-- It only pays for large buffers, because the completion notification costs more than copying small ones.
+socket.zerocopy = assert(driver.zerocopy)
+-- socket.ratelimit(id, read, packet, write) : limit read bytes, read packets and write bytes per second (nil or 0 for unlimited).
+-- The socket thread stops reading the socket when it exceeds the limit, so the data is left in the kernel.
+socket.ratelimit = assert(driver.ratelimit)
+-- socket.frame(id, header, max, batch) : split the stream by a big-endian length header (2 or 4 bytes) in the socket thread,
+-- call it before socket.start. Each frame is a message without header (for gateserver/netpack),
+-- or the complete frames of one read are a message with headers if batch is true, so socket.read never gets an uncomplete frame.
+socket.frame = assert(driver.frame)
 socket.header = assert(driver.header)
 
+-- Keep the received data of socket in one contiguous block instead of a list of nodes (the buffered data is moved into it),
+-- socket.read(n) is one memcpy then, at the cost of a copy when the data arrives.
+-- It pays for the reads span many small packets (large reads, readline of long lines).
+function socket.contiguous(id)
+	local s = socket_pool[id]
+	assert(s and s.buffer)
+	driver.contiguous(s.buffer, s.pool)
+end
+
 function socket.invalid(id)
 	return socket_pool[id] == nil
 end
@@ -406,12 +467,19 @@ function socket.disconnected(id)
 	end
 end
 
-function socket.listen(host, port, backlog)
+-- If reuseport is true, the listen socket is opened with SO_REUSEPORT,
+-- so that several services can listen the same port and share the connections.
+-- host can be "unix:path" for unix domain socket (port is 0)
+function socket.listen(host, port, backlog, reuseport)
 	if port == nil then
-		host, port = string.match(host, "([^:]+):(.+)$")
-		port = tonumber(port)
+		if host:sub(1,5) == "unix:" then
+			port = 0
+		else
+			host, port = string.match(host, "([^:]+):(.+)$")
+			port = tonumber(port)
+		end
 	end
-	local id = driver.listen(host, port, backlog)
+	local id = driver.listen(host, port, backlog, reuseport)
 	local s = {
 		id = id,
 		connected = false,
@@ -483,9 +551,20 @@ function socket.udp_dial(addr, port, callback)
 	return id
 end
 
+-- socket.udp_batch(id [, enable]) : the datagrams of one read are delivered in one socket message, the callback is still called for each of them.
+socket.udp_batch = assert(driver.udp_batch)
 socket.sendto = assert(driver.udp_send)
 socket.udp_address = assert(driver.udp_address)
+-- socket.netstat([tcpinfo]) : if tcpinfo is true, rtt/rttvar (microseconds), retransmits, cwnd and unacked of tcp connections are sampled by TCP_INFO (linux only)
 socket.netstat = assert(driver.info)
+
+function socket.info(id, tcpinfo)
+	return driver.info(tcpinfo, id)
+end
+-- socket.poolstat() : { alloc, hit, free, recycle, bytes } of the socket read buffer pool
+socket.poolstat = assert(driver.poolstat)
+-- socket.pollstat() : { spin, hit, spin_us, block } of the socket thread, see socket_spin in config
+socket.pollstat = assert(driver.pollstat)
 socket.resolve = assert(driver.resolve)
 
 function socket.warning(id, callback)
@@ -6,10 +6,23 @@ local gateserver = {}
 
 local socket	-- listen socket
 local queue		-- message queue
+local pending	-- the packages from netpack.batch { fd1, msg1, sz1, ... }, pending.i is the next one
 local maxclient	-- max client
 local client_number = 0
-local CMD = setmetatable({}, { __gc = function() netpack.clear(queue) end })
+local CMD = setmetatable({}, { __gc = function()
+	netpack.clear(queue)
+	if pending then
+		for i = pending.i, #pending, 3 do
+			skynet.trash(pending[i+1], pending[i+2])
+		end
+	end
+end })
 local nodelay = false
+local coalesce	-- coalesce small writes, see socket.coalesce
+local ratelimit	-- { read = bytes, packet = n, write = bytes } per second, see socket.ratelimit
+local frame		-- true or "batch" : split the packages in socket thread, see socket.frame
+local header = 2	-- the size of package header, 2 or 4
+local maxpacket	-- the max size of package
 
 local connection = {}
 -- true : connected
@@ -42,8 +55,18 @@ function gateserver.start(handler)
 		local port = assert(conf.port)
 		maxclient = conf.maxclient or 1024
 		nodelay = conf.nodelay
+		coalesce = conf.coalesce
+		ratelimit = conf.ratelimit
+		frame = conf.frame
+		if conf.header or conf.maxpacket then
+			header = conf.header or 2
+			maxpacket = conf.maxpacket
+			assert(queue == nil)
+			queue = netpack.queue(header, maxpacket)
+		end
 		skynet.error(string.format("Listen on %s:%d", address, port))
-		socket = socketdriver.listen(address, port, conf.backlog)
+		-- conf.reuseport : launch several gates with the same port, the kernel balances the connections among them.
+		socket = socketdriver.listen(address, port, conf.backlog, conf.reuseport)
 		listen_context.co = coroutine.running()
 		listen_context.fd = socket
 		skynet.wait(listen_context.co)
@@ -73,15 +96,31 @@ function gateserver.start(handler)
 
 	MSG.data = dispatch_msg
 
+	-- take all the packages in queue at once, and share them among the dispatch coroutines
+	local function next_package()
+		local b = pending
+		if b == nil or b.i > #b then
+			b = netpack.batch(queue)
+			pending = b
+			if b == nil then
+				return
+			end
+			b.i = 1
+		end
+		local i = b.i
+		b.i = i + 3
+		return b[i], b[i+1], b[i+2]
+	end
+
 	local function dispatch_queue()
-		local fd, msg, sz = netpack.pop(queue)
+		local fd, msg, sz = next_package()
 		if fd then
 			-- may dispatch even the handler.message blocked
 			-- If the handler.message never block, the queue should be empty, so only fork once and then exit.
 			skynet.fork(dispatch_queue)
 			dispatch_msg(fd, msg, sz)
 
-			for fd, msg, sz in netpack.pop, queue do
+			for fd, msg, sz in next_package do
 				dispatch_msg(fd, msg, sz)
 			end
 		end
@@ -98,6 +137,15 @@ function gateserver.start(handler)
 		if nodelay then
 			socketdriver.nodelay(fd)
 		end
+		if coalesce then
+			socketdriver.coalesce(fd, coalesce)
+		end
+		if ratelimit then
+			socketdriver.ratelimit(fd, ratelimit.read, ratelimit.packet, ratelimit.write)
+		end
+		if frame then
+			socketdriver.frame(fd, header, maxpacket, frame == "batch")
+		end
 		connection[fd] = true
 		handler.connect(fd, msg)
 	end
@@ -120,6 +168,8 @@ function gateserver.start(handler)
 		if fd == socket then
 			skynet.error("gateserver accept error:",msg)
 		else
+			-- the packages before a too large one may be in queue
+			dispatch_queue()
 			socketdriver.shutdown(fd)
 			if handler.error then
 				handler.error(fd, msg)
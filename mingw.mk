@@ -57,12 +57,13 @@ LUA_CLIB_SKYNET = \
   lua-debugchannel.c \
   lua-datasheet.c \
   lua-sharetable.c \
+  lua-websocket.c \
   \
 
 SKYNET_SRC = skynet_main.c skynet_handle.c skynet_module.c skynet_mq.c \
   skynet_server.c skynet_start.c skynet_timer.c skynet_error.c \
   skynet_harbor.c skynet_env.c skynet_monitor.c skynet_socket.c socket_server.c \
-  mem_info.c malloc_hook.c skynet_daemon.c skynet_log.c
+  buffer_pool.c mem_info.c malloc_hook.c skynet_daemon.c skynet_log.c
 
 $(LUA_STATICLIB): 
 	@echo "Building Lua static library..."
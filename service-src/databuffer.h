@@ -2,157 +2,90 @@
 #define skynet_databuffer_h
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
-#include <assert.h>
 
-#define MESSAGEPOOL 1023
-
-struct message {
-	char * buffer;
-	int size;
-	struct message * next;
-};
+// the max size of package (16M - 1)
+#define DATABUFFER_MAX 0xffffff
 
+/*
+	The uncomplete package of a connection.
+	The body is read into a buffer of the package size, so the complete package can be forwarded without copy.
+ */
 struct databuffer {
-	int header;
-	int offset;
-	int size;
-	struct message * head;
-	struct message * tail;
-};
-
-struct messagepool_list {
-	struct messagepool_list *next;
-	struct message pool[MESSAGEPOOL];
-};
-
-struct messagepool {
-	struct messagepool_list * pool;
-	struct message * freelist;
+	int header;	// bytes of header read
+	int size;	// size of package
+	int read;	// bytes of body read
+	uint8_t head[4];
+	char * buffer;
 };
 
-// use memset init struct 
+// use memset init struct
 
-static void 
-messagepool_free(struct messagepool *pool) {
-	struct messagepool_list *p = pool->pool;
-	while(p) {
-		struct messagepool_list *tmp = p;
-		p=p->next;
-		skynet_free(tmp);
-	}
-	pool->pool = NULL;
-	pool->freelist = NULL;
-}
-
-static inline void
-_return_message(struct databuffer *db, struct messagepool *mp) {
-	struct message *m = db->head;
-	if (m->next == NULL) {
-		assert(db->tail == m);
-		db->head = db->tail = NULL;
+static inline uint32_t
+databuffer_size(const uint8_t * head, int header_size) {
+	// big-endian
+	if (header_size == 2) {
+		return head[0] << 8 | head[1];
 	} else {
-		db->head = m->next;
-	}
-	skynet_free(m->buffer);
-	m->buffer = NULL;
-	m->size = 0;
-	m->next = mp->freelist;
-	mp->freelist = m;
-}
-
-static void
-databuffer_read(struct databuffer *db, struct messagepool *mp, char * buffer, int sz) {
-	assert(db->size >= sz);
-	db->size -= sz;
-	for (;;) {
-		struct message *current = db->head;
-		int bsz = current->size - db->offset;
-		if (bsz > sz) {
-			memcpy(buffer, current->buffer + db->offset, sz);
-			db->offset += sz;
-			return;
-		}
-		if (bsz == sz) {
-			memcpy(buffer, current->buffer + db->offset, sz);
-			db->offset = 0;
-			_return_message(db, mp);
-			return;
-		} else {
-			memcpy(buffer, current->buffer + db->offset, bsz);
-			_return_message(db, mp);
-			db->offset = 0;
-			buffer+=bsz;
-			sz-=bsz;
-		}
+		return (uint32_t)head[0] << 24 | head[1] << 16 | head[2] << 8 | head[3];
 	}
 }
 
-static void
-databuffer_push(struct databuffer *db, struct messagepool *mp, void *data, int sz) {
-	struct message * m;
-	if (mp->freelist) {
-		m = mp->freelist;
-		mp->freelist = m->next;
-	} else {
-		struct messagepool_list * mpl = skynet_malloc(sizeof(*mpl));
-		struct message * temp = mpl->pool;
-		int i;
-		for (i=1;i<MESSAGEPOOL;i++) {
-			temp[i].buffer = NULL;
-			temp[i].size = 0;
-			temp[i].next = &temp[i+1];
-		}
-		temp[MESSAGEPOOL-1].next = NULL;
-		mpl->next = mp->pool;
-		mp->pool = mpl;
-		m = &temp[0];
-		mp->freelist = &temp[1];
-	}
-	m->buffer = data;
-	m->size = sz;
-	m->next = NULL;
-	db->size += sz;
-	if (db->head == NULL) {
-		assert(db->tail == NULL);
-		db->head = db->tail = m;
-	} else {
-		db->tail->next = m;
-		db->tail = m;
-	}
+static inline void
+databuffer_reset(struct databuffer *db) {
+	db->header = 0;
+	db->size = 0;
+	db->read = 0;
+	db->buffer = NULL;
 }
 
+// read the data into package, returns the bytes of data used, or -1 if the package is too large
 static int
-databuffer_readheader(struct databuffer *db, struct messagepool *mp, int header_size) {
-	if (db->header == 0) {
+databuffer_push(struct databuffer *db, int header_size, const uint8_t *data, int sz) {
+	int n = 0;
+	if (db->header < header_size) {
 		// parser header (2 or 4)
-		if (db->size < header_size) {
-			return -1;
+		while (db->header < header_size && n < sz) {
+			db->head[db->header++] = data[n++];
 		}
-		uint8_t plen[4];
-		databuffer_read(db,mp,(char *)plen,header_size);
-		// big-endian
-		if (header_size == 2) {
-			db->header = plen[0] << 8 | plen[1];
-		} else {
-			db->header = plen[0] << 24 | plen[1] << 16 | plen[2] << 8 | plen[3];
+		if (db->header < header_size)
+			return n;
+		uint32_t size = databuffer_size(db->head, header_size);
+		if (size > DATABUFFER_MAX)
+			return -1;
+		if (size == 0) {
+			// ignore empty package
+			databuffer_reset(db);
+			return n;
 		}
+		db->size = (int)size;
+		db->read = 0;
+		db->buffer = skynet_malloc(size);
+	}
+	int bsz = db->size - db->read;
+	if (bsz > sz - n) {
+		bsz = sz - n;
 	}
-	if (db->size < db->header)
-		return -1;
-	return db->header;
+	memcpy(db->buffer + db->read, data + n, bsz);
+	db->read += bsz;
+	return n + bsz;
 }
 
-static inline void
-databuffer_reset(struct databuffer *db) {
-	db->header = 0;
+// returns the complete package (the caller owns it), or NULL
+static inline char *
+databuffer_pop(struct databuffer *db, int *sz) {
+	if (db->buffer == NULL || db->read < db->size)
+		return NULL;
+	char * buffer = db->buffer;
+	*sz = db->size;
+	databuffer_reset(db);
+	return buffer;
 }
 
 static void
-databuffer_clear(struct databuffer *db, struct messagepool *mp) {
-	while (db->head) {
-		_return_message(db,mp);
-	}
+databuffer_clear(struct databuffer *db) {
+	skynet_free(db->buffer);
 	memset(db, 0, sizeof(*db));
 }
 
@@ -7,11 +7,24 @@
 #include <string.h>
 #include <assert.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
 
 #define BACKLOG 128
 
+/*
+	The last 4 bytes (little endian) of PTYPE_CLIENT message is the target of the package :
+	socket id, or one of the multicast targets below (the package is sent to the sockets with a shared buffer).
+
+	MULTICAST_ALL : all the connections
+	MULTICAST_LIST : package, n socket ids (4 bytes each), n (4 bytes), MULTICAST_LIST
+	MULTICAST_GROUP : package, group name, name length (1 byte), MULTICAST_GROUP. See command join/leave
+ */
+#define MULTICAST_ALL 0xffffffff
+#define MULTICAST_LIST 0xfffffffe
+#define MULTICAST_GROUP 0xfffffffd
+
 struct connection {
 	int id;	// skynet_socket id
 	uint32_t agent;
@@ -20,6 +33,14 @@ struct connection {
 	struct databuffer buffer;
 };
 
+struct group {
+	struct group * next;
+	int n;
+	int cap;
+	int *id;	// socket ids
+	char name[1];
+};
+
 struct gate {
 	struct skynet_context *ctx;
 	int listen_id;
@@ -30,8 +51,7 @@ struct gate {
 	int max_connection;
 	struct hashid hash;
 	struct connection *conn;
-	// todo: save message pool ptr for release
-	struct messagepool mp;
+	struct group *group;
 };
 
 struct gate *
@@ -55,7 +75,15 @@ gate_release(struct gate *g) {
 	if (g->listen_id >= 0) {
 		skynet_socket_close(ctx, g->listen_id);
 	}
-	messagepool_free(&g->mp);
+	while (g->group) {
+		struct group *gp = g->group;
+		g->group = gp->next;
+		skynet_free(gp->id);
+		skynet_free(gp);
+	}
+	for (i=0;i<g->max_connection;i++) {
+		databuffer_clear(&g->conn[i].buffer);
+	}
 	hashid_clear(&g->hash);
 	skynet_free(g->conn);
 	skynet_free(g);
@@ -85,6 +113,98 @@ _forward_agent(struct gate * g, int fd, uint32_t agentaddr, uint32_t clientaddr)
 	}
 }
 
+static struct group *
+_group(struct gate *g, const char * name, int sz, bool create) {
+	struct group *gp;
+	for (gp = g->group; gp; gp = gp->next) {
+		if (strncmp(gp->name, name, sz) == 0 && gp->name[sz] == '\0')
+			return gp;
+	}
+	if (!create)
+		return NULL;
+	gp = skynet_malloc(sizeof(*gp) + sz);
+	gp->n = 0;
+	gp->cap = 0;
+	gp->id = NULL;
+	memcpy(gp->name, name, sz);
+	gp->name[sz] = '\0';
+	gp->next = g->group;
+	g->group = gp;
+	return gp;
+}
+
+static void
+_group_dismiss(struct gate *g, struct group *gp) {
+	struct group **p = &g->group;
+	while (*p != gp) {
+		p = &(*p)->next;
+	}
+	*p = gp->next;
+	skynet_free(gp->id);
+	skynet_free(gp);
+}
+
+// remove the socket id from group, and dismiss the empty group (returns true)
+static bool
+_group_leave(struct gate *g, struct group *gp, int uid) {
+	int i;
+	for (i=0;i<gp->n;i++) {
+		if (gp->id[i] == uid) {
+			gp->id[i] = gp->id[--gp->n];
+			break;
+		}
+	}
+	if (gp->n > 0)
+		return false;
+	_group_dismiss(g, gp);
+	return true;
+}
+
+static void
+_group_join(struct gate *g, struct group *gp, int uid) {
+	int i;
+	for (i=0;i<gp->n;i++) {
+		if (gp->id[i] == uid)
+			return;
+	}
+	if (gp->n >= gp->cap) {
+		gp->cap = gp->cap == 0 ? 16 : gp->cap * 2;
+		gp->id = skynet_realloc(gp->id, gp->cap * sizeof(int));
+	}
+	gp->id[gp->n++] = uid;
+}
+
+// join (or leave) group name uid1 uid2 ...
+static void
+_group_command(struct gate *g, char * param, bool join) {
+	char * ids = param;
+	char * name = strsep(&ids, " ");
+	if (ids == NULL || name[0] == '\0' || strlen(name) > 255) {
+		skynet_error(g->ctx, "[gate] Invalid group command %s", param);
+		return;
+	}
+	struct group *gp = _group(g, name, strlen(name), join);
+	if (gp == NULL)
+		return;
+	char * idstr;
+	while ((idstr = strsep(&ids, " ")) != NULL) {
+		if (idstr[0] == '\0')
+			continue;
+		int uid = strtol(idstr, NULL, 10);
+		if (join) {
+			if (hashid_lookup(&g->hash, uid) >= 0) {
+				_group_join(g, gp, uid);
+			}
+		} else if (_group_leave(g, gp, uid)) {
+			return;
+		}
+	}
+	if (gp->n == 0) {
+		// no valid socket id to join
+		_group_dismiss(g, gp);
+	}
+}
+
 static void
 _ctrl(struct gate * g, const void * msg, int sz) {
 	struct skynet_context * ctx = g->ctx;
@@ -126,6 +246,16 @@ _ctrl(struct gate * g, const void * msg, int sz) {
 		_forward_agent(g, id, agent_handle, client_handle);
 		return;
 	}
+	if (memcmp(command,"join",i)==0) {
+		_parm(tmp, sz, i);
+		_group_command(g, command, true);
+		return;
+	}
+	if (memcmp(command,"leave",i)==0) {
+		_parm(tmp, sz, i);
+		_group_command(g, command, false);
+		return;
+	}
 	if (memcmp(command,"broker",i)==0) {
 		_parm(tmp, sz, i);
 		g->broker = skynet_queryname(ctx, command);
@@ -165,52 +295,59 @@ _report(struct gate * g, const char * data, ...) {
 	skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT,  0, tmp, n);
 }
 
+// forward the package (data) to broker, agent or watchdog, the data is owned by the receiver
 static void
-_forward(struct gate *g, struct connection * c, int size) {
+_forward(struct gate *g, struct connection *c, void * data, int sz) {
 	struct skynet_context * ctx = g->ctx;
 	int fd = c->id;
-	if (fd <= 0) {
-		// socket error
-		return;
-	}
 	if (g->broker) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,(char *)temp, size);
-		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, fd, temp, size);
-		return;
-	}
-	if (c->agent) {
-		void * temp = skynet_malloc(size);
-		databuffer_read(&c->buffer,&g->mp,(char *)temp, size);
-		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, fd , temp, size);
+		skynet_send(ctx, 0, g->broker, g->client_tag | PTYPE_TAG_DONTCOPY, fd, data, sz);
+	} else if (c->agent) {
+		skynet_send(ctx, c->client, c->agent, g->client_tag | PTYPE_TAG_DONTCOPY, fd, data, sz);
 	} else if (g->watchdog) {
-		char * tmp = skynet_malloc(size + 32);
+		char * tmp = skynet_malloc(sz + 32);
 		int n = snprintf(tmp,32,"%d data ",c->id);
-		databuffer_read(&c->buffer,&g->mp,tmp+n,size);
-		skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT | PTYPE_TAG_DONTCOPY, fd, tmp, size + n);
+		memcpy(tmp+n, data, sz);
+		skynet_free(data);
+		skynet_send(ctx, 0, g->watchdog, PTYPE_TEXT | PTYPE_TAG_DONTCOPY, fd, tmp, sz + n);
+	} else {
+		skynet_free(data);
 	}
 }
 
 static void
 dispatch_message(struct gate *g, struct connection *c, int id, void * data, int sz) {
-	databuffer_push(&c->buffer,&g->mp, data, sz);
-	for (;;) {
-		int size = databuffer_readheader(&c->buffer, &g->mp, g->header_size);
-		if (size < 0) {
-			return;
-		} else if (size > 0) {
-			if (size >= 0x1000000) {
-				struct skynet_context * ctx = g->ctx;
-				databuffer_clear(&c->buffer,&g->mp);
-				skynet_socket_close(ctx, id);
-				skynet_error(ctx, "Recv socket message > 16M");
+	struct databuffer *db = &c->buffer;
+	int header_size = g->header_size;
+	uint8_t * ptr = data;
+	int left = sz;
+	while (left > 0) {
+		if (db->header == 0 && left > header_size) {
+			uint32_t size = databuffer_size(ptr, header_size);
+			if (size == left - header_size && size <= DATABUFFER_MAX) {
+				// the rest of data is one package, forward the data block without copy
+				memmove(data, ptr + header_size, size);
+				_forward(g, c, data, size);
 				return;
-			} else {
-				_forward(g, c, size);
-				databuffer_reset(&c->buffer);
 			}
 		}
+		int n = databuffer_push(db, header_size, ptr, left);
+		if (n < 0) {
+			struct skynet_context * ctx = g->ctx;
+			databuffer_clear(db);
+			skynet_socket_close(ctx, id);
+			skynet_error(ctx, "Recv socket message > 16M");
+			break;
+		}
+		ptr += n;
+		left -= n;
+		int psz;
+		char * pack = databuffer_pop(db, &psz);
+		if (pack) {
+			_forward(g, c, pack, psz);
+		}
 	}
+	skynet_socket_free_buffer(data, sz);
 }
 
 static void
@@ -229,6 +366,23 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		}
 		break;
 	}
+	case SKYNET_SOCKET_TYPE_FRAME: {
+		int id = hashid_lookup(&g->hash, message->id);
+		if (id>=0) {
+			if (message->ud == 0) {
+				// ignore empty package, as databuffer_push does
+				skynet_socket_free_buffer(message->buffer, 0);
+				break;
+			}
+			// the package is split by socket thread (see skynet_socket_frame), forward it without copy
+			_forward(g, &g->conn[id], message->buffer, message->ud);
+		} else {
+			skynet_error(ctx, "Drop unknown connection %d message", message->id);
+			skynet_socket_close(ctx, message->id);
+			skynet_free(message->buffer);
+		}
+		break;
+	}
 	case SKYNET_SOCKET_TYPE_CONNECT: {
 		if (message->id == g->listen_id) {
 			// start listening
@@ -246,7 +400,13 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 		int id = hashid_remove(&g->hash, message->id);
 		if (id>=0) {
 			struct connection *c = &g->conn[id];
-			databuffer_clear(&c->buffer,&g->mp);
+			databuffer_clear(&c->buffer);
+			struct group *gp = g->group;
+			while (gp) {
+				struct group *next = gp->next;
+				_group_leave(g, gp, message->id);
+				gp = next;
+			}
 			memset(c, 0, sizeof(*c));
 			c->id = -1;
 			_report(g, "%d close", message->id);
@@ -265,6 +425,8 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 				sz = sizeof(c->remote_name) - 1;
 			}
 			c->id = message->ud;
+			// split the packages in socket thread before it starts, the size limit is 16M
+			skynet_socket_frame(ctx, c->id, g->header_size, 0xffffff, 0);
 			memcpy(c->remote_name, message+1, sz);
 			c->remote_name[sz] = '\0';
 			_report(g, "%d open %d %s:0",c->id, c->id, c->remote_name);
@@ -277,6 +439,68 @@ dispatch_socket_message(struct gate *g, const struct skynet_socket_message * mes
 	}
 }
 
+static inline uint32_t
+_uint32(const uint8_t * buf) {
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+// send the package (msg, owned by socket server after) to multiple sockets, returns false if the message is invalid
+static bool
+_multicast(struct gate *g, const uint8_t * msg, int sz, uint32_t target) {
+	struct skynet_context * ctx = g->ctx;
+	int n = 0;
+	int i;
+	if (target == MULTICAST_ALL) {
+		int * ids = skynet_malloc(g->max_connection * sizeof(int));
+		for (i=0;i<g->max_connection;i++) {
+			if (g->conn[i].id >= 0) {
+				ids[n++] = g->conn[i].id;
+			}
+		}
+		skynet_socket_multicast(ctx, msg, sz, ids, n);
+		skynet_free(ids);
+		return true;
+	}
+	if (target == MULTICAST_LIST) {
+		if (sz < 4)
+			return false;
+		int count = (int)_uint32(msg + sz - 4);
+		sz -= 4;
+		if (count < 0 || count > sz / 4)
+			return false;
+		sz -= count * 4;
+		const uint8_t * idbuf = msg + sz;
+		int * ids = skynet_malloc((count + 1) * sizeof(int));
+		for (i=0;i<count;i++) {
+			int uid = (int)_uint32(idbuf + i * 4);
+			// only the connections of gate
+			if (hashid_lookup(&g->hash, uid) >= 0) {
+				ids[n++] = uid;
+			}
+		}
+		skynet_socket_multicast(ctx, msg, sz, ids, n);
+		skynet_free(ids);
+		return true;
+	}
+	if (target == MULTICAST_GROUP) {
+		if (sz < 1)
+			return false;
+		int len = msg[sz-1];
+		sz -= 1;
+		if (len > sz)
+			return false;
+		sz -= len;
+		struct group *gp = _group(g, (const char *)msg + sz, len, false);
+		if (gp == NULL) {
+			skynet_socket_multicast(ctx, msg, sz, NULL, 0);
+		} else {
+			skynet_socket_multicast(ctx, msg, sz, gp->id, gp->n);
+		}
+		return true;
+	}
+	return false;
+}
+
 static int
 _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t source, const void * msg, size_t sz) {
 	struct gate *g = ud;
@@ -290,8 +514,15 @@ _cb(struct skynet_context * ctx, void * ud, int type, int session, uint32_t sour
 			break;
 		}
 		// The last 4 bytes in msg are the id of socket, write following bytes to it
-		const uint8_t * idbuf = msg + sz - 4;
-		uint32_t uid = idbuf[0] | idbuf[1] << 8 | idbuf[2] << 16 | idbuf[3] << 24;
+		uint32_t uid = _uint32((const uint8_t *)msg + sz - 4);
+		if (uid >= MULTICAST_GROUP) {
+			if (_multicast(g, msg, (int)sz-4, uid)) {
+				// return 1 means don't free msg
+				return 1;
+			}
+			skynet_error(ctx, "Invalid multicast message from %x",source);
+			break;
+		}
 		int id = hashid_lookup(&g->hash, uid);
 		if (id>=0) {
 			// don't send id (last 4 bytes)
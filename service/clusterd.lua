@@ -39,7 +39,13 @@ local function open_channel(t, key)
 	end
 	local succ, err, c
 	if address then
-		local host, port = string.match(address, "([^:]+):(.*)$")
+		local host, port
+		if address:sub(1,5) == "unix:" then
+			-- unix domain socket for the node on the same host
+			host, port = address, 0
+		else
+			host, port = string.match(address, "([^:]+):(.*)$")
+		end
 		c = node_sender[key]
 		if c == nil then
 			c = skynet.newservice("clustersender", key, nodename, host, port)
@@ -146,9 +152,13 @@ function command.listen(source, addr, port, maxclient)
 	local gate = skynet.newservice("gate")
 	if port == nil then
 		local address = assert(node_address[addr], addr .. " is down")
-		addr, port = string.match(address, "(.+):([^:]+)$")
-		port = tonumber(port)
-		assert(port ~= 0)
+		if address:sub(1,5) == "unix:" then
+			addr, port = address, 0
+		else
+			addr, port = string.match(address, "(.+):([^:]+)$")
+			port = tonumber(port)
+			assert(port ~= 0)
+		end
 		skynet.call(gate, "lua", "open", { address = addr, port = port, maxclient = maxclient })
 		skynet.ret(skynet.pack(addr, port))
 	else
@@ -167,7 +167,9 @@ function COMMAND.help()
 		ping = "ping address",
 		call = "call address ...",
 		trace = "trace address [proto] [on|off]",
-		netstat = "netstat : show netstat",
+		netstat = "netstat [tcp] : show netstat, tcp for rtt, retransmits and cwnd by TCP_INFO",
+		netpool = "netpool : show socket read buffer pool stat",
+		netpoll = "netpoll : show spin hit rate of socket thread (config socket_spin)",
 		profactive = "profactive [on|off] : active/deactive jemalloc heap profilling",
 		dumpheap = "dumpheap : dump heap profilling",
 		killtask = "killtask address threadname : threadname listed by task",
@@ -449,21 +451,46 @@ local function convert_stat(info)
 	end
 
 	info.address = skynet.address(info.address)
+	if info.wcall and info.wcall > 0 then
+		info.wavg = bytes(info.write // info.wcall)
+	end
 	info.read = bytes(info.read)
 	info.write = bytes(info.write)
 	info.wbuffer = bytes(info.wbuffer)
 	info.rtime = time(info.rtime)
 	info.wtime = time(info.wtime)
+	if info.rtt then
+		info.rtt = string.format("%.3fms", info.rtt / 1000)
+		info.rttvar = string.format("%.3fms", info.rttvar / 1000)
+	end
 end
 
-function COMMAND.netstat()
-	local stat = socket.netstat()
+function COMMAND.netstat(tcpinfo)
+	local stat = socket.netstat(tcpinfo == "tcp")
 	for _, info in ipairs(stat) do
 		convert_stat(info)
 	end
 	return stat
 end
 
+function COMMAND.netpool()
+	local stat = socket.poolstat()
+	if stat.alloc > 0 then
+		stat.hitrate = string.format("%.2f%%", stat.hit * 100 / stat.alloc)
+	end
+	return stat
+end
+
+function COMMAND.netpoll()
+	local stat = socket.pollstat()
+	stat.socket_spin = skynet.getenv "socket_spin" or "0"
+	if stat.spin > 0 then
+		stat.hitrate = string.format("%.2f%%", stat.hit * 100 / stat.spin)
+		stat.spin_avg = string.format("%.1fus", stat.spin_us / stat.spin)
+	end
+	return stat
+end
+
 function COMMAND.dumpheap()
 	memory.dumpheap()
 end
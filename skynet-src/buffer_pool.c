@@ -0,0 +1,295 @@
+#include "skynet.h"
+
+#include "buffer_pool.h"
+#include "atomic.h"
+#include "spinlock.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// size class 2^6 (64, MIN_READ_BUFFER of socket server) ... 2^16
+#define MIN_CLASS_P 6
+#define MAX_CLASS_P 16
+#define CLASS_N (MAX_CLASS_P - MIN_CLASS_P + 1)
+// bytes limit per class for each thread cache and for the central list
+#define CACHE_BYTES (64 * 1024)
+#define CENTRAL_BYTES (1024 * 1024)
+// free counter of thread cache is added to the global one in batch
+#define STAT_BATCH 64
+
+struct free_block {
+	struct free_block * next;
+};
+
+// 每个线程私有的缓存，分配（socket 线程）与回收（工作线程）大部分时候不需要加锁
+struct thread_cache {
+	struct free_block * list[CLASS_N];
+	int n[CLASS_N];
+	int free;
+};
+
+// 线程缓存溢出或不足时，按批与中心链表交换
+struct central_list {
+	struct spinlock lock;
+	struct free_block * list;
+	int n;
+};
+
+struct buffer_pool {
+	pthread_key_t key;
+	struct central_list central[CLASS_N];
+	ATOM_SIZET alloc;
+	ATOM_SIZET hit;
+	ATOM_SIZET free;
+	ATOM_SIZET drop;
+	ATOM_SIZET bytes;
+};
+
+static struct buffer_pool *P = NULL;
+
+static inline int
+size_class(size_t sz) {
+	int p = MIN_CLASS_P;
+	while (((size_t)1 << p) < sz) {
+		++p;
+	}
+	return p - MIN_CLASS_P;
+}
+
+static inline size_t
+class_size(int c) {
+	return (size_t)1 << (c + MIN_CLASS_P);
+}
+
+static inline int
+cache_limit(int c) {
+	int n = CACHE_BYTES >> (c + MIN_CLASS_P);
+	return n < 4 ? 4 : n;
+}
+
+static inline int
+central_limit(int c) {
+	int n = CENTRAL_BYTES >> (c + MIN_CLASS_P);
+	return n < 16 ? 16 : n;
+}
+
+static void
+central_push(struct buffer_pool *p, int c, struct free_block *head, struct free_block *tail, int n) {
+	struct central_list *cl = &p->central[c];
+	int limit = central_limit(c);
+	spinlock_lock(&cl->lock);
+	if (cl->n + n <= limit) {
+		tail->next = cl->list;
+		cl->list = head;
+		cl->n += n;
+		head = NULL;
+	}
+	spinlock_unlock(&cl->lock);
+	if (head) {
+		// central list is full, give them back to allocator
+		ATOM_FADD(&p->drop, n);
+		ATOM_FSUB(&p->bytes, n * class_size(c));
+	}
+	while (head) {
+		struct free_block *tmp = head;
+		head = head->next;
+		skynet_free(tmp);
+	}
+}
+
+static void
+cache_flush(struct buffer_pool *p, struct thread_cache *tc, int c, int n) {
+	struct free_block *head = tc->list[c];
+	struct free_block *tail = head;
+	int i;
+	for (i=1;i<n;i++) {
+		tail = tail->next;
+	}
+	tc->list[c] = tail->next;
+	tail->next = NULL;
+	tc->n[c] -= n;
+	central_push(p, c, head, tail, n);
+}
+
+static void
+cache_release(void *ud) {
+	struct thread_cache *tc = ud;
+	struct buffer_pool *p = P;
+	int i;
+	if (p) {
+		ATOM_FADD(&p->free, tc->free);
+	}
+	for (i=0;i<CLASS_N;i++) {
+		if (tc->n[i] > 0) {
+			if (p) {
+				cache_flush(p, tc, i, tc->n[i]);
+			} else {
+				while (tc->list[i]) {
+					struct free_block *tmp = tc->list[i];
+					tc->list[i] = tmp->next;
+					skynet_free(tmp);
+				}
+			}
+		}
+	}
+	skynet_free(tc);
+}
+
+static struct thread_cache *
+get_cache(struct buffer_pool *p) {
+	struct thread_cache *tc = pthread_getspecific(p->key);
+	if (tc == NULL) {
+		tc = skynet_malloc(sizeof(*tc));
+		memset(tc, 0, sizeof(*tc));
+		pthread_setspecific(p->key, tc);
+	}
+	return tc;
+}
+
+// move a batch (half of thread cache limit) from central list to thread cache
+static void
+cache_refill(struct buffer_pool *p, struct thread_cache *tc, int c) {
+	struct central_list *cl = &p->central[c];
+	int batch = cache_limit(c) / 2 + 1;
+	spinlock_lock(&cl->lock);
+	struct free_block *head = cl->list;
+	if (head == NULL) {
+		spinlock_unlock(&cl->lock);
+		return;
+	}
+	struct free_block *tail = head;
+	int n = 1;
+	while (n < batch && tail->next) {
+		tail = tail->next;
+		++n;
+	}
+	cl->list = tail->next;
+	cl->n -= n;
+	spinlock_unlock(&cl->lock);
+	tail->next = tc->list[c];
+	tc->list[c] = head;
+	tc->n[c] += n;
+}
+
+void
+buffer_pool_init() {
+	struct buffer_pool *p = skynet_malloc(sizeof(*p));
+	memset(p, 0, sizeof(*p));
+	int i;
+	for (i=0;i<CLASS_N;i++) {
+		spinlock_init(&p->central[i].lock);
+	}
+	ATOM_INIT(&p->alloc, 0);
+	ATOM_INIT(&p->hit, 0);
+	ATOM_INIT(&p->free, 0);
+	ATOM_INIT(&p->drop, 0);
+	ATOM_INIT(&p->bytes, 0);
+	if (pthread_key_create(&p->key, cache_release)) {
+		skynet_error(NULL, "buffer pool : pthread_key_create failed");
+		skynet_free(p);
+		return;
+	}
+	P = p;
+}
+
+void
+buffer_pool_release() {
+	struct buffer_pool *p = P;
+	if (p == NULL)
+		return;
+	P = NULL;
+	struct thread_cache *tc = pthread_getspecific(p->key);
+	if (tc) {
+		pthread_setspecific(p->key, NULL);
+		cache_release(tc);
+	}
+	pthread_key_delete(p->key);
+	int i;
+	for (i=0;i<CLASS_N;i++) {
+		struct central_list *cl = &p->central[i];
+		while (cl->list) {
+			struct free_block *tmp = cl->list;
+			cl->list = tmp->next;
+			skynet_free(tmp);
+		}
+		spinlock_destroy(&cl->lock);
+	}
+	skynet_free(p);
+}
+
+void *
+buffer_pool_alloc(size_t sz) {
+	struct buffer_pool *p = P;
+	int c = size_class(sz);
+	if (p == NULL || c >= CLASS_N) {
+		return skynet_malloc(sz);
+	}
+	ATOM_FINC(&p->alloc);
+	struct thread_cache *tc = get_cache(p);
+	if (tc->list[c] == NULL) {
+		cache_refill(p, tc, c);
+	}
+	struct free_block *b = tc->list[c];
+	if (b) {
+		ATOM_FINC(&p->hit);
+		ATOM_FSUB(&p->bytes, class_size(c));
+		tc->list[c] = b->next;
+		--tc->n[c];
+		return b;
+	}
+	return skynet_malloc(class_size(c));
+}
+
+void
+buffer_pool_free(void *buffer, size_t sz) {
+	if (buffer == NULL)
+		return;
+	struct buffer_pool *p = P;
+	int c = size_class(sz);
+	if (p == NULL || c >= CLASS_N) {
+		skynet_free(buffer);
+		return;
+	}
+	struct thread_cache *tc = get_cache(p);
+	if (++tc->free >= STAT_BATCH) {
+		ATOM_FADD(&p->free, tc->free);
+		tc->free = 0;
+	}
+	ATOM_FADD(&p->bytes, class_size(c));
+	struct free_block *b = buffer;
+	b->next = tc->list[c];
+	tc->list[c] = b;
+	if (++tc->n[c] > cache_limit(c)) {
+		cache_flush(p, tc, c, tc->n[c] / 2);
+	}
+}
+
+void *
+buffer_pool_shrink(void *buffer, size_t cap, size_t sz) {
+	int c = size_class(sz);
+	if (P == NULL || c >= CLASS_N || c == size_class(cap)) {
+		return buffer;
+	}
+	// the block is filed by the size of the bytes it holds when it's freed,
+	// move them into a block of that class and put the large one back at once.
+	void * tmp = buffer_pool_alloc(sz);
+	memcpy(tmp, buffer, sz);
+	buffer_pool_free(buffer, cap);
+	return tmp;
+}
+
+void
+buffer_pool_stat(struct buffer_pool_stat *stat) {
+	struct buffer_pool *p = P;
+	if (p == NULL) {
+		memset(stat, 0, sizeof(*stat));
+		return;
+	}
+	stat->alloc = ATOM_LOAD(&p->alloc);
+	stat->hit = ATOM_LOAD(&p->hit);
+	stat->free = ATOM_LOAD(&p->free);
+	size_t drop = ATOM_LOAD(&p->drop);
+	stat->recycle = stat->free > drop ? stat->free - drop : 0;
+	stat->bytes = ATOM_LOAD(&p->bytes);
+}
@@ -0,0 +1,29 @@
+#ifndef skynet_buffer_pool_h
+#define skynet_buffer_pool_h
+
+#include <stddef.h>
+
+// Size-classed pool for socket read buffers.
+// buffer_pool_alloc always returns a block of power of 2 size (>= sz), and buffer_pool_free files the block
+// by the size given, so it must be in the same class as the capacity. The consumers of socket messages free
+// the buffer with the bytes it holds, so the socket thread calls buffer_pool_shrink before forwarding a buffer.
+// A pooled buffer can also be freed by skynet_free directly (it's allocated by skynet_malloc).
+
+struct buffer_pool_stat {
+	size_t alloc;	// times of buffer_pool_alloc
+	size_t hit;	// alloc from pool
+	size_t free;	// times of buffer_pool_free (thread caches report it in batch)
+	size_t recycle;	// free into pool (others are freed by skynet_free because the pool is full)
+	size_t bytes;	// bytes of the blocks kept in pool
+};
+
+void buffer_pool_init();
+void buffer_pool_release();
+
+void * buffer_pool_alloc(size_t sz);
+void buffer_pool_free(void *buffer, size_t sz);
+// returns a buffer of the class of sz with the first sz bytes of buffer (capacity cap), buffer may be freed
+void * buffer_pool_shrink(void *buffer, size_t cap, size_t sz);
+void buffer_pool_stat(struct buffer_pool_stat *stat);
+
+#endif
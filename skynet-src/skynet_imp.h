@@ -8,6 +8,9 @@ struct skynet_config {
 	int thread; // 工作线程数量， 总线程数量 = thread + THREAD_MAIN + THREAD_SOCKET + THREAD_TIMER + THREAD_MONITOR
 	int harbor; // 集群节点标识。每个节点需要一个唯一的harbor值，通常为非负整数
 	int profile; // 性能分析开关，0表示关闭，1表示开启
+	int max_socket; // socket 数量上限（向上取 2 的幂，默认 65536），socket 表按需分段增长
+	int socket_spin; // socket 线程阻塞前自旋轮询的时长（微秒），0 表示不自旋
+	int socket_busy_poll; // socket 的 SO_BUSY_POLL（微秒），0 表示不设置
 	const char * daemon; // 守护进程模式配置
 	const char * module_path; // 搜索模块路径
 	const char * bootstrap; // 启动脚本路径
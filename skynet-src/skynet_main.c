@@ -191,6 +191,9 @@ main(int argc, char *argv[]) {
 	config.logger = optstring("logger", NULL);  // 日志输出文件路径（默认控制台）
 	config.logservice = optstring("logservice", "logger"); // 日志服务类型（默认 logger）
 	config.profile = optboolean("profile", 1); // 是否启用性能分析（默认启用）
+	config.max_socket = optint("max_socket", 65536); // socket 数量上限（默认 65536）
+	config.socket_spin = optint("socket_spin", 0); // socket 线程阻塞前自旋轮询的微秒数（默认 0，不自旋）
+	config.socket_busy_poll = optint("socket_busy_poll", 0); // socket 的 SO_BUSY_POLL 微秒数（默认 0）
 
 	// 启动 Skynet 框架核心服务
 	skynet_start(&config); // skynet_start 是框架启动的核心函数，根据 config 参数初始化工作线程、启动入口服务（如 bootstrap），进入事件循环
@@ -2,6 +2,7 @@
 
 #include "skynet_socket.h"
 #include "socket_server.h"
+#include "buffer_pool.h"
 #include "skynet_server.h"
 #include "skynet_mq.h"
 #include "skynet_harbor.h"
@@ -15,8 +16,9 @@ static struct socket_server * SOCKET_SERVER = NULL; // 唯一的 socket 服务
 
 // 创建并初始化底层的 socket 服务器实例，为框架的网络通信功能提供基础支持
 void 
-skynet_socket_init() {
-	SOCKET_SERVER = socket_server_create(skynet_now());
+skynet_socket_init(int max_socket) {
+	buffer_pool_init();
+	SOCKET_SERVER = socket_server_create(skynet_now(), max_socket);
 }
 
 void
@@ -28,6 +30,7 @@ void
 skynet_socket_free() {
 	socket_server_release(SOCKET_SERVER);
 	SOCKET_SERVER = NULL;
+	buffer_pool_release();
 }
 
 void
@@ -35,6 +38,16 @@ skynet_socket_updatetime() {
 	socket_server_updatetime(SOCKET_SERVER, skynet_now());
 }
 
+void
+skynet_socket_busypoll(int spin, int busy_poll) {
+	socket_server_busypoll(SOCKET_SERVER, spin, busy_poll);
+}
+
+void
+skynet_socket_pollstat(struct socket_poll_stat *stat) {
+	socket_server_pollstat(SOCKET_SERVER, stat);
+}
+
 // mainloop thread
 static void
 forward_message(int type, bool padding, struct socket_message * result) {
@@ -117,9 +130,15 @@ skynet_socket_poll() {
 	case SOCKET_UDP: // udp的消息
 		forward_message(SKYNET_SOCKET_TYPE_UDP, false, &result);
 		break;
+	case SOCKET_UDPBATCH: // 一次读取的多个 udp 数据报（socket_server_udp_batch）
+		forward_message(SKYNET_SOCKET_TYPE_UDPBATCH, false, &result);
+		break;
 	case SOCKET_WARNING:
 		forward_message(SKYNET_SOCKET_TYPE_WARNING, false, &result);
 		break;
+	case SOCKET_FRAME: // 按长度头分好的一个包（不含长度头）
+		forward_message(SKYNET_SOCKET_TYPE_FRAME, false, &result);
+		break;
 	default:
 		skynet_error(NULL, "error: Unknown socket message type %d.",type);
 		return -1;
@@ -140,12 +159,28 @@ skynet_socket_sendbuffer_lowpriority(struct skynet_context *ctx, struct socket_s
 	return socket_server_send_lowpriority(SOCKET_SERVER, buffer);
 }
 
+void
+skynet_socket_multicast(struct skynet_context *ctx, const void *buffer, size_t sz, const int *ids, int n) {
+	socket_server_multicast(SOCKET_SERVER, buffer, sz, ids, n);
+}
+
+int
+skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int64_t sz) {
+	return socket_server_sendfile(SOCKET_SERVER, id, fd, offset, sz);
+}
+
 int 
 skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog) {
 	uint32_t source = skynet_context_handle(ctx);
 	return socket_server_listen(SOCKET_SERVER, source, host, port, backlog);
 }
 
+int 
+skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog) {
+	uint32_t source = skynet_context_handle(ctx);
+	return socket_server_listen_reuseport(SOCKET_SERVER, source, host, port, backlog);
+}
+
 int 
 skynet_socket_connect(struct skynet_context *ctx, const char *host, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -188,6 +223,31 @@ skynet_socket_nodelay(struct skynet_context *ctx, int id) {
 	socket_server_nodelay(SOCKET_SERVER, id);
 }
 
+void
+skynet_socket_coalesce(struct skynet_context *ctx, int id, int size) {
+	socket_server_coalesce(SOCKET_SERVER, id, size);
+}
+
+void
+skynet_socket_zerocopy(struct skynet_context *ctx, int id, int size) {
+	socket_server_zerocopy(SOCKET_SERVER, id, size);
+}
+
+void
+skynet_socket_ratelimit(struct skynet_context *ctx, int id, int read, int packet, int write) {
+	socket_server_ratelimit(SOCKET_SERVER, id, read, packet, write);
+}
+
+void
+skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max, int batch) {
+	socket_server_frame(SOCKET_SERVER, id, header, max, batch);
+}
+
+void
+skynet_socket_tls(struct skynet_context *ctx, int id, void *tls, const struct socket_tls_interface *i) {
+	socket_server_tls(SOCKET_SERVER, id, tls, i);
+}
+
 int 
 skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port) {
 	uint32_t source = skynet_context_handle(ctx);
@@ -231,7 +291,52 @@ skynet_socket_udp_address(struct skynet_socket_message *msg, int *addrsz) {
 	return (const char *)socket_server_udp_address(SOCKET_SERVER, &sm, addrsz); // 调用底层函数获取地址
 }
 
+void
+skynet_socket_udp_batch(struct skynet_context *ctx, int id, int batch) {
+	socket_server_udp_batch(SOCKET_SERVER, id, batch);
+}
+
+int
+skynet_socket_udp_next(const char *buffer, int sz, int offset, const char **data, int *datasz, const char **addr, int *addrsz) {
+	if (offset + 3 > sz) {
+		return -1;
+	}
+	const uint8_t * p = (const uint8_t *)buffer + offset;
+	int n = p[0] << 8 | p[1];
+	struct socket_message sm;
+	sm.id = 0;
+	sm.opaque = 0;
+	sm.ud = 0;
+	sm.data = (char *)(p + 2);
+	*addr = (const char *)socket_server_udp_address(SOCKET_SERVER, &sm, addrsz);
+	if (*addr == NULL) {
+		return -1;
+	}
+	offset += 2 + *addrsz;
+	if (offset + n > sz) {
+		return -1;
+	}
+	*data = buffer + offset;
+	*datasz = n;
+	return offset + n;
+}
+
+struct socket_info *
+skynet_socket_info(int tcpinfo) {
+	return socket_server_info(SOCKET_SERVER, tcpinfo);
+}
+
 struct socket_info *
-skynet_socket_info() {
-	return socket_server_info(SOCKET_SERVER);
+skynet_socket_info_id(int id, int tcpinfo) {
+	return socket_server_info_id(SOCKET_SERVER, id, tcpinfo);
+}
+
+void
+skynet_socket_free_buffer(void *buffer, int sz) {
+	buffer_pool_free(buffer, sz);
+}
+
+void
+skynet_socket_buffer_stat(struct buffer_pool_stat *stat) {
+	buffer_pool_stat(stat);
 }
@@ -5,6 +5,8 @@
 #include "socket_buffer.h"
 
 struct skynet_context;
+struct buffer_pool_stat;
+struct socket_tls_interface;
 
 #define SKYNET_SOCKET_TYPE_DATA 1
 #define SKYNET_SOCKET_TYPE_CONNECT 2
@@ -13,6 +15,8 @@ struct skynet_context;
 #define SKYNET_SOCKET_TYPE_ERROR 5
 #define SKYNET_SOCKET_TYPE_UDP 6
 #define SKYNET_SOCKET_TYPE_WARNING 7
+#define SKYNET_SOCKET_TYPE_FRAME 8
+#define SKYNET_SOCKET_TYPE_UDPBATCH 9
 
 struct skynet_socket_message {
 	int type;
@@ -21,15 +25,20 @@ struct skynet_socket_message {
 	char * buffer;
 };
 
-void skynet_socket_init();
+void skynet_socket_init(int max_socket);
 void skynet_socket_exit();
 void skynet_socket_free();
 int skynet_socket_poll();
 void skynet_socket_updatetime();
+void skynet_socket_busypoll(int spin, int busy_poll);
+void skynet_socket_pollstat(struct socket_poll_stat *stat);
 
 int skynet_socket_sendbuffer(struct skynet_context *ctx, struct socket_sendbuffer *buffer);
 int skynet_socket_sendbuffer_lowpriority(struct skynet_context *ctx, struct socket_sendbuffer *buffer);
+void skynet_socket_multicast(struct skynet_context *ctx, const void *buffer, size_t sz, const int *ids, int n);
+int skynet_socket_sendfile(struct skynet_context *ctx, int id, int fd, int64_t offset, int64_t sz);
 int skynet_socket_listen(struct skynet_context *ctx, const char *host, int port, int backlog);
+int skynet_socket_listen_reuseport(struct skynet_context *ctx, const char *host, int port, int backlog);
 int skynet_socket_connect(struct skynet_context *ctx, const char *host, int port);
 int skynet_socket_bind(struct skynet_context *ctx, int fd);
 void skynet_socket_close(struct skynet_context *ctx, int id);
@@ -37,6 +46,11 @@ void skynet_socket_shutdown(struct skynet_context *ctx, int id);
 void skynet_socket_start(struct skynet_context *ctx, int id);
 void skynet_socket_pause(struct skynet_context *ctx, int id);
 void skynet_socket_nodelay(struct skynet_context *ctx, int id);
+void skynet_socket_coalesce(struct skynet_context *ctx, int id, int size);
+void skynet_socket_zerocopy(struct skynet_context *ctx, int id, int size);
+void skynet_socket_ratelimit(struct skynet_context *ctx, int id, int read, int packet, int write);
+void skynet_socket_frame(struct skynet_context *ctx, int id, int header, int max, int batch);
+void skynet_socket_tls(struct skynet_context *ctx, int id, void *tls, const struct socket_tls_interface *i);
 
 int skynet_socket_udp(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_connect(struct skynet_context *ctx, int id, const char * addr, int port);
@@ -44,8 +58,19 @@ int skynet_socket_udp_dial(struct skynet_context *ctx, const char * addr, int po
 int skynet_socket_udp_listen(struct skynet_context *ctx, const char * addr, int port);
 int skynet_socket_udp_sendbuffer(struct skynet_context *ctx, const char * address, struct socket_sendbuffer *buffer);
 const char * skynet_socket_udp_address(struct skynet_socket_message *, int *addrsz);
+void skynet_socket_udp_batch(struct skynet_context *ctx, int id, int batch);
+// the datagram at offset of the buffer of SKYNET_SOCKET_TYPE_UDPBATCH message (sz bytes),
+// returns the offset of the next one, or -1 if the record is invalid.
+int skynet_socket_udp_next(const char *buffer, int sz, int offset, const char **data, int *datasz, const char **addr, int *addrsz);
 
-struct socket_info * skynet_socket_info();
+struct socket_info * skynet_socket_info(int tcpinfo);
+struct socket_info * skynet_socket_info_id(int id, int tcpinfo);
+
+// Release the buffer of SKYNET_SOCKET_TYPE_DATA message into read buffer pool, sz is the size of data
+// (data and address for SKYNET_SOCKET_TYPE_UDP, the whole message for SKYNET_SOCKET_TYPE_UDPBATCH).
+// It's also ok to free it by skynet_free.
+void skynet_socket_free_buffer(void *buffer, int sz);
+void skynet_socket_buffer_stat(struct buffer_pool_stat *stat);
 
 // legacy APIs
 
@@ -354,7 +354,8 @@ skynet_start(struct skynet_config * config) {
 	skynet_mq_init(); // 初始化服务句柄管理器（服务唯一标识）
 	skynet_module_init(config->module_path);  // 初始化模块加载器（加载动态链接库）
 	skynet_timer_init();  // 初始化定时器系统
-	skynet_socket_init(); // 初始化网络 socket 模块
+	skynet_socket_init(config->max_socket); // 初始化网络 socket 模块
+	skynet_socket_busypoll(config->socket_spin, config->socket_busy_poll); // 低延迟模式（可选）
 	skynet_profile_enable(config->profile); // 启用性能分析（若配置开启）
 
 	// 启动日志服务
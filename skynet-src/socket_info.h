@@ -18,13 +18,28 @@ struct socket_info {
 	uint64_t write;
 	uint64_t rtime;
 	uint64_t wtime;
+	uint64_t wcall;
 	int64_t wbuffer;
 	uint8_t reading;
 	uint8_t writing;
+	uint8_t tcpinfo;	// 1 when the fields below are sampled by TCP_INFO (linux only)
+	uint32_t rtt;	// smoothed round trip time, in microseconds
+	uint32_t rttvar;	// round trip time variance, in microseconds
+	uint32_t retransmits;	// total retransmitted segments
+	uint32_t cwnd;	// send congestion window, in segments
+	uint32_t unacked;	// segments sent but not acknowledged
 	char name[128];
 	struct socket_info *next;
 };
 
+// the stat of spin-then-block mode of socket thread (see socket_server_busypoll)
+struct socket_poll_stat {
+	uint64_t spin;	// times of spinning before blocking
+	uint64_t hit;	// times of spinning that get events (or commands) without blocking
+	uint64_t spin_us;	// total time of spinning, in microseconds
+	uint64_t block;	// times of blocking in sp_wait
+};
+
 struct socket_info * socket_info_create(struct socket_info *last);
 void socket_info_release(struct socket_info *);
 
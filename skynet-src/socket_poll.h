@@ -2,8 +2,15 @@
 #define socket_poll_h
 
 #include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
+#if defined(__linux__) && defined(USE_IO_URING)
+typedef struct uring_poll * poll_fd;
+#else
 typedef int poll_fd;
+#endif
 
 struct event {
 	void * s;
@@ -19,15 +26,76 @@ static void sp_release(poll_fd fd);
 static int sp_add(poll_fd fd, int sock, void *ud);
 static void sp_del(poll_fd fd, int sock);
 static int sp_enable(poll_fd, int sock, void *ud, bool read_enable, bool write_enable);
-static int sp_wait(poll_fd, struct event *e, int max);
+// timeout is in milliseconds, -1 for infinite, 0 returns at once
+static int sp_wait(poll_fd, struct event *e, int max, int timeout);
 static void sp_nonblocking(int sock);
 
+// The completion based backend (io_uring) defines SP_COMPLETION, it receives and accepts for the sockets in kernel,
+// and the socket server reads and accepts by sp_read / sp_accept. The others use the syscalls directly.
+// sp_stream : sock is a connected stream socket. sp_listen : sock is a listen socket.
+// sp_errqueue : report an error event when the error queue of sock is readable (MSG_ZEROCOPY).
+static void sp_stream(poll_fd, int sock);
+static void sp_listen(poll_fd, int sock);
+static void sp_errqueue(poll_fd, int sock);
+static ssize_t sp_read(poll_fd, int sock, void *buffer, size_t sz);
+static int sp_accept(poll_fd, int sock, struct sockaddr *addr, socklen_t *len);
+// sp_send queues a send of iov and returns 0, the result is taken by sp_sendstate after a write event.
+// It returns -1 if the backend can't send it, and the caller should write by itself.
+#define SP_SEND_IDLE 0
+#define SP_SEND_BUSY 1
+#define SP_SEND_DONE 2
+static int sp_send(poll_fd, int sock, const struct iovec *iov, int n);
+static int sp_sendstate(poll_fd, int sock, ssize_t *sz, size_t *total);
+
 #ifdef __linux__
+#ifdef USE_IO_URING
+#include "socket_uring.h"
+#else
 #include "socket_epoll.h"
 #endif
+#endif
 
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #include "socket_kqueue.h"
 #endif
 
+#ifndef SP_COMPLETION
+
+#include <unistd.h>
+
+static inline void
+sp_stream(poll_fd fd, int sock) {
+}
+
+static inline void
+sp_listen(poll_fd fd, int sock) {
+}
+
+static inline void
+sp_errqueue(poll_fd fd, int sock) {
+	// the error queue is reported as EPOLLERR / EV_ERROR
+}
+
+static inline ssize_t
+sp_read(poll_fd fd, int sock, void *buffer, size_t sz) {
+	return read(sock, buffer, sz);
+}
+
+static inline int
+sp_accept(poll_fd fd, int sock, struct sockaddr *addr, socklen_t *len) {
+	return accept(sock, addr, len);
+}
+
+static inline int
+sp_send(poll_fd fd, int sock, const struct iovec *iov, int n) {
+	return -1;
+}
+
+static inline int
+sp_sendstate(poll_fd fd, int sock, ssize_t *sz, size_t *total) {
+	return SP_SEND_IDLE;
+}
+
+#endif
+
 #endif
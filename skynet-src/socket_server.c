@@ -1,12 +1,20 @@
+#ifdef __linux__
+#define _GNU_SOURCE	// recvmmsg / sendmmsg
+#endif
+
 #include "skynet.h"
 
 #include "socket_server.h"
 #include "socket_poll.h"
+#include "buffer_pool.h"
 #include "atomic.h"
 #include "spinlock.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <errno.h>
@@ -16,12 +24,33 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#endif
 
 #define MAX_INFO 128
-// MAX_SOCKET will be 2^MAX_SOCKET_P
+// default max socket number will be 2^MAX_SOCKET_P, it can be changed by config max_socket
 #define MAX_SOCKET_P 16
+// socket table is allocated by segment (2^SEGMENT_P sockets) when all the slots are used
+#define SEGMENT_P 10
+#define SEGMENT_SIZE (1<<SEGMENT_P)
+#define LIMIT_SOCKET_P 24
 #define MAX_EVENT 64
 #define MIN_READ_BUFFER 64
+// max buffers gathered by one writev
+#ifdef IOV_MAX
+#define MAX_IOV IOV_MAX
+#else
+#define MAX_IOV 64
+#endif
 #define SOCKET_TYPE_INVALID 0
 #define SOCKET_TYPE_RESERVE 1
 #define SOCKET_TYPE_PLISTEN 2
@@ -33,22 +62,33 @@
 #define SOCKET_TYPE_PACCEPT 8
 #define SOCKET_TYPE_BIND 9
 
-#define MAX_SOCKET (1<<MAX_SOCKET_P)
-
 #define PRIORITY_HIGH 0
 #define PRIORITY_LOW 1
 
-#define HASH_ID(id) (((unsigned)id) % MAX_SOCKET)
-#define ID_TAG16(id) ((id>>MAX_SOCKET_P) & 0xffff)
+#define HASH_ID(ss, id) (((unsigned)id) & (ss)->slot_mask)
+#define ID_TAG16(ss, id) ((id>>(ss)->slot_p) & 0xffff)
 
 #define PROTOCOL_TCP 0 // tcp协议
 #define PROTOCOL_UDP 1 // udp
 #define PROTOCOL_UDPv6 2 // udp ipv6
+#define PROTOCOL_UNIX 3 // unix domain datagram (connected or bound to a path)，udp 地址只有 1 字节类型
 #define PROTOCOL_UNKNOWN 255
 
 #define UDP_ADDRESS_SIZE 19	// ipv6 128bit + port 16bit + 1 byte type
 
 #define MAX_UDP_PACKAGE 65535 
+#if defined(__linux__)
+// max datagrams of one recvmmsg / sendmmsg
+#define UDP_BATCH 32
+#endif
+
+// ctrl command queue size, must be power of 2
+#define CTRL_QUEUE_SIZE 4096
+// a producer yields this many times when ctrl queue is full, and then sleeps until socket thread pops the commands
+#define CTRL_FULL_SPIN 64
+// socket thread wakes up the sleeping producers every CTRL_WAKE_BATCH commands popped, or when the queue is empty
+#define CTRL_WAKE_BATCH 64
+#define MAX_CTRL_REQUEST 256
 
 // EAGAIN and EWOULDBLOCK may be not the same value.
 #if (EAGAIN != EWOULDBLOCK)
@@ -58,15 +98,41 @@
 #endif
 
 #define WARNING_SIZE (1024*1024)
+// setopt what for coalesce mode, not a real socket option
+#define SOCKOPT_COALESCE (-1)
+// setopt what for MSG_ZEROCOPY threshold
+#define SOCKOPT_ZEROCOPY (-2)
+// setopt what for udp batch mode
+#define SOCKOPT_UDPBATCH (-3)
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define ZEROCOPY_SEND
+#endif
+
+// the reason why the socket is paused by rate limit
+#define THROTTLE_READ 1
+#define THROTTLE_WRITE 2
+// no throttled socket to wake up
+#define THROTTLE_NONE (~0UL)
+// check the MSG_ZEROCOPY buffers of closed sockets every 0.1s, and reset the connections after 30s (see zerocopy_park)
+#define ZEROCOPY_PARK_INTERVAL 10
+#define ZEROCOPY_PARK_TIMEOUT 3000
 
 #define USEROBJECT ((size_t)(-1))
 
+// the buffer of encoded data read from a tls socket
+#define TLS_READ_BUFFER (64*1024)
+
 struct write_buffer {
 	struct write_buffer * next;  // 链表节点，用于串联多个缓冲区
 	const void *buffer; // 指向待发送的数据内存
 	char *ptr; // 当前发送位置（用于断点续传） 支持因网络阻塞中断后继续发送，提高发送效率
 	size_t sz; // 剩余待发送的字节数
 	bool userobject; // 标记是否为用户自定义对象（需特殊释放）  若为用户自定义对象，使用注册的 free 函数释放 否则直接调用 skynet_free
+	bool file; // 是否为 sendfile 的文件块（struct write_buffer_file），只会出现在高优先级队列中
+	bool zerocopy; // 是否用 MSG_ZEROCOPY 发送过，若是，发送完后要等内核的完成通知才能释放
+	uint32_t zc_seq; // 最后一次 MSG_ZEROCOPY 发送的序号
+	struct socket_multicast *multicast; // 多播共享的缓冲区（引用计数），buffer 指向其中的数据，释放时减引用
 };
 
 // UDP 专用扩展结构（包含目标地址）
@@ -75,6 +141,13 @@ struct write_buffer_udp {
 	uint8_t udp_address[UDP_ADDRESS_SIZE]; // UDP 目标地址信息
 };
 
+// sendfile 专用扩展结构，sz 为文件中剩余待发送的字节数（不计入 wb_size）
+struct write_buffer_file {
+	struct write_buffer buffer;
+	int fd; // 文件描述符，发送完毕或 socket 关闭时由 socket 线程关闭
+	off_t offset; // 下一次发送在文件中的偏移
+};
+
 struct wb_list {
 	struct write_buffer * head;  // list的头节点
 	struct write_buffer * tail;  // list的尾节点
@@ -85,6 +158,43 @@ struct socket_stat {
 	uint64_t wtime;
 	uint64_t read; // 累计读写的字节数
 	uint64_t write;
+	uint64_t wcall; // 写系统调用的次数，write / wcall 即每次调用平均写出的字节数
+};
+
+// 令牌桶限速，令牌以 1/100 为单位（ss->time 的单位是 1/100 秒），最多积攒 1 秒的令牌。
+// 一次读写可以透支令牌（token 为负），透支的部分在之后补回，所以平均速率是准确的。
+struct rate_limit {
+	ATOM_INT rate; // 每秒的速率，0 表示不限速
+	int64_t token; // 当前的令牌数 * 100
+	uint64_t time; // 上次补充令牌的时间
+};
+
+// 按长度头分包（socket_server_frame），只由 socket 线程访问。
+// 长度头为 2 或 4 字节大端，不包含长度头本身。
+struct socket_frame {
+	uint8_t header; // 长度头字节数，2 或 4
+	bool batch; // true : 一次读取中的完整包（保留长度头）合并为一条 SOCKET_DATA；false : 每个包（去掉长度头）一条 SOCKET_FRAME
+	bool more; // 上次读取是否读满了缓冲区，读满说明内核中可能还有数据
+	int max; // 包体的最大长度，超出则报错
+	int head_n; // 跨两次读取时，head 中已读到的长度头字节数
+	uint8_t head[4];
+	char * pack; // 未读完整的包，batch 模式包含长度头（buffer_pool 分配，大小为 pack_sz）
+	int pack_sz; // pack 的总长度
+	int pack_n; // pack 中已读到的字节数
+	char * rbuf; // 已读入但还没有分完的数据（buffer_pool 分配，大小为 rbuf_sz）
+	int rbuf_sz;
+	int roff; // rbuf 中已分包的位置
+	int rn; // rbuf 中的数据长度
+};
+
+// TLS 层（socket_server_tls），只由 socket 线程访问。
+// 读到的数据解密后再转发，发送的数据加密后放入高优先级队列（记录必须按加密的顺序发出，所以不区分优先级）。
+struct socket_tls {
+	void * tls; // 由 i 操作的 TLS 对象（例如 ltls.c 中的 SSL）
+	const struct socket_tls_interface * i;
+	char * plain; // 握手完成前要发送的明文，握手完成后加密发出
+	int plain_sz;
+	int plain_cap;
 };
 
 struct socket {
@@ -93,16 +203,31 @@ struct socket {
 	struct wb_list low;  // 低优先级的发送队列
 	int64_t wb_size;  // 发送缓冲区总大小（字节数），用于监控缓冲区占用，避免内存溢出
 	struct socket_stat stat; // 包含收发数据的统计信息
-	ATOM_ULONG sending;  // 发送状态标记（原子类型），用于多线程同步，避免并发发送冲突（高 16 位为 ID_TAG16(id)，低 16 位为计数器）
+	ATOM_ULONG sending;  // 发送状态标记（原子类型），用于多线程同步，避免并发发送冲突（高 16 位为 ID_TAG16(ss, id)，低 16 位为计数器）
 	int fd;  // 文件描述符
 	int id; // skynet中为socket分配的唯一标识 大于0
 	ATOM_INT type; // 连接状态（原子类型，支持多线程安全访问），取值为宏定义的状态常量（如 SOCKET_TYPE_CONNECTING 表示连接中、SOCKET_TYPE_CONNECTED 表示已连接等
-	uint8_t protocol; // 协议类型，取值为宏定义的 PROTOCOL_TCP（0）、PROTOCOL_UDP（1）、PROTOCOL_UDPv6（2）
+	uint8_t protocol; // 协议类型，取值为宏定义的 PROTOCOL_TCP（0）、PROTOCOL_UDP（1）、PROTOCOL_UDPv6（2）、PROTOCOL_UNIX（3），unix domain stream 也使用 PROTOCOL_TCP
 	bool reading; // 是否监听读事件 true表示允许接收数据，由enable_read函数控制
 	bool writing; // 是否监听写事件， true 表示允许发送数据，enable_write函数控制
 	bool closing; // 是否处于关闭中的状态
 	ATOM_INT udpconnecting; // UDP 连接状态（原子类型），用于标记 UDP 是否处于 “连接” 过程（模拟 TCP 连接特性）
+	bool udpbatch; // UDP 一次 recvmmsg 收到的数据报合并为一条 SOCKET_UDPBATCH 消息，只由 socket 线程访问
 	int64_t warn_size; // 缓冲区告警阈值，当 wb_size 超过此值时可能触发警告（避免缓冲区过度堆积）
+	ATOM_INT coalesce; // 合并小包写入的阈值（字节），0 表示关闭。开启后不再由工作线程直接写，数据都交给 socket 线程在下一轮 poll 中一次 writev 发出
+	ATOM_INT zerocopy; // 不小于此长度（字节）的内存块用 MSG_ZEROCOPY 发送，0 表示关闭（linux only）
+	uint32_t zc_seq; // 下一次 MSG_ZEROCOPY 发送的序号，内核对每次成功的 MSG_ZEROCOPY 调用计数
+	struct wb_list zc; // 已经发送完，等待内核完成通知才能释放的 write_buffer，按 zc_seq 排列
+	struct rate_limit rlimit; // 读取字节数限速
+	struct rate_limit plimit; // 读取包数限速（tcp 每次 read 或每个 udp 数据报算一个包）
+	struct rate_limit wlimit; // 写出字节数限速，开启后不再由工作线程直接写
+	uint8_t throttle; // 因超出限速而暂停的读写（THROTTLE_READ / THROTTLE_WRITE），令牌补足后由 socket 线程恢复
+	bool pause; // 限速暂停期间是否又被 pause_socket 暂停了读，若是，限速结束后不恢复读
+	bool throttle_list; // 是否在 ss->throttle 链表中（socket 关闭后可能仍在链表中，由 throttle_refill 移除）
+	struct socket * throttle_next; // ss->throttle 链表
+	struct socket_frame * frame; // 按长度头分包的状态，NULL 表示不分包，原样转发读到的数据
+	struct socket_tls * tls; // TLS 层，NULL 表示明文
+	ATOM_INT tls_on; // 是否挂接了（或即将挂接）TLS 层，由 socket_server_tls 立即设置，开启后不再由工作线程直接写
 	union {
 		int size; // TCP缓冲区大小，初始值为 MIN_READ_BUFFER 64
 		uint8_t udp_address[UDP_ADDRESS_SIZE]; // UDP 关联的目标地址（包含地址类型、端口、IP 地址等，长度固定为 19 字节）
@@ -113,20 +238,46 @@ struct socket {
 	size_t dw_size; // 延迟发送的数据大小
 };
 
+// 一条控制命令，seq 用于生产者/消费者之间的同步（Vyukov bounded queue）
+struct ctrl_slot {
+	ATOM_SIZET seq;
+	uint8_t type;
+	union {
+		uint8_t buffer[MAX_CTRL_REQUEST];
+		uint64_t align;
+		void * ptr;
+	} u;
+};
+
+struct ctrl_queue {
+	ATOM_SIZET tail; // 生产者（任意工作线程）争用的写入位置
+	char pad[64 - sizeof(ATOM_SIZET)]; // 避免 tail 与 head 伪共享
+	size_t head; // 只由 socket 线程读写
+	ATOM_INT full_wait; // 队列满时睡眠等待的生产者数量
+	pthread_mutex_t full_lock;
+	pthread_cond_t full_cond; // socket 线程取出命令后唤醒睡眠的生产者
+	struct ctrl_slot slot[CTRL_QUEUE_SIZE];
+};
+
 struct socket_server {
 	// 时间管理 
 	volatile uint64_t time; // 当前时间戳（volatile 确保多线程下的可见性），用于网络事件的超时管理和统计（如最后一次读写时间）
 
 	// 文件描述符相关
 	int reserve_fd;	// for EMFILE 预留的文件描述符，用于应对 EMFILE 错误（系统文件描述符耗尽时的应急处理
-	int recvctrl_fd; // 控制管道的读端，用于线程间通信（如处理外部发送的连接、关闭等命令）
-	int sendctrl_fd; // 控制管道的写端，用于线程间通信（如处理外部发送的连接、关闭等命令）
-	fd_set rfds; // 文件描述符集合，用于辅助监听控制管道的可读事件。
+	int recvctrl_fd; // 控制命令通知的读端（linux 下为 eventfd，其它平台为管道），仅用于唤醒 socket 线程
+	int sendctrl_fd; // 控制命令通知的写端（linux 下与 recvctrl_fd 相同）
+	ATOM_INT ctrl_sleep; // socket 线程即将阻塞在 sp_wait 时置 1，此时投递命令的线程才需要写通知 fd
+	struct ctrl_queue ctrl; // 控制命令队列（多生产者单消费者无锁环形队列），替代原来的管道传输
 
 	// 连接管理
 	ATOM_INT alloc_id; // 原子类型的ID分配器，用于生成socket的唯一标识，确保多线程安全。
-	struct socket slot[MAX_SOCKET]; // socket 连接数组（大小为 2^16） 65536，通过 HASH_ID(id) 映射管理所有连接，实现 O (1) 级别的访问效率
-	// HASH_ID(id) (((unsigned)id) % MAX_SOCKET)
+	int slot_p; // socket 表最大容量为 2^slot_p（配置 max_socket，默认 2^16）
+	unsigned slot_mask; // 2^slot_p - 1 , HASH_ID(ss, id) = id & slot_mask
+	ATOM_INT slot_n; // 已分配的 slot 数量（SEGMENT_SIZE 的整数倍），只增不减，id 只在 [0, slot_n) 中分配
+	struct spinlock slot_lock; // 增长 socket 表时加锁
+	ATOM_POINTER * slot; // 分段的 socket 表，共 2^(slot_p-SEGMENT_P) 段，按需分配，通过 get_socket 以 O(1) 无锁访问
+	struct socket invalid; // 不存在的 id （所在的段未分配）都映射到这个无效的 socket
 
 	// 事件驱动核心
 	poll_fd event_fd; // I/O 多路复用句柄（封装了 epoll/kqueue 等底层实现），用于监听所有 socket 的读写事件
@@ -138,8 +289,24 @@ struct socket_server {
 	// 缓冲区与接口
 	struct socket_object_interface soi; // socket 对象接口，封装了业务层对象的内存管理函数（如缓冲区的分配、释放），实现框架与业务逻辑的解耦
 	char buffer[MAX_INFO]; // 通用缓冲区（大小 MAX_INFO=128），用于临时存储字符串信息（如 IP 地址转换结果）
+#ifndef UDP_BATCH
 	uint8_t udpbuffer[MAX_UDP_PACKAGE]; // UDP 接收缓冲区（大小 65535），用于暂存收到的 UDP 数据包
-	
+#endif
+	struct udp_batch * udpbatch; // recvmmsg 的批量接收缓冲区，第一次收到 UDP 数据时创建
+	char * tlsbuffer; // 读取 TLS 加密数据的缓冲区（TLS_READ_BUFFER），第一次读取 TLS socket 时创建
+
+	// 限速
+	struct socket * throttle; // 因限速暂停读写的 socket 链表，只由 socket 线程访问
+	ATOM_ULONG throttle_wake; // 下次需要补充令牌的时间，定时器线程在 socket_server_updatetime 中发现到期后发送 'Z' 命令唤醒 socket 线程
+	struct zerocopy_park * zc_park; // 已关闭但 MSG_ZEROCOPY 发送还未完成的 fd 及其缓冲区，在 'Z' 命令中检查，见 zerocopy_park
+
+	// 低延迟模式（socket_server_busypoll）
+	int spin; // 阻塞在 sp_wait 之前，先以 0 超时轮询的时长（微秒），0 表示直接阻塞
+	int busy_poll; // 新 socket 的 SO_BUSY_POLL（微秒），0 表示不设置
+	ATOM_ULONG spin_n; // 自旋的次数
+	ATOM_ULONG spin_hit; // 自旋期间等到事件或控制命令（不需要阻塞）的次数
+	ATOM_ULONG spin_us; // 自旋的总时长（微秒）
+	ATOM_ULONG block_n; // 阻塞在 sp_wait 的次数
 };
 
 // 用于描述 “发起连接” 请求的参数，对应 TCP 客户端主动连接服务器的操作
@@ -156,6 +323,13 @@ struct request_send {
 	const void * buffer;
 };
 
+struct request_sendfile {
+	int id;
+	int fd;
+	int64_t offset;
+	int64_t sz;
+};
+
 struct request_send_udp {
 	struct request_send send;
 	uint8_t address[UDP_ADDRESS_SIZE];
@@ -196,6 +370,26 @@ struct request_setopt {
 	int value;
 };
 
+struct request_ratelimit {
+	int id;
+	int read; // bytes per second
+	int packet; // packets per second
+	int write; // bytes per second
+};
+
+struct request_frame {
+	int id;
+	int header; // 0 : turn off
+	int max;
+	int batch;
+};
+
+struct request_tls {
+	int id;
+	void * tls;
+	const struct socket_tls_interface * i;
+};
+
 struct request_udp {
 	int id;
 	int fd;
@@ -210,6 +404,20 @@ struct request_dial_udp {
 	uint8_t address[UDP_ADDRESS_SIZE];
 };
 
+// The buffer is shared by the write lists of all the sockets, it's only touched by socket thread after the request is sent,
+// so the reference count needn't be atomic.
+struct socket_multicast {
+	int ref;
+	int n;
+	size_t sz;
+	const void * buffer;
+	int id[1];	// n socket ids, -1 for the invalid one
+};
+
+struct request_multicast {
+	struct socket_multicast * m;
+};
+
 /*
 	The first byte is TYPE
 	R Resume socket
@@ -222,37 +430,113 @@ struct request_dial_udp {
 	W Enable write
 	D Send package (high)
 	P Send package (low)
+	F Send file
 	A Send UDP package
 	C set udp address
 	N client dial to UDP host port
 	T Set opt
 	U Create UDP socket
+	Y Set rate limit
+	Z Wake up throttled sockets
+	M Send package to multiple sockets
+	E Attach TLS
  */
 
 struct request_package {
-	uint8_t header[8];	// 6 bytes dummy
 	union {
-		char buffer[256];
+		char buffer[MAX_CTRL_REQUEST];
 		struct request_open open;
 		struct request_send send;
+		struct request_sendfile sendfile;
 		struct request_send_udp send_udp;
 		struct request_close close;
 		struct request_listen listen;
 		struct request_bind bind;
 		struct request_resumepause resumepause;
 		struct request_setopt setopt;
+		struct request_ratelimit ratelimit;
+		struct request_frame frame;
+		struct request_tls tls;
 		struct request_udp udp;
 		struct request_setudp set_udp;
 		struct request_dial_udp dial_udp;
+		struct request_multicast multicast;
 	} u;
-	uint8_t dummy[256];
 };
 
 union sockaddr_all {
 	struct sockaddr s;
 	struct sockaddr_in v4;
 	struct sockaddr_in6 v6;
+	struct sockaddr_un un;
+};
+
+#define UNIX_PREFIX "unix:"
+#define UNIX_PREFIX_LEN (sizeof(UNIX_PREFIX) - 1)
+
+// An address "unix:path" is an unix domain socket, returns the path (or NULL).
+static inline const char *
+unix_path(const char *addr) {
+	if (addr && strncmp(addr, UNIX_PREFIX, UNIX_PREFIX_LEN) == 0)
+		return addr + UNIX_PREFIX_LEN;
+	return NULL;
+}
+
+// The path begins with '@' is in abstract namespace (linux only).
+// return the length of address, 0 when the path is too long.
+static socklen_t
+unix_address(const char *path, struct sockaddr_un *sa) {
+	size_t sz = strlen(path);
+	if (sz == 0 || sz >= sizeof(sa->sun_path))
+		return 0;
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	memcpy(sa->sun_path, path, sz);
+	if (path[0] == '@') {
+		sa->sun_path[0] = '\0';
+		return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + sz);
+	}
+	return (socklen_t)sizeof(*sa);
+}
+
+static int
+getname(union sockaddr_all *u, socklen_t slen, char *buffer, size_t sz) {
+	if (u->s.sa_family == AF_UNIX) {
+		// unix:path , or unix: for unnamed socket (the connect side)
+		int n = (int)slen - (int)offsetof(struct sockaddr_un, sun_path);
+		const char * path = u->un.sun_path;
+		if (n > 0 && path[0] == '\0') {
+			// abstract namespace
+			snprintf(buffer, sz, UNIX_PREFIX "@%.*s", n - 1, path + 1);
+		} else {
+			snprintf(buffer, sz, UNIX_PREFIX "%.*s", n > 0 ? n : 0, path);
+		}
+		return 1;
+	}
+	char tmp[INET6_ADDRSTRLEN];
+	void * sin_addr = (u->s.sa_family == AF_INET) ? (void*)&u->v4.sin_addr : (void *)&u->v6.sin6_addr;
+	if (inet_ntop(u->s.sa_family, sin_addr, tmp, sizeof(tmp))) {
+		int sin_port = ntohs((u->s.sa_family == AF_INET) ? u->v4.sin_port : u->v6.sin6_port);
+		snprintf(buffer, sz, "%s:%d", tmp, sin_port);
+		return 1;
+	} else {
+		buffer[0] = '\0';
+		return 0;
+	}
+}
+
+#ifdef UDP_BATCH
+// recvmmsg 一次收到的数据报，每次 poll 转发其中一个（每个数据报仍是一条 SOCKET_UDP 消息）
+struct udp_batch {
+	int id; // 所属 socket 的 id
+	int n; // 收到的数据报数量
+	int index; // 下一个待转发的数据报
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	union sockaddr_all addr[UDP_BATCH];
+	uint8_t buffer[UDP_BATCH][MAX_UDP_PACKAGE];
 };
+#endif
 
 struct send_object {
 	const void * buffer;
@@ -349,9 +633,21 @@ send_object_init_from_sendbuffer(struct socket_server *ss, struct send_object *s
 	}
 }
 
+static void
+multicast_release(struct socket_multicast *m) {
+	if (--m->ref == 0) {
+		FREE((void *)m->buffer);
+		FREE(m);
+	}
+}
+
 static inline void
 write_buffer_free(struct socket_server *ss, struct write_buffer *wb) {
-	if (wb->userobject) {
+	if (wb->file) {
+		close(((struct write_buffer_file *)wb)->fd);
+	} else if (wb->multicast) {
+		multicast_release(wb->multicast);
+	} else if (wb->userobject) {
 		ss->soi.free((void *)wb->buffer);
 	} else {
 		FREE((void *)wb->buffer);
@@ -365,32 +661,90 @@ socket_keepalive(int fd) {
 	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));
 }
 
+static inline struct socket *
+get_socket(struct socket_server *ss, int id) {
+	unsigned h = HASH_ID(ss, id);
+	struct socket * seg = (struct socket *)ATOM_LOAD(&ss->slot[h >> SEGMENT_P]);
+	if (seg == NULL)
+		return &ss->invalid;
+	return &seg[h & (SEGMENT_SIZE-1)];
+}
+
+// the i-th slot, i < slot_n
+static inline struct socket *
+slot_index(struct socket_server *ss, int i) {
+	struct socket * seg = (struct socket *)ATOM_LOAD(&ss->slot[i >> SEGMENT_P]);
+	return &seg[i & (SEGMENT_SIZE-1)];
+}
+
+static void
+init_slot(struct socket *s) {
+	memset(s, 0, sizeof(*s));
+	ATOM_INIT(&s->type, SOCKET_TYPE_INVALID);
+	s->id = -1;
+	s->fd = -1;
+	spinlock_init(&s->dw_lock);
+}
+
+// Allocate one more segment when all the n slots are used, return false when the table is full
+static bool
+grow_slot(struct socket_server *ss, int n) {
+	bool ret = true;
+	spinlock_lock(&ss->slot_lock);
+	if (ATOM_LOAD(&ss->slot_n) == n) {
+		if ((unsigned)n > ss->slot_mask) {
+			ret = false;
+		} else {
+			struct socket * seg = MALLOC(sizeof(struct socket) * SEGMENT_SIZE);
+			int i;
+			for (i=0;i<SEGMENT_SIZE;i++) {
+				init_slot(&seg[i]);
+			}
+			ATOM_STORE(&ss->slot[n >> SEGMENT_P], (uintptr_t)seg);
+			ATOM_STORE(&ss->slot_n, n + SEGMENT_SIZE);
+		}
+	}
+	// else, grown by others
+	spinlock_unlock(&ss->slot_lock);
+	return ret;
+}
+
 static int
 reserve_id(struct socket_server *ss) {
-	int i;
-	for (i=0;i<MAX_SOCKET;i++) {
-		int id = ATOM_FINC(&(ss->alloc_id))+1;
-		if (id < 0) {
-			id = ATOM_FAND(&(ss->alloc_id), 0x7fffffff) & 0x7fffffff;
-		}
-		struct socket *s = &ss->slot[HASH_ID(id)];
-		int type_invalid = ATOM_LOAD(&s->type);
-		if (type_invalid == SOCKET_TYPE_INVALID) {
-			if (ATOM_CAS(&s->type, type_invalid, SOCKET_TYPE_RESERVE)) {
-				s->id = id;
-				s->protocol = PROTOCOL_UNKNOWN;
-				// socket_server_udp_connect may inc s->udpconncting directly (from other thread, before new_fd),
-				// so reset it to 0 here rather than in new_fd.
-				ATOM_INIT(&s->udpconnecting, 0);
-				s->fd = -1;
-				return id;
-			} else {
-				// retry
+	for (;;) {
+		int n = ATOM_LOAD(&ss->slot_n);
+		int i;
+		for (i=0;i<n;i++) {
+			int id = ATOM_FINC(&(ss->alloc_id))+1;
+			if (id < 0) {
+				id = ATOM_FAND(&(ss->alloc_id), 0x7fffffff) & 0x7fffffff;
+			}
+			if (HASH_ID(ss, id) >= (unsigned)n) {
+				// the slot is not allocated, skip to the next round (HASH_ID == 0)
+				ATOM_CAS(&ss->alloc_id, id, id | ss->slot_mask);
 				--i;
+				continue;
+			}
+			struct socket *s = get_socket(ss, id);
+			int type_invalid = ATOM_LOAD(&s->type);
+			if (type_invalid == SOCKET_TYPE_INVALID) {
+				if (ATOM_CAS(&s->type, type_invalid, SOCKET_TYPE_RESERVE)) {
+					s->id = id;
+					s->protocol = PROTOCOL_UNKNOWN;
+					// socket_server_udp_connect may inc s->udpconncting directly (from other thread, before new_fd),
+					// so reset it to 0 here rather than in new_fd.
+					ATOM_INIT(&s->udpconnecting, 0);
+					s->fd = -1;
+					return id;
+				} else {
+					// retry
+					--i;
+				}
 			}
 		}
+		if (!grow_slot(ss, n))
+			return -1;
 	}
-	return -1;
 }
 
 static inline void
@@ -403,6 +757,42 @@ clear_wb_list(struct wb_list *list) {
 // 初始化 socket 服务的核心数据结构，包括 I/O 多路复用机制、线程间通信管道、连接管理数组等
 // 返回一个初始化完成的 struct socket_server 指针，作为后续所有 socket 操作的入口
 
+static int
+ctrl_notify_create(int fd[2]) {
+#ifdef __linux__
+	int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd < 0)
+		return -1;
+	fd[0] = fd[1] = efd;
+#else
+	if (pipe(fd))
+		return -1;
+	sp_nonblocking(fd[0]);
+	sp_nonblocking(fd[1]);
+#endif
+	return 0;
+}
+
+static void
+ctrl_notify_release(int rfd, int wfd) {
+	close(rfd);
+	if (wfd != rfd)
+		close(wfd);
+}
+
+static void
+ctrl_queue_init(struct ctrl_queue *q) {
+	size_t i;
+	ATOM_INIT(&q->tail, 0);
+	q->head = 0;
+	ATOM_INIT(&q->full_wait, 0);
+	pthread_mutex_init(&q->full_lock, NULL);
+	pthread_cond_init(&q->full_cond, NULL);
+	for (i=0;i<CTRL_QUEUE_SIZE;i++) {
+		ATOM_INIT(&q->slot[i].seq, i);
+	}
+}
+
 /*
 static int
 sp_create() {
@@ -410,8 +800,7 @@ sp_create() {
 }
 */
 struct socket_server *
-socket_server_create(uint64_t time) {
-	int i;
+socket_server_create(uint64_t time, int max_socket) {
 	int fd[2];
 	poll_fd efd = sp_create(); // 创建 I/O 多路复用句柄
 	if (sp_invalid(efd)) { // 检查句柄
@@ -419,21 +808,19 @@ socket_server_create(uint64_t time) {
 		return NULL;
 	}
 
-	// 通过 pipe(fd) 创建一个匿名管道，用于 socket 线程与其他线程（如 Skynet 工作线程）的通信：
-	// fd[0] 为读端（recvctrl_fd），用于接收控制命令（如连接、关闭 socket 的请求）。
-	// fd[1] 为写端（sendctrl_fd），用于发送控制命令。
-	if (pipe(fd)) {
-		// 管道创建失败，释放已创建的事件池句柄并返回 NULL
+	// 控制命令通过 ss->ctrl 无锁队列传递，fd 只用来在 socket 线程阻塞时唤醒它：
+	// fd[0] 为读端（recvctrl_fd），注册到事件池中。
+	// fd[1] 为写端（sendctrl_fd），linux 下两者是同一个 eventfd 。
+	if (ctrl_notify_create(fd)) {
 		sp_release(efd);
-		skynet_error(NULL, "socket-server error: create socket pair failed.");
+		skynet_error(NULL, "socket-server error: create ctrl notify fd failed.");
 		return NULL;
 	}
-	// 通过 sp_add 将管道读端（fd[0]）注册到事件池（efd），使其能被 I/O 多路复用机制监听
+	// 通过 sp_add 将通知 fd 注册到事件池（efd），使其能被 I/O 多路复用机制监听
 	if (sp_add(efd, fd[0], NULL)) { 
 		// add recvctrl_fd to event poll
 		skynet_error(NULL, "socket-server error: can't add server fd to event pool.");
-		close(fd[0]);
-		close(fd[1]);
+		ctrl_notify_release(fd[0], fd[1]);
 		sp_release(efd);
 		return NULL;
 	}
@@ -442,34 +829,64 @@ socket_server_create(uint64_t time) {
 	struct socket_server *ss = MALLOC(sizeof(*ss));
 	ss->time = time; // 初始化当前时间戳（从框架启动开始计算）
 	ss->event_fd = efd; // 绑定 I/O 多路复用句柄
-	ss->recvctrl_fd = fd[0]; // 绑定管道读端
-	ss->sendctrl_fd = fd[1]; // 绑定管道写端
-	ss->checkctrl = 1;  // 标记需要检查控制管道事件
+	ss->recvctrl_fd = fd[0]; // 绑定通知 fd 读端
+	ss->sendctrl_fd = fd[1]; // 绑定通知 fd 写端
+	ss->checkctrl = 1;  // 标记需要检查控制命令队列
+	ATOM_INIT(&ss->ctrl_sleep, 0);
+	ctrl_queue_init(&ss->ctrl);
 	ss->reserve_fd = dup(1);	// reserve an extra fd for EMFILE // 复制标准输出的文件描述符，用于应对 EMFILE（文件描述符耗尽）错误
 
-	// 初始化 socket 连接数组
-	for (i=0;i<MAX_SOCKET;i++) {
-		struct socket *s = &ss->slot[i];
-		ATOM_INIT(&s->type, SOCKET_TYPE_INVALID); // // 初始化 socket 状态为“无效”
-		clear_wb_list(&s->high); // 清空高优先级发送队列
-		clear_wb_list(&s->low); // 清空低优先级发送队列
-		spinlock_init(&s->dw_lock); // 初始化延迟发送缓冲区的自旋锁
+	// 初始化 socket 表：容量为不小于 max_socket 的 2 的幂，先只分配第一段
+	int p = MAX_SOCKET_P;
+	if (max_socket > 0) {
+		p = SEGMENT_P;
+		while (p < LIMIT_SOCKET_P && (1 << p) < max_socket) {
+			++p;
+		}
 	}
+	ss->slot_p = p;
+	ss->slot_mask = (1u << p) - 1;
+	size_t segn = (size_t)1 << (p - SEGMENT_P);
+	ss->slot = MALLOC(segn * sizeof(ATOM_POINTER));
+	size_t i;
+	for (i=0;i<segn;i++) {
+		ATOM_INIT(&ss->slot[i], 0);
+	}
+	ATOM_INIT(&ss->slot_n, 0);
+	spinlock_init(&ss->slot_lock);
+	init_slot(&ss->invalid);
+	grow_slot(ss, 0);
 
 	// 初始化其他成员变量
 	ATOM_INIT(&ss->alloc_id , 0); // 初始化 socket ID 分配器（原子变量，确保多线程安全）
 	ss->event_n = 0;  // 就绪事件数量初始化为 0
 	ss->event_index = 0; // 事件处理索引初始化为 0
 	memset(&ss->soi, 0, sizeof(ss->soi));  // 初始化 socket 对象接口（内存管理函数）
-	FD_ZERO(&ss->rfds); // 清空文件描述符集合（用于辅助监听控制管道）
-	assert(ss->recvctrl_fd < FD_SETSIZE);
-
-	return ss; // 确保管道读端的文件描述符在有效范围内
+	ss->udpbatch = NULL;
+	ss->throttle = NULL;
+	ATOM_INIT(&ss->throttle_wake, THROTTLE_NONE);
+	ss->zc_park = NULL;
+	ss->spin = 0;
+	ss->busy_poll = 0;
+	ATOM_INIT(&ss->spin_n, 0);
+	ATOM_INIT(&ss->spin_hit, 0);
+	ATOM_INIT(&ss->spin_us, 0);
+	ATOM_INIT(&ss->block_n, 0);
+
+	return ss;
 }
 
+static void send_request(struct socket_server *ss, struct request_package *request, char type, int len);
+
+// It's called by timer thread, so the socket thread (maybe blocked in sp_wait) is woken up by a 'Z' command when throttled sockets can be resumed.
 void
 socket_server_updatetime(struct socket_server *ss, uint64_t time) {
 	ss->time = time;
+	unsigned long wake = ATOM_LOAD(&ss->throttle_wake);
+	if (time >= wake && ATOM_CAS_ULONG(&ss->throttle_wake, wake, THROTTLE_NONE)) {
+		struct request_package request;
+		send_request(ss, &request, 'Z', 0);
+	}
 }
 
 static void
@@ -520,6 +937,29 @@ clone_buffer(struct socket_sendbuffer *buf, size_t *sz) {
 	return NULL;
 }
 
+static void
+free_frame(struct socket_frame *f) {
+	// the uncomplete pack is discarded
+	if (f->pack) {
+		buffer_pool_free(f->pack, f->pack_sz);
+	}
+	if (f->rbuf) {
+		buffer_pool_free(f->rbuf, f->rbuf_sz);
+	}
+	FREE(f);
+}
+
+static void
+free_tls(struct socket_tls *t) {
+	t->i->release(t->tls);
+	FREE(t->plain);
+	FREE(t);
+}
+
+
+static bool zerocopy_park(struct socket_server *ss, struct socket *s);
+static void zerocopy_park_release(struct socket_server *ss);
+
 static void
 force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	result->id = s->id;
@@ -531,16 +971,29 @@ force_close(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 		return;
 	}
 	assert(type != SOCKET_TYPE_RESERVE);
+	// remove it from the event pool first, a send queued by sp_send is finished in sp_del
+	sp_del(ss->event_fd, s->fd);
+	// the kernel may still read the buffers sent by MSG_ZEROCOPY (retransmission), keep them with the fd until completed
+	bool parked = type != SOCKET_TYPE_BIND && zerocopy_park(ss, s);
 	free_wb_list(ss,&s->high);
 	free_wb_list(ss,&s->low);
-	sp_del(ss->event_fd, s->fd);
+	free_wb_list(ss,&s->zc);
 	socket_lock(l);
-	if (type != SOCKET_TYPE_BIND) {
+	if (type != SOCKET_TYPE_BIND && !parked) {
 		if (close(s->fd) < 0) {
 			perror("close socket:");
 		}
 	}
 	ATOM_STORE(&s->type, SOCKET_TYPE_INVALID);
+	s->throttle = 0;
+	if (s->frame) {
+		free_frame(s->frame);
+		s->frame = NULL;
+	}
+	if (s->tls) {
+		free_tls(s->tls);
+		s->tls = NULL;
+	}
 	if (s->dw_buffer) {
 		struct socket_sendbuffer tmp;
 		tmp.buffer = s->dw_buffer;
@@ -557,8 +1010,9 @@ void
 socket_server_release(struct socket_server *ss) {
 	int i;
 	struct socket_message dummy;
-	for (i=0;i<MAX_SOCKET;i++) {
-		struct socket *s = &ss->slot[i];
+	int n = ATOM_LOAD(&ss->slot_n);
+	for (i=0;i<n;i++) {
+		struct socket *s = slot_index(ss, i);
 		struct socket_lock l;
 		socket_lock_init(s, &l);
 		if (ATOM_LOAD(&s->type) != SOCKET_TYPE_RESERVE) {
@@ -566,11 +1020,21 @@ socket_server_release(struct socket_server *ss) {
 		}
 		spinlock_destroy(&s->dw_lock);
 	}
-	close(ss->sendctrl_fd);
-	close(ss->recvctrl_fd);
+	zerocopy_park_release(ss);
+	for (i=0;i<n;i+=SEGMENT_SIZE) {
+		FREE(slot_index(ss, i));
+	}
+	FREE(ss->slot);
+	spinlock_destroy(&ss->invalid.dw_lock);
+	spinlock_destroy(&ss->slot_lock);
+	ctrl_notify_release(ss->recvctrl_fd, ss->sendctrl_fd);
+	pthread_mutex_destroy(&ss->ctrl.full_lock);
+	pthread_cond_destroy(&ss->ctrl.full_cond);
 	sp_release(ss->event_fd);
 	if (ss->reserve_fd >= 0)
 		close(ss->reserve_fd);
+	FREE(ss->udpbatch);
+	FREE(ss->tlsbuffer);
 	FREE(ss);
 }
 
@@ -601,25 +1065,44 @@ enable_read(struct socket_server *ss, struct socket *s, bool enable) {
 
 static struct socket *
 new_fd(struct socket_server *ss, int id, int fd, int protocol, uintptr_t opaque, bool reading) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	assert(ATOM_LOAD(&s->type) == SOCKET_TYPE_RESERVE);
 
 	if (sp_add(ss->event_fd, fd, s)) {
 		ATOM_STORE(&s->type, SOCKET_TYPE_INVALID);
 		return NULL;
 	}
+#ifdef SO_BUSY_POLL
+	if (ss->busy_poll > 0 && protocol != PROTOCOL_UNIX) {
+		// the value larger than sysctl net.core.busy_read needs CAP_NET_ADMIN, ignore the error
+		setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &ss->busy_poll, sizeof(ss->busy_poll));
+	}
+#endif
 
 	s->id = id;
 	s->fd = fd;
 	s->reading = true;
 	s->writing = false;
 	s->closing = false;
-	ATOM_INIT(&s->sending , ID_TAG16(id) << 16 | 0);
+	s->udpbatch = false;
+	ATOM_INIT(&s->sending , ID_TAG16(ss, id) << 16 | 0);
 	s->protocol = protocol;
 	s->p.size = MIN_READ_BUFFER;
 	s->opaque = opaque;
 	s->wb_size = 0;
 	s->warn_size = 0;
+	ATOM_STORE(&s->coalesce, 0);
+	ATOM_STORE(&s->zerocopy, 0);
+	s->zc_seq = 0;
+	check_wb_list(&s->zc);
+	ATOM_STORE(&s->rlimit.rate, 0);
+	ATOM_STORE(&s->plimit.rate, 0);
+	ATOM_STORE(&s->wlimit.rate, 0);
+	s->throttle = 0;
+	s->pause = false;
+	s->frame = NULL;
+	s->tls = NULL;
+	ATOM_STORE(&s->tls_on, 0);
 	check_wb_list(&s->high);
 	check_wb_list(&s->low);
 	s->dw_buffer = NULL;
@@ -641,9 +1124,162 @@ stat_read(struct socket_server *ss, struct socket *s, int n) {
 static inline void
 stat_write(struct socket_server *ss, struct socket *s, int n) {
 	s->stat.write += n;
+	s->stat.wcall++;
 	s->stat.wtime = ss->time;
 }
 
+static void
+limit_set(struct rate_limit *r, int rate, uint64_t now) {
+	if (rate < 0)
+		rate = 0;
+	ATOM_STORE(&r->rate, rate);
+	r->token = (int64_t)rate * 100;
+	r->time = now;
+}
+
+// add tokens for the time passed, return false when the tokens are used up
+static bool
+limit_refill(struct rate_limit *r, uint64_t now) {
+	int rate = ATOM_LOAD(&r->rate);
+	if (rate == 0)
+		return true;
+	if (now > r->time) {
+		int64_t full = (int64_t)rate * 100;
+		r->token += (int64_t)(now - r->time) * rate;
+		if (r->token > full)
+			r->token = full;
+	}
+	r->time = now;
+	return r->token > 0;
+}
+
+static inline bool
+limit_consume(struct rate_limit *r, uint64_t now, int64_t n) {
+	if (ATOM_LOAD(&r->rate) == 0)
+		return true;
+	limit_refill(r, now);
+	r->token -= n * 100;
+	return r->token > 0;
+}
+
+// bytes (or packets) allowed now, call it after limit_refill
+static inline int64_t
+limit_quota(struct rate_limit *r) {
+	if (ATOM_LOAD(&r->rate) == 0)
+		return INT64_MAX;
+	return r->token > 0 ? (r->token + 99) / 100 : 0;
+}
+
+// time (1/100 s) to wait for the tokens
+static inline uint64_t
+limit_wait(struct rate_limit *r) {
+	int rate = ATOM_LOAD(&r->rate);
+	if (rate == 0 || r->token > 0)
+		return 0;
+	return (uint64_t)(-r->token) / rate + 1;
+}
+
+static uint64_t
+throttle_wait(struct socket *s) {
+	uint64_t t = 0;
+	if (s->throttle & THROTTLE_READ) {
+		uint64_t r = limit_wait(&s->rlimit);
+		uint64_t p = limit_wait(&s->plimit);
+		t = r > p ? r : p;
+	}
+	if (s->throttle & THROTTLE_WRITE) {
+		uint64_t w = limit_wait(&s->wlimit);
+		if (t == 0 || w < t)
+			t = w;
+	}
+	return t;
+}
+
+static void
+throttle_wake(struct socket_server *ss, uint64_t time) {
+	for (;;) {
+		unsigned long wake = ATOM_LOAD(&ss->throttle_wake);
+		if (time >= wake || ATOM_CAS_ULONG(&ss->throttle_wake, wake, time))
+			return;
+	}
+}
+
+// Pause reading (or writing) when the tokens are used up, and resume it in throttle_refill later.
+static void
+throttle_socket(struct socket_server *ss, struct socket *s, int what) {
+	if (what == THROTTLE_READ) {
+		enable_read(ss, s, false);
+	} else {
+		enable_write(ss, s, false);
+	}
+	s->throttle |= what;
+	if (!s->throttle_list) {
+		s->throttle_list = true;
+		s->throttle_next = ss->throttle;
+		ss->throttle = s;
+	}
+	throttle_wake(ss, ss->time + throttle_wait(s));
+}
+
+static inline void
+limit_read(struct socket_server *ss, struct socket *s, int n) {
+	uint64_t now = ss->time;
+	bool r = limit_consume(&s->rlimit, now, n);
+	bool p = limit_consume(&s->plimit, now, 1);
+	if (!(r && p)) {
+		throttle_socket(ss, s, THROTTLE_READ);
+	}
+}
+
+// connect to unix domain socket, return -1 when connecting
+static int
+open_unix(struct socket_server *ss, struct request_open * request, struct socket_message *result) {
+	int id = request->id;
+	struct sockaddr_un sa;
+	socklen_t len = unix_address(unix_path(request->host), &sa);
+	if (len == 0) {
+		result->data = "invalid unix socket path";
+		goto _failed;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		result->data = strerror(errno);
+		goto _failed;
+	}
+	sp_nonblocking(sock);
+	int status = connect(sock, (struct sockaddr *)&sa, len);
+	if (status != 0 && errno != EINPROGRESS) {
+		// EAGAIN : the backlog of listen socket is full
+		result->data = strerror(errno);
+		close(sock);
+		goto _failed;
+	}
+	struct socket *ns = new_fd(ss, id, sock, PROTOCOL_TCP, request->opaque, true);
+	if (ns == NULL) {
+		close(sock);
+		result->data = "reach skynet socket number limit";
+		goto _failed;
+	}
+	if (status == 0) {
+		ATOM_STORE(&ns->type , SOCKET_TYPE_CONNECTED);
+		sp_stream(ss->event_fd, sock);
+		// request->host is released after this command, so copy it
+		snprintf(ss->buffer, sizeof(ss->buffer), "%s", request->host);
+		result->data = ss->buffer;
+		return SOCKET_OPEN;
+	}
+	if (enable_write(ss, ns, true)) {
+		close(sock);
+		result->data = "enable write failed";
+		goto _failed;
+	}
+	ATOM_STORE(&ns->type , SOCKET_TYPE_CONNECTING);
+	return -1;
+_failed:
+	ATOM_STORE(&get_socket(ss, id)->type, SOCKET_TYPE_INVALID);
+	return SOCKET_ERR;
+}
+
 // return -1 when connecting
 static int
 open_socket(struct socket_server *ss, struct request_open * request, struct socket_message *result) {
@@ -652,6 +1288,9 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 	result->id = id;
 	result->ud = 0;
 	result->data = NULL;
+	if (unix_path(request->host)) {
+		return open_unix(ss, request, result);
+	}
 	struct socket *ns;
 	int status;
 	struct addrinfo ai_hints;
@@ -699,6 +1338,7 @@ open_socket(struct socket_server *ss, struct request_open * request, struct sock
 
 	if(status == 0) {
 		ATOM_STORE(&ns->type , SOCKET_TYPE_CONNECTED);
+		sp_stream(ss->event_fd, sock);
 		struct sockaddr * addr = ai_ptr->ai_addr;
 		void * sin_addr = (ai_ptr->ai_family == AF_INET) ? (void*)&((struct sockaddr_in *)addr)->sin_addr : (void*)&((struct sockaddr_in6 *)addr)->sin6_addr;
 		if (inet_ntop(ai_ptr->ai_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
@@ -721,7 +1361,7 @@ _failed:
 		close(sock);
 	freeaddrinfo( ai_list );
 _failed_getaddrinfo:
-	ATOM_STORE(&ss->slot[HASH_ID(id)].type, SOCKET_TYPE_INVALID);
+	ATOM_STORE(&get_socket(ss, id)->type, SOCKET_TYPE_INVALID);
 	return SOCKET_ERR;
 }
 
@@ -757,74 +1397,515 @@ close_write(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 	}
 }
 
-static int
-send_list_tcp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
+// remove sz bytes sent from the head of list, the buffers sent by MSG_ZEROCOPY are moved to s->zc
+static void
+list_consume(struct socket_server *ss, struct socket *s, struct wb_list *list, size_t *sz) {
 	while (list->head) {
 		struct write_buffer * tmp = list->head;
-		for (;;) {
-			ssize_t sz = write(s->fd, tmp->ptr, tmp->sz);
-			if (sz < 0) {
-				switch(errno) {
-				case EINTR:
-					continue;
-				case AGAIN_WOULDBLOCK:
-					return -1;
-				}
-				return close_write(ss, s, l, result);
-			}
-			stat_write(ss,s,(int)sz);
-			s->wb_size -= sz;
-			if (sz != tmp->sz) {
-				tmp->ptr += sz;
-				tmp->sz -= sz;
-				return -1;
-			}
-			break;
+		if (*sz < tmp->sz) {
+			tmp->ptr += *sz;
+			tmp->sz -= *sz;
+			*sz = 0;
+			return;
 		}
+		*sz -= tmp->sz;
 		list->head = tmp->next;
-		write_buffer_free(ss,tmp);
+		if (tmp->zerocopy) {
+			// wait for the completion notification, see zerocopy_complete
+			tmp->next = NULL;
+			if (s->zc.head == NULL) {
+				s->zc.head = s->zc.tail = tmp;
+			} else {
+				s->zc.tail->next = tmp;
+				s->zc.tail = tmp;
+			}
+		} else {
+			write_buffer_free(ss,tmp);
+		}
 	}
 	list->tail = NULL;
-
-	return -1;
 }
 
-static socklen_t
-udp_socket_address(struct socket *s, const uint8_t udp_address[UDP_ADDRESS_SIZE], union sockaddr_all *sa) {
-	int type = (uint8_t)udp_address[0];
-	if (type != s->protocol)
-		return 0;
-	uint16_t port = 0;
-	memcpy(&port, udp_address+1, sizeof(uint16_t));
-	switch (s->protocol) {
-	case PROTOCOL_UDP:
-		memset(&sa->v4, 0, sizeof(sa->v4));
-		sa->s.sa_family = AF_INET;
-		sa->v4.sin_port = port;
-		memcpy(&sa->v4.sin_addr, udp_address + 1 + sizeof(uint16_t), sizeof(sa->v4.sin_addr));	// ipv4 address is 32 bits
-		return sizeof(sa->v4);
-	case PROTOCOL_UDPv6:
-		memset(&sa->v6, 0, sizeof(sa->v6));
-		sa->s.sa_family = AF_INET6;
-		sa->v6.sin6_port = port;
-		memcpy(&sa->v6.sin6_addr, udp_address + 1 + sizeof(uint16_t), sizeof(sa->v6.sin6_addr)); // ipv6 address is 128 bits
-		return sizeof(sa->v6);
+// gather memory buffers of list into iov, return false if it stops before the end of list (iov is full or meet a file).
+// A buffer not less than zc (the threshold of MSG_ZEROCOPY, 0 for off) is gathered alone, and it's returned by *zwb.
+static inline bool
+list_gather(struct wb_list *list, struct iovec *iov, int *n, size_t *sz, int zc, struct write_buffer **zwb) {
+	struct write_buffer * tmp;
+	for (tmp = list->head; tmp; tmp = tmp->next) {
+		if (*n >= MAX_IOV || tmp->file)
+			return false;
+		if (zc > 0 && tmp->sz >= (size_t)zc) {
+			if (*n > 0)
+				return false;
+			*zwb = tmp;
+		}
+		iov[*n].iov_base = tmp->ptr;
+		iov[*n].iov_len = tmp->sz;
+		*sz += tmp->sz;
+		++*n;
+		if (*zwb)
+			return false;
 	}
-	return 0;
+	return true;
 }
 
+// move the first n buffers of low list to the tail of high list
 static void
-drop_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct write_buffer *tmp) {
-	s->wb_size -= tmp->sz;
-	list->head = tmp->next;
-	if (list->head == NULL)
-		list->tail = NULL;
+raise_gathered(struct socket *s, int n) {
+	struct wb_list *low = &s->low;
+	struct wb_list *high = &s->high;
+	while (n-- > 0) {
+		struct write_buffer *tmp = low->head;
+		low->head = tmp->next;
+		tmp->next = NULL;
+		if (high->head == NULL) {
+			high->head = high->tail = tmp;
+		} else {
+			high->tail->next = tmp;
+			high->tail = tmp;
+		}
+	}
+	if (low->head == NULL) {
+		low->tail = NULL;
+	}
+}
+
+#ifdef ZEROCOPY_SEND
+
+// the MSG_ZEROCOPY buffers of a closed socket, and the fd to read their completions
+struct zerocopy_park {
+	struct zerocopy_park * next;
+	int fd;
+	uint64_t expire;
+	struct wb_list zc;
+};
+
+// release the buffers in zc which are completed (zc_seq <= hi)
+static void
+zerocopy_release(struct socket_server *ss, struct wb_list *zc, uint32_t hi) {
+	while (zc->head && (int32_t)(hi - zc->head->zc_seq) >= 0) {
+		struct write_buffer *tmp = zc->head;
+		zc->head = tmp->next;
+		write_buffer_free(ss, tmp);
+	}
+	if (zc->head == NULL)
+		zc->tail = NULL;
+}
+
+// read the completion notifications of MSG_ZEROCOPY from the error queue of fd, return the number of notifications
+static int
+zerocopy_recv(struct socket_server *ss, int fd, struct wb_list *zc) {
+	int count = 0;
+	for (;;) {
+		char control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+			if (errno == EINTR)
+				continue;
+			return count;
+		}
+		struct cmsghdr *cm;
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+				|| (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+				continue;
+			struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0)
+				continue;
+			// the calls [ee_info, ee_data] are completed
+			zerocopy_release(ss, zc, serr->ee_data);
+			++count;
+		}
+	}
+}
+
+static inline int
+zerocopy_complete(struct socket_server *ss, struct socket *s) {
+	return zerocopy_recv(ss, s->fd, &s->zc);
+}
+
+// Move s->zc and the fd to ss->zc_park when s is closed, returns false if there is no buffer waiting for completion.
+// The fd is shut down (FIN is sent after the data in kernel), and closed when all the buffers are completed in zerocopy_check.
+// the head of list may be sent partly by MSG_ZEROCOPY, move it to s->zc
+static void
+zerocopy_uncomplete(struct socket *s, struct wb_list *list) {
+	struct write_buffer *tmp = list->head;
+	if (tmp == NULL || !tmp->zerocopy)
+		return;
+	list->head = tmp->next;
+	if (list->head == NULL)
+		list->tail = NULL;
+	tmp->next = NULL;
+	if (s->zc.head == NULL) {
+		s->zc.head = s->zc.tail = tmp;
+	} else {
+		s->zc.tail->next = tmp;
+		s->zc.tail = tmp;
+	}
+}
+
+static bool
+zerocopy_park(struct socket_server *ss, struct socket *s) {
+	zerocopy_uncomplete(s, &s->high);
+	zerocopy_uncomplete(s, &s->low);
+	if (s->zc.head == NULL)
+		return false;
+	zerocopy_recv(ss, s->fd, &s->zc);
+	if (s->zc.head == NULL)
+		return false;
+	struct zerocopy_park *p = MALLOC(sizeof(*p));
+	p->fd = s->fd;
+	p->expire = ss->time + ZEROCOPY_PARK_TIMEOUT;
+	p->zc = s->zc;
+	s->zc.head = s->zc.tail = NULL;
+	shutdown(p->fd, SHUT_RDWR);
+	p->next = ss->zc_park;
+	ss->zc_park = p;
+	throttle_wake(ss, ss->time + ZEROCOPY_PARK_INTERVAL);
+	return true;
+}
+
+static void
+zerocopy_park_close(struct socket_server *ss, struct zerocopy_park *p) {
+	if (p->zc.head) {
+		// timeout or exit : reset the connection, so the kernel drops the pages in send queue before they are freed
+		struct linger lg = { 1, 0 };
+		setsockopt(p->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+	}
+	close(p->fd);
+	free_wb_list(ss, &p->zc);
+	FREE(p);
+}
+
+// called by 'Z', close the parked fds whose buffers are completed
+static void
+zerocopy_check(struct socket_server *ss) {
+	struct zerocopy_park **prev = &ss->zc_park;
+	struct zerocopy_park *p;
+	while ((p = *prev)) {
+		zerocopy_recv(ss, p->fd, &p->zc);
+		if (p->zc.head == NULL || ss->time >= p->expire) {
+			*prev = p->next;
+			zerocopy_park_close(ss, p);
+		} else {
+			prev = &p->next;
+		}
+	}
+	if (ss->zc_park) {
+		throttle_wake(ss, ss->time + ZEROCOPY_PARK_INTERVAL);
+	}
+}
+
+static void
+zerocopy_park_release(struct socket_server *ss) {
+	while (ss->zc_park) {
+		struct zerocopy_park *p = ss->zc_park;
+		ss->zc_park = p->next;
+		zerocopy_park_close(ss, p);
+	}
+}
+
+static int
+zerocopy_enable(struct socket *s) {
+	int one = 1;
+	return setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+}
+
+#else
+
+static inline int
+zerocopy_complete(struct socket_server *ss, struct socket *s) {
+	return 0;
+}
+
+static inline bool
+zerocopy_park(struct socket_server *ss, struct socket *s) {
+	return false;
+}
+
+static inline void
+zerocopy_check(struct socket_server *ss) {
+}
+
+static inline void
+zerocopy_park_release(struct socket_server *ss) {
+}
+
+static inline int
+zerocopy_enable(struct socket *s) {
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+#endif
+
+static ssize_t
+sendfile_(int sock, int fd, off_t *offset, size_t sz) {
+#if defined(__linux__)
+	return sendfile(sock, fd, offset, sz);
+#elif !defined(_WIN32)
+	// no zero copy, read the file by block
+	char tmp[16 * 1024];
+	if (sz > sizeof(tmp))
+		sz = sizeof(tmp);
+	ssize_t n = pread(fd, tmp, sz, *offset);
+	if (n <= 0)
+		return n;
+	n = write(sock, tmp, n);
+	if (n > 0)
+		*offset += n;
+	return n;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// send the file at the head of high list, return 0 when the file is sent
+static int
+send_list_file(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
+	struct write_buffer_file * f = (struct write_buffer_file *)s->high.head;
+	while (f->buffer.sz > 0) {
+		int64_t quota = limit_quota(&s->wlimit);
+		if (quota == 0)
+			return -1;
+		ssize_t sz = sendfile_(s->fd, f->fd, &f->offset, quota < f->buffer.sz ? quota : f->buffer.sz);
+		if (sz < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			return close_write(ss, s, l, result);
+		}
+		if (sz == 0) {
+			skynet_error(NULL, "socket-server : sendfile (%d) eof, %d bytes left.", s->id, (int)f->buffer.sz);
+			break;
+		}
+		stat_write(ss,s,(int)sz);
+		limit_consume(&s->wlimit, ss->time, sz);
+		f->buffer.sz -= sz;
+	}
+	s->high.head = f->buffer.next;
+	if (s->high.head == NULL)
+		s->high.tail = NULL;
+	write_buffer_free(ss, &f->buffer);
+	return 0;
+}
+
+// Gather the buffers of high list and then low list, and send them by one writev.
+// A file in high list (see socket_server_sendfile) is sent by sendfile.
+static int
+send_list_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
+	struct iovec iov[MAX_IOV];
+	for (;;) {
+		ssize_t sz;
+		size_t total = 0;
+		switch (sp_sendstate(ss->event_fd, s->fd, &sz, &total)) {
+		case SP_SEND_BUSY:
+			return -1;
+		case SP_SEND_DONE:
+			// the result of sp_send
+			goto _sent;
+		}
+		int64_t quota = limit_quota(&s->wlimit);
+		if (quota == 0)
+			return -1;
+		int n = 0;
+		int zc = ATOM_LOAD(&s->zerocopy);
+		struct write_buffer *zwb = NULL;
+		bool more = list_gather(&s->high, iov, &n, &total, zc, &zwb);
+		int nhigh = n;
+		if (more) {
+			list_gather(&s->low, iov, &n, &total, zc, &zwb);
+		}
+		if (total > (uint64_t)quota) {
+			// write rate limit, send a part of them
+			total = 0;
+			int i;
+			for (i=0;total + iov[i].iov_len < (uint64_t)quota;i++) {
+				total += iov[i].iov_len;
+			}
+			iov[i].iov_len = quota - total;
+			total = quota;
+			n = i + 1;
+		}
+		if (n == 0) {
+			if (s->high.head == NULL)
+				return -1;
+			int ret = send_list_file(ss, s, l, result);
+			if (ret != 0)
+				return ret;
+			continue;
+		}
+		if (zwb == NULL && sp_send(ss->event_fd, s->fd, iov, n) == 0) {
+			// The result is reported by a write event (io_uring), move the buffers of low list into high list,
+			// so the data added into high list before the result is sent after them.
+			if (n > nhigh)
+				raise_gathered(s, n - nhigh);
+			return -1;
+		}
+#ifdef ZEROCOPY_SEND
+		if (zwb) {
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = 1;
+			sz = sendmsg(s->fd, &msg, MSG_ZEROCOPY);
+			if (sz < 0 && errno == ENOBUFS) {
+				// exceed the optmem limit (net.core.optmem_max), send it by copy
+				sz = writev(s->fd, iov, n);
+			} else if (sz >= 0) {
+				zwb->zerocopy = true;
+				zwb->zc_seq = s->zc_seq++;
+			}
+		} else
+#endif
+		sz = writev(s->fd, iov, n);
+_sent:
+		if (sz < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			return close_write(ss, s, l, result);
+		}
+		stat_write(ss,s,(int)sz);
+		limit_consume(&s->wlimit, ss->time, sz);
+		s->wb_size -= sz;
+		size_t left = (size_t)sz;
+		list_consume(ss, s, &s->high, &left);
+		list_consume(ss, s, &s->low, &left);
+		if ((size_t)sz != total) {
+			// kernel buffer is full
+			return -1;
+		}
+	}
+}
+
+static socklen_t
+udp_socket_address(struct socket *s, const uint8_t udp_address[UDP_ADDRESS_SIZE], union sockaddr_all *sa) {
+	int type = (uint8_t)udp_address[0];
+	if (type != s->protocol)
+		return 0;
+	uint16_t port = 0;
+	memcpy(&port, udp_address+1, sizeof(uint16_t));
+	switch (s->protocol) {
+	case PROTOCOL_UDP:
+		memset(&sa->v4, 0, sizeof(sa->v4));
+		sa->s.sa_family = AF_INET;
+		sa->v4.sin_port = port;
+		memcpy(&sa->v4.sin_addr, udp_address + 1 + sizeof(uint16_t), sizeof(sa->v4.sin_addr));	// ipv4 address is 32 bits
+		return sizeof(sa->v4);
+	case PROTOCOL_UDPv6:
+		memset(&sa->v6, 0, sizeof(sa->v6));
+		sa->s.sa_family = AF_INET6;
+		sa->v6.sin6_port = port;
+		memcpy(&sa->v6.sin6_addr, udp_address + 1 + sizeof(uint16_t), sizeof(sa->v6.sin6_addr)); // ipv6 address is 128 bits
+		return sizeof(sa->v6);
+	case PROTOCOL_UNIX:
+		// unnamed address, the datagram is sent to the connected peer (See udp_sendto)
+		memset(&sa->un, 0, sizeof(sa->un));
+		sa->un.sun_family = AF_UNIX;
+		return offsetof(struct sockaddr_un, sun_path);
+	}
+	return 0;
+}
+
+static inline int
+udp_sendto(struct socket *s, const void * buffer, size_t sz, union sockaddr_all *sa, socklen_t sasz) {
+	if (s->protocol == PROTOCOL_UNIX)
+		return sendto(s->fd, buffer, sz, 0, NULL, 0);
+	return sendto(s->fd, buffer, sz, 0, &sa->s, sasz);
+}
+
+static void
+drop_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct write_buffer *tmp) {
+	s->wb_size -= tmp->sz;
+	list->head = tmp->next;
+	if (list->head == NULL)
+		list->tail = NULL;
 	write_buffer_free(ss,tmp);
 }
 
+#ifdef UDP_BATCH
+
+// send the udp list by sendmmsg, UDP_BATCH packages at most for each call
+static int
+send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	union sockaddr_all sa[UDP_BATCH];
+	while (list->head) {
+		if (limit_quota(&s->wlimit) == 0)
+			return -1;
+		struct write_buffer * tmp = list->head;
+		int n = 0;
+		while (tmp && n < UDP_BATCH) {
+			struct write_buffer_udp * udp = (struct write_buffer_udp *)tmp;
+			socklen_t sasz = udp_socket_address(s, udp->udp_address, &sa[n]);
+			if (sasz == 0) {
+				if (n > 0)
+					break;
+				skynet_error(NULL, "socket-server : udp (%d) error: type mismatch.", s->id);
+				drop_udp(ss, s, list, tmp);
+				return -1;
+			}
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			memset(&msg[n], 0, sizeof(msg[n]));
+			if (s->protocol != PROTOCOL_UNIX) {
+				msg[n].msg_hdr.msg_name = &sa[n];
+				msg[n].msg_hdr.msg_namelen = sasz;
+			}
+			msg[n].msg_hdr.msg_iov = &iov[n];
+			msg[n].msg_hdr.msg_iovlen = 1;
+			++n;
+			tmp = tmp->next;
+		}
+		int sent = sendmmsg(s->fd, msg, n, 0);
+		if (sent < 0) {
+			switch(errno) {
+			case EINTR:
+			case AGAIN_WOULDBLOCK:
+				return -1;
+			}
+			skynet_error(NULL, "socket-server : udp (%d) sendmmsg error %s.",s->id, strerror(errno));
+			drop_udp(ss, s, list, list->head);
+			return -1;
+		}
+		int i;
+		for (i=0;i<sent;i++) {
+			tmp = list->head;
+			stat_write(ss,s,tmp->sz);
+			limit_consume(&s->wlimit, ss->time, tmp->sz);
+			s->wb_size -= tmp->sz;
+			list->head = tmp->next;
+			write_buffer_free(ss,tmp);
+		}
+		if (sent < n) {
+			// list->head will be sent next time, or get the error
+			return -1;
+		}
+	}
+	list->tail = NULL;
+
+	return -1;
+}
+
+#else
+
 static int
 send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_message *result) {
 	while (list->head) {
+		if (limit_quota(&s->wlimit) == 0)
+			return -1;
 		struct write_buffer * tmp = list->head;
 		struct write_buffer_udp * udp = (struct write_buffer_udp *)tmp;
 		union sockaddr_all sa;
@@ -834,7 +1915,7 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 			drop_udp(ss, s, list, tmp);
 			return -1;
 		}
-		int err = sendto(s->fd, tmp->ptr, tmp->sz, 0, &sa.s, sasz);
+		int err = udp_sendto(s, tmp->ptr, tmp->sz, &sa, sasz);
 		if (err < 0) {
 			switch(errno) {
 			case EINTR:
@@ -846,6 +1927,7 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 			return -1;
 		}
 		stat_write(ss,s,tmp->sz);
+		limit_consume(&s->wlimit, ss->time, tmp->sz);
 		s->wb_size -= tmp->sz;
 		list->head = tmp->next;
 		write_buffer_free(ss,tmp);
@@ -855,12 +1937,18 @@ send_list_udp(struct socket_server *ss, struct socket *s, struct wb_list *list,
 	return -1;
 }
 
+#endif
+
 static int
-send_list(struct socket_server *ss, struct socket *s, struct wb_list *list, struct socket_lock *l, struct socket_message *result) {
+send_list(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	if (s->protocol == PROTOCOL_TCP) {
-		return send_list_tcp(ss, s, list, l, result);
+		return send_list_tcp(ss, s, l, result);
 	} else {
-		return send_list_udp(ss, s, list, result);
+		send_list_udp(ss, s, &s->high, result);
+		if (s->high.head == NULL) {
+			send_list_udp(ss, s, &s->low, result);
+		}
+		return -1;
 	}
 }
 
@@ -899,15 +1987,20 @@ send_buffer_empty(struct socket *s) {
 	Each socket has two write buffer list, high priority and low priority.
 
 	1. send high list as far as possible.
-	2. If high list is empty, try to send low list.
+	2. If high list is empty, try to send low list. (tcp gathers both lists into one writev)
 	3. If low list head is uncomplete (send a part before), move the head of low list to empty high list (call raise_uncomplete) .
 	4. If two lists are both empty, turn off the event. (call check_close)
  */
 static int
 send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	assert(!list_uncomplete(&s->low));
-	// step 1
-	int ret = send_list(ss,s,&s->high,l,result);
+	if (!limit_refill(&s->wlimit, ss->time)) {
+		// write rate limit, wait for the tokens
+		throttle_socket(ss, s, THROTTLE_WRITE);
+		return -1;
+	}
+	// step 1 and 2
+	int ret = send_list(ss,s,l,result);
 	if (ret != -1) {
 		if (ret == SOCKET_ERR) {
 			// HALFCLOSE_WRITE
@@ -916,30 +2009,21 @@ send_buffer_(struct socket_server *ss, struct socket *s, struct socket_lock *l,
 		// SOCKET_RST (ignore)
 		return -1;
 	}
+	if (!send_buffer_empty(s) && !limit_refill(&s->wlimit, ss->time)) {
+		throttle_socket(ss, s, THROTTLE_WRITE);
+	}
 	if (s->high.head == NULL) {
-		// step 2
 		if (s->low.head != NULL) {
-			int ret = send_list(ss,s,&s->low,l,result);
-			if (ret != -1) {
-				if (ret == SOCKET_ERR) {
-					// HALFCLOSE_WRITE
-					return SOCKET_ERR;
-				}
-				// SOCKET_RST (ignore)
-				return -1;
-			}
 			// step 3
 			if (list_uncomplete(&s->low)) {
 				raise_uncomplete(s);
-				return -1;
 			}
-			if (s->low.head)
-				return -1;
+			return -1;
 		}
 		// step 4
 		assert(send_buffer_empty(s) && s->wb_size == 0);
 
-		if (s->closing) {
+		if (s->closing && s->zc.head == NULL) {
 			// finish writing
 			force_close(ss, s, l, result);
 			return -1;
@@ -973,6 +2057,9 @@ send_buffer(struct socket_server *ss, struct socket *s, struct socket_lock *l, s
 		struct write_buffer * buf = MALLOC(sizeof(*buf));
 		struct send_object so;
 		buf->userobject = send_object_init(ss, &so, (void *)s->dw_buffer, s->dw_size);
+		buf->file = false;
+		buf->zerocopy = false;
+		buf->multicast = NULL;
 		buf->ptr = (char*)so.buffer+s->dw_offset;
 		buf->sz = so.sz - s->dw_offset;
 		buf->buffer = (void *)s->dw_buffer;
@@ -997,6 +2084,9 @@ append_sendbuffer_(struct socket_server *ss, struct wb_list *s, struct request_s
 	struct write_buffer * buf = MALLOC(size);
 	struct send_object so;
 	buf->userobject = send_object_init(ss, &so, request->buffer, request->sz);
+	buf->file = false;
+	buf->zerocopy = false;
+	buf->multicast = NULL;
 	buf->ptr = (char*)so.buffer;
 	buf->sz = so.sz;
 	buf->buffer = request->buffer;
@@ -1035,7 +2125,7 @@ append_sendbuffer_low(struct socket_server *ss,struct socket *s, struct request_
 static int
 trigger_write(struct socket_server *ss, struct request_send * request, struct socket_message *result) {
 	int id = request->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id))
 		return -1;
 	if (enable_write(ss, s, true)) {
@@ -1044,6 +2134,83 @@ trigger_write(struct socket_server *ss, struct request_send * request, struct so
 	return -1;
 }
 
+// move the encoded data of tls to the high list, returns false if enable write failed
+static bool
+tls_output(struct socket_server *ss, struct socket *s) {
+	struct socket_tls *t = s->tls;
+	int sz;
+	while ((sz = t->i->pending(t->tls)) > 0) {
+		char * data = MALLOC(sz);
+		sz = t->i->output(t->tls, data, sz);
+		if (sz <= 0) {
+			FREE(data);
+			break;
+		}
+		struct write_buffer * buf = MALLOC(sizeof(*buf));
+		buf->next = NULL;
+		buf->buffer = data;
+		buf->ptr = data;
+		buf->sz = sz;
+		buf->userobject = false;
+		buf->file = false;
+		buf->zerocopy = false;
+		buf->multicast = NULL;
+		struct wb_list *list = &s->high;
+		if (list->head == NULL) {
+			list->head = list->tail = buf;
+		} else {
+			list->tail->next = buf;
+			list->tail = buf;
+		}
+		s->wb_size += sz;
+	}
+	if (!send_buffer_empty(s) && enable_write(ss, s, true)) {
+		return false;
+	}
+	return true;
+}
+
+// encode the data kept before the handshake finished, returns false if error
+static bool
+tls_flush(struct socket_server *ss, struct socket *s) {
+	struct socket_tls *t = s->tls;
+	if (t->plain_sz > 0) {
+		int n = t->i->write(t->tls, t->plain, t->plain_sz);
+		if (n < 0)
+			return false;
+		t->plain_sz -= n;
+		memmove(t->plain, t->plain + n, t->plain_sz);
+	}
+	return tls_output(ss, s);
+}
+
+// encode the data and append it to the high list, returns false if error
+static bool
+tls_write(struct socket_server *ss, struct socket *s, const void *data, int sz) {
+	struct socket_tls *t = s->tls;
+	if (t->plain_sz == 0) {
+		int n = t->i->write(t->tls, data, sz);
+		if (n < 0)
+			return false;
+		data = (const char *)data + n;
+		sz -= n;
+	}
+	if (sz > 0) {
+		// the handshake is not finished
+		if (t->plain_sz + sz > t->plain_cap) {
+			int cap = t->plain_cap == 0 ? 4096 : t->plain_cap;
+			while (cap < t->plain_sz + sz) {
+				cap *= 2;
+			}
+			t->plain = skynet_realloc(t->plain, cap);
+			t->plain_cap = cap;
+		}
+		memcpy(t->plain + t->plain_sz, data, sz);
+		t->plain_sz += sz;
+	}
+	return tls_output(ss, s);
+}
+
 /*
 	When send a package , we can assign the priority : PRIORITY_HIGH or PRIORITY_LOW
 
@@ -1054,7 +2221,7 @@ trigger_write(struct socket_server *ss, struct request_send * request, struct so
 static int
 send_socket(struct socket_server *ss, struct request_send * request, struct socket_message *result, int priority, const uint8_t *udp_address) {
 	int id = request->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	struct send_object so;
 	send_object_init(ss, &so, request->buffer, request->sz);
 	uint8_t type = ATOM_LOAD(&s->type);
@@ -1070,7 +2237,13 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 		so.free_func((void *)request->buffer);
 		return -1;
 	}
-	if (send_buffer_empty(s)) {
+	if (s->tls) {
+		bool ok = tls_write(ss, s, so.buffer, (int)so.sz);
+		so.free_func((void *)request->buffer);
+		if (!ok) {
+			return report_error(s, result, "tls error");
+		}
+	} else if (send_buffer_empty(s)) {
 		if (s->protocol == PROTOCOL_TCP) {
 			append_sendbuffer(ss, s, request);	// add to high priority list, even priority == PRIORITY_LOW
 		} else {
@@ -1086,7 +2259,7 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 				so.free_func((void *)request->buffer);
 				return -1;
 			}
-			int n = sendto(s->fd, so.buffer, so.sz, 0, &sa.s, sasz);
+			int n = udp_sendto(s, so.buffer, so.sz, &sa, sasz);
 			if (n != so.sz) {
 				append_sendbuffer_udp(ss,s,priority,request,udp_address);
 			} else {
@@ -1112,6 +2285,15 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 			append_sendbuffer_udp(ss,s,priority,request,udp_address);
 		}
 	}
+	int coalesce = ATOM_LOAD(&s->coalesce);
+	if (coalesce > 0 && s->wb_size >= coalesce) {
+		// too many bytes in coalesce mode, don't wait the write event
+		struct socket_lock l;
+		socket_lock_init(s, &l);
+		int type = send_buffer(ss, s, &l, result);
+		if (type != -1)
+			return type;
+	}
 	if (s->wb_size >= WARNING_SIZE && s->wb_size >= s->warn_size) {
 		s->warn_size = s->warn_size == 0 ? WARNING_SIZE *2 : s->warn_size*2;
 		result->opaque = s->opaque;
@@ -1123,23 +2305,76 @@ send_socket(struct socket_server *ss, struct request_send * request, struct sock
 	return -1;
 }
 
+// Append the file to high list, and send it in socket thread (see send_list_file)
 static int
-listen_socket(struct socket_server *ss, struct request_listen * request, struct socket_message *result) {
+sendfile_socket(struct socket_server *ss, struct request_sendfile * request, struct socket_message *result) {
 	int id = request->id;
-	int listen_fd = request->fd;
-	struct socket *s = new_fd(ss, id, listen_fd, PROTOCOL_TCP, request->opaque, false);
-	if (s == NULL) {
-		goto _failed;
+	struct socket * s = get_socket(ss, id);
+	uint8_t type = ATOM_LOAD(&s->type);
+	if (type == SOCKET_TYPE_INVALID || s->id != id
+		|| type == SOCKET_TYPE_HALFCLOSE_WRITE
+		|| type == SOCKET_TYPE_PACCEPT
+		|| type == SOCKET_TYPE_PLISTEN
+		|| type == SOCKET_TYPE_LISTEN
+		|| s->protocol != PROTOCOL_TCP
+		|| s->closing) {
+		close(request->fd);
+		return -1;
 	}
-	ATOM_STORE(&s->type , SOCKET_TYPE_PLISTEN);
-	result->opaque = request->opaque;
-	result->id = id;
-	result->ud = 0;
-	result->data = "listen";
-
-	union sockaddr_all u;
+	if (s->tls) {
+		skynet_error(NULL, "socket-server : sendfile to tls socket %d is not supported.", id);
+		close(request->fd);
+		return -1;
+	}
+	struct write_buffer_file * f = MALLOC(sizeof(*f));
+	f->buffer.next = NULL;
+	f->buffer.buffer = NULL;
+	f->buffer.ptr = NULL;
+	f->buffer.sz = (size_t)request->sz;
+	f->buffer.userobject = false;
+	f->buffer.file = true;
+	f->buffer.zerocopy = false;
+	f->buffer.multicast = NULL;
+	f->fd = request->fd;
+	f->offset = (off_t)request->offset;
+	bool empty = send_buffer_empty(s);
+	struct wb_list *list = &s->high;
+	if (list->head == NULL) {
+		list->head = list->tail = &f->buffer;
+	} else {
+		list->tail->next = &f->buffer;
+		list->tail = &f->buffer;
+	}
+	if (empty && enable_write(ss, s, true)) {
+		return report_error(s, result, "enable write failed");
+	}
+	return -1;
+}
+
+static int
+listen_socket(struct socket_server *ss, struct request_listen * request, struct socket_message *result) {
+	int id = request->id;
+	int listen_fd = request->fd;
+	struct socket *s = new_fd(ss, id, listen_fd, PROTOCOL_TCP, request->opaque, false);
+	if (s == NULL) {
+		goto _failed;
+	}
+	ATOM_STORE(&s->type , SOCKET_TYPE_PLISTEN);
+	sp_listen(ss->event_fd, listen_fd);
+	result->opaque = request->opaque;
+	result->id = id;
+	result->ud = 0;
+	result->data = "listen";
+
+	union sockaddr_all u;
 	socklen_t slen = sizeof(u);
 	if (getsockname(listen_fd, &u.s, &slen) == 0) {
+		if (u.s.sa_family == AF_UNIX) {
+			// port is 0
+			getname(&u, slen, ss->buffer, sizeof(ss->buffer));
+			result->data = ss->buffer;
+			return SOCKET_OPEN;
+		}
 		void * sin_addr = (u.s.sa_family == AF_INET) ? (void*)&u.v4.sin_addr : (void *)&u.v6.sin6_addr;
 		if (inet_ntop(u.s.sa_family, sin_addr, ss->buffer, sizeof(ss->buffer)) == 0) {
 			result->data = strerror(errno);
@@ -1160,7 +2395,7 @@ _failed:
 	result->id = id;
 	result->ud = 0;
 	result->data = "reach skynet socket number limit";
-	ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+	get_socket(ss, id)->type = SOCKET_TYPE_INVALID;
 
 	return SOCKET_ERR;
 }
@@ -1196,7 +2431,7 @@ halfclose_read(struct socket *s) {
 static int
 close_socket(struct socket_server *ss, struct request_close *request, struct socket_message *result) {
 	int id = request->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		// The socket is closed, ignore
 		return -1;
@@ -1206,7 +2441,13 @@ close_socket(struct socket_server *ss, struct request_close *request, struct soc
 
 	int shutdown_read = halfclose_read(s);
 
-	if (request->shutdown || nomore_sending_data(s)) {
+	if (s->tls && !request->shutdown && !s->closing && ATOM_LOAD(&s->type) != SOCKET_TYPE_HALFCLOSE_WRITE) {
+		// send close_notify before closing
+		s->tls->i->shutdown(s->tls->tls);
+		tls_output(ss, s);
+	}
+
+	if (request->shutdown || (nomore_sending_data(s) && s->zc.head == NULL)) {
 		// If socket is SOCKET_TYPE_HALFCLOSE_READ, Do not raise SOCKET_CLOSE again.
 		int r = shutdown_read ? -1 : SOCKET_CLOSE;
 		force_close(ss,s,&l,result);
@@ -1246,7 +2487,7 @@ resume_socket(struct socket_server *ss, struct request_resumepause *request, str
 	result->opaque = request->opaque;
 	result->ud = 0;
 	result->data = NULL;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		result->data = "invalid socket";
 		return SOCKET_ERR;
@@ -1258,7 +2499,10 @@ resume_socket(struct socket_server *ss, struct request_resumepause *request, str
 	}
 	struct socket_lock l;
 	socket_lock_init(s, &l);
-	if (enable_read(ss, s, true)) {
+	if (s->throttle & THROTTLE_READ) {
+		// reading is resumed by throttle_refill later
+		s->pause = false;
+	} else if (enable_read(ss, s, true)) {
 		result->data = "enable read failed";
 		return SOCKET_ERR;
 	}
@@ -1281,52 +2525,275 @@ resume_socket(struct socket_server *ss, struct request_resumepause *request, str
 static int
 pause_socket(struct socket_server *ss, struct request_resumepause *request, struct socket_message *result) {
 	int id = request->id;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		return -1;
 	}
+	if (s->throttle & THROTTLE_READ) {
+		// don't resume reading when the throttle is over
+		s->pause = true;
+		return -1;
+	}
 	if (enable_read(ss, s, false)) {
 		return report_error(s, result, "enable read failed");
 	}
 	return -1;
 }
 
+// resume reading or writing of the throttled socket if the tokens are enough
+static void
+throttle_update(struct socket_server *ss, struct socket *s) {
+	uint64_t now = ss->time;
+	if (s->throttle & THROTTLE_READ) {
+		bool r = limit_refill(&s->rlimit, now);
+		bool p = limit_refill(&s->plimit, now);
+		if (r && p) {
+			s->throttle &= ~THROTTLE_READ;
+			if (!s->pause && !halfclose_read(s)) {
+				enable_read(ss, s, true);
+			}
+			s->pause = false;
+		}
+	}
+	if (s->throttle & THROTTLE_WRITE) {
+		if (limit_refill(&s->wlimit, now)) {
+			s->throttle &= ~THROTTLE_WRITE;
+			if (!send_buffer_empty(s)) {
+				enable_write(ss, s, true);
+			}
+		}
+	}
+}
+
+static void
+throttle_refill(struct socket_server *ss) {
+	uint64_t wake = THROTTLE_NONE;
+	struct socket **prev = &ss->throttle;
+	struct socket *s;
+	while ((s = *prev)) {
+		// s->throttle is cleared when the socket is closed
+		if (s->throttle) {
+			throttle_update(ss, s);
+		}
+		if (s->throttle == 0) {
+			*prev = s->throttle_next;
+			s->throttle_next = NULL;
+			s->throttle_list = false;
+		} else {
+			uint64_t t = ss->time + throttle_wait(s);
+			if (t < wake)
+				wake = t;
+			prev = &s->throttle_next;
+		}
+	}
+	if (wake != THROTTLE_NONE) {
+		throttle_wake(ss, wake);
+	}
+}
+
+static void
+ratelimit_socket(struct socket_server *ss, struct request_ratelimit *request) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (socket_invalid(s, id)) {
+		return;
+	}
+	uint64_t now = ss->time;
+	limit_set(&s->rlimit, request->read, now);
+	limit_set(&s->plimit, request->packet, now);
+	limit_set(&s->wlimit, request->write, now);
+	if (s->throttle) {
+		// the bucket is full now, resume it
+		throttle_update(ss, s);
+	}
+}
+
+static void
+frame_socket(struct socket_server *ss, struct request_frame *request) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (socket_invalid(s, id) || s->protocol != PROTOCOL_TCP) {
+		return;
+	}
+	struct socket_frame *f = s->frame;
+	if (request->header == 0) {
+		if (f) {
+			if (f->pack || f->head_n || f->roff < f->rn) {
+				skynet_error(NULL, "socket-server : discard uncomplete frame of socket %d", id);
+			}
+			free_frame(f);
+			s->frame = NULL;
+		}
+		return;
+	}
+	if (f == NULL) {
+		f = MALLOC(sizeof(*f));
+		memset(f, 0, sizeof(*f));
+		s->frame = f;
+	}
+	f->header = (uint8_t)request->header;
+	f->max = request->max;
+	f->batch = request->batch;
+}
+
+static int
+tls_socket(struct socket_server *ss, struct request_tls *request, struct socket_message *result) {
+	int id = request->id;
+	struct socket *s = get_socket(ss, id);
+	if (socket_invalid(s, id) || s->protocol != PROTOCOL_TCP || s->tls) {
+		if (s->id == id && s->tls) {
+			skynet_error(NULL, "socket-server : tls of socket %d is attached already.", id);
+		}
+		request->i->release(request->tls);
+		return -1;
+	}
+	struct socket_tls *t = MALLOC(sizeof(*t));
+	t->tls = request->tls;
+	t->i = request->i;
+	t->plain = NULL;
+	t->plain_sz = 0;
+	t->plain_cap = 0;
+	s->tls = t;
+	ATOM_STORE(&s->tls_on, 1);
+	// the client hello
+	if (!tls_output(ss, s)) {
+		return report_error(s, result, "enable write failed");
+	}
+	return -1;
+}
+
 static void
 setopt_socket(struct socket_server *ss, struct request_setopt *request) {
 	int id = request->id;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		return;
 	}
 	int v = request->value;
+	if (request->what == SOCKOPT_COALESCE) {
+		if (s->protocol != PROTOCOL_TCP)
+			return;
+		ATOM_STORE(&s->coalesce, v < 0 ? 0 : v);
+		return;
+	}
+	if (request->what == SOCKOPT_UDPBATCH) {
+		if (s->protocol == PROTOCOL_TCP)
+			return;
+		s->udpbatch = v != 0;
+		return;
+	}
+	if (request->what == SOCKOPT_ZEROCOPY) {
+		if (s->protocol != PROTOCOL_TCP)
+			return;
+		if (v > 0) {
+			if (zerocopy_enable(s) != 0) {
+				skynet_error(NULL, "socket-server : set zerocopy (%d) failed: %s", id, strerror(errno));
+				return;
+			}
+			sp_errqueue(ss->event_fd, s->fd);
+		}
+		ATOM_STORE(&s->zerocopy, v < 0 ? 0 : v);
+		return;
+	}
 	setsockopt(s->fd, IPPROTO_TCP, request->what, &v, sizeof(v));
 }
 
+static inline struct ctrl_slot *
+ctrl_head(struct socket_server *ss) {
+	struct ctrl_queue *q = &ss->ctrl;
+	struct ctrl_slot *slot = &q->slot[q->head & (CTRL_QUEUE_SIZE-1)];
+	if (ATOM_LOAD(&slot->seq) != q->head + 1) {
+		// empty, or the producer doesn't finish writing the slot yet (it will notify later).
+		return NULL;
+	}
+	return slot;
+}
+
+static inline void
+ctrl_pop(struct socket_server *ss, struct ctrl_slot *slot) {
+	struct ctrl_queue *q = &ss->ctrl;
+	ATOM_STORE(&slot->seq, q->head + CTRL_QUEUE_SIZE);
+	++q->head;
+	if (ATOM_LOAD(&q->full_wait) > 0
+		&& ((q->head & (CTRL_WAKE_BATCH-1)) == 0 || ctrl_head(ss) == NULL)) {
+		// see ctrl_wait_full
+		pthread_mutex_lock(&q->full_lock);
+		pthread_cond_broadcast(&q->full_cond);
+		pthread_mutex_unlock(&q->full_lock);
+	}
+}
+
+static int
+has_cmd(struct socket_server *ss) {
+	return ctrl_head(ss) != NULL;
+}
+
+// drain the notify fd, one read per wakeup rather than one per command.
 static void
-block_readpipe(int pipefd, void *buffer, int sz) {
+ctrl_clear_notify(struct socket_server *ss) {
+	uint64_t buffer[8];
 	for (;;) {
-		int n = read(pipefd, buffer, sz);
-		if (n<0) {
+		int n = read(ss->recvctrl_fd, buffer, sizeof(buffer));
+		if (n < 0) {
 			if (errno == EINTR)
 				continue;
-			skynet_error(NULL, "socket-server : read pipe error %s.",strerror(errno));
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				skynet_error(NULL, "socket-server : read ctrl notify error %s.",strerror(errno));
 			return;
 		}
-		// must atomic read from a pipe
-		assert(n == sz);
-		return;
+		if (n < (int)sizeof(buffer))
+			return;
 	}
 }
 
-static int
-has_cmd(struct socket_server *ss) {
-	struct timeval tv = {0,0};
-	int retval;
+static inline uint64_t
+spin_clock() {
+	struct timespec ti;
+	clock_gettime(CLOCK_MONOTONIC, &ti);
+	return (uint64_t)ti.tv_sec * 1000000 + ti.tv_nsec / 1000;
+}
 
-	FD_SET(ss->recvctrl_fd, &ss->rfds);
+// Poll with zero timeout for ss->spin microseconds before blocking in sp_wait, return 1 if there are events or commands.
+// The ctrl notify fd is not written when the socket thread is not going to sleep, so check the ctrl queue too.
+static int
+spin_wait(struct socket_server *ss) {
+	uint64_t start = spin_clock();
+	uint64_t now = start;
+	int hit = 0;
+	ATOM_FINC(&ss->spin_n);
+	for (;;) {
+		if (has_cmd(ss)) {
+			hit = 1;
+			break;
+		}
+		int n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT, 0);
+		if (n > 0) {
+			ss->event_n = n;
+			ss->event_index = 0;
+			hit = 1;
+			break;
+		}
+		now = spin_clock();
+		if (now - start >= (uint64_t)ss->spin) {
+			break;
+		}
+	}
+	if (hit) {
+		ATOM_FINC(&ss->spin_hit);
+		now = spin_clock();
+	}
+	ATOM_FADD(&ss->spin_us, now - start);
+	return hit;
+}
 
-	retval = select(ss->recvctrl_fd+1, &ss->rfds, NULL, NULL, &tv);
-	if (retval == 1) {
+// Called before sp_wait, return 1 if there are commands in the queue and socket thread should not sleep.
+static int
+ctrl_prepare_sleep(struct socket_server *ss) {
+	ATOM_STORE(&ss->ctrl_sleep, 1);
+	if (has_cmd(ss)) {
+		// If CAS failed, a producer has cleared ctrl_sleep and the notify fd will be readable soon,
+		// it's harmless (we will clear it in next poll).
+		ATOM_CAS(&ss->ctrl_sleep, 1, 0);
 		return 1;
 	}
 	return 0;
@@ -1338,23 +2805,29 @@ add_udp_socket(struct socket_server *ss, struct request_udp *udp) {
 	int protocol;
 	if (udp->family == AF_INET6) {
 		protocol = PROTOCOL_UDPv6;
+	} else if (udp->family == AF_UNIX) {
+		protocol = PROTOCOL_UNIX;
 	} else {
 		protocol = PROTOCOL_UDP;
 	}
 	struct socket *ns = new_fd(ss, id, udp->fd, protocol, udp->opaque, true);
 	if (ns == NULL) {
 		close(udp->fd);
-		ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+		get_socket(ss, id)->type = SOCKET_TYPE_INVALID;
 		return;
 	}
 	ATOM_STORE(&ns->type , SOCKET_TYPE_CONNECTED);
 	memset(ns->p.udp_address, 0, sizeof(ns->p.udp_address));
+	if (protocol == PROTOCOL_UNIX) {
+		// send to the connected peer by default
+		ns->p.udp_address[0] = PROTOCOL_UNIX;
+	}
 }
 
 static int
 set_udp_address(struct socket_server *ss, struct request_setudp *request, struct socket_message *result) {
 	int id = request->id;
-	struct socket *s = &ss->slot[HASH_ID(id)];
+	struct socket *s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		return -1;
 	}
@@ -1363,7 +2836,9 @@ set_udp_address(struct socket_server *ss, struct request_setudp *request, struct
 		// protocol mismatch
 		return report_error(s, result, "protocol mismatch");
 	}
-	if (type == PROTOCOL_UDP) {
+	if (type == PROTOCOL_UNIX) {
+		s->p.udp_address[0] = PROTOCOL_UNIX;
+	} else if (type == PROTOCOL_UDP) {
 		memcpy(s->p.udp_address, request->address, 1+2+4);	// 1 type, 2 port, 4 ipv4
 	} else {
 		memcpy(s->p.udp_address, request->address, 1+2+16);	// 1 type, 2 port, 16 ipv6
@@ -1380,7 +2855,7 @@ dial_udp_socket(struct socket_server *ss, struct request_dial_udp *request, stru
 	struct socket *ns = new_fd(ss, id, request->fd, protocol, request->opaque, true);
 	if (ns == NULL){
 		close(request->fd);
-		ss->slot[HASH_ID(id)].type = SOCKET_TYPE_INVALID;
+		get_socket(ss, id)->type = SOCKET_TYPE_INVALID;
 		return -1;
 	}
 
@@ -1397,12 +2872,12 @@ dial_udp_socket(struct socket_server *ss, struct request_dial_udp *request, stru
 }
 
 static inline void
-inc_sending_ref(struct socket *s, int id) {
+inc_sending_ref(struct socket_server *ss, struct socket *s, int id) {
 	if (s->protocol != PROTOCOL_TCP)
 		return;
 	for (;;) {
 		unsigned long sending = ATOM_LOAD(&s->sending);
-		if ((sending >> 16) == ID_TAG16(id)) {
+		if ((sending >> 16) == ID_TAG16(ss, id)) {
 			if ((sending & 0xffff) == 0xffff) {
 				// s->sending may overflow (rarely), so busy waiting here for socket thread dec it. see issue #794
 				continue;
@@ -1420,7 +2895,7 @@ inc_sending_ref(struct socket *s, int id) {
 
 static inline void
 dec_sending_ref(struct socket_server *ss, int id) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	// Notice: udp may inc sending while type == SOCKET_TYPE_RESERVE
 	if (s->id == id && s->protocol == PROTOCOL_TCP) {
 		assert((ATOM_LOAD(&s->sending) & 0xffff) != 0);
@@ -1428,18 +2903,63 @@ dec_sending_ref(struct socket_server *ss, int id) {
 	}
 }
 
+// Append the shared buffer to the high list of each socket (tcp only), the sockets which are closing or invalid are skipped.
+// The warning of send buffer size is not reported for multicast.
+static void
+multicast_socket(struct socket_server *ss, struct request_multicast * request) {
+	struct socket_multicast * m = request->m;
+	int i;
+	for (i=0;i<m->n;i++) {
+		int id = m->id[i];
+		if (id < 0)
+			continue;
+		struct socket * s = get_socket(ss, id);
+		uint8_t type = ATOM_LOAD(&s->type);
+		if (s->id == id && s->protocol == PROTOCOL_TCP && !s->closing
+			&& type != SOCKET_TYPE_INVALID
+			&& type != SOCKET_TYPE_HALFCLOSE_WRITE
+			&& type != SOCKET_TYPE_PACCEPT
+			&& type != SOCKET_TYPE_PLISTEN
+			&& type != SOCKET_TYPE_LISTEN) {
+			if (s->tls) {
+				// encoded for each socket
+				if (!tls_write(ss, s, m->buffer, (int)m->sz)) {
+					skynet_error(NULL, "socket-server : tls error of socket (%d).", id);
+				}
+				dec_sending_ref(ss, id);
+				continue;
+			}
+			struct write_buffer * buf = MALLOC(sizeof(*buf));
+			buf->next = NULL;
+			buf->buffer = m->buffer;
+			buf->ptr = (char *)m->buffer;
+			buf->sz = m->sz;
+			buf->userobject = false;
+			buf->file = false;
+			buf->zerocopy = false;
+			buf->multicast = m;
+			++m->ref;
+			bool empty = send_buffer_empty(s);
+			struct wb_list *list = &s->high;
+			if (list->head == NULL) {
+				list->head = list->tail = buf;
+			} else {
+				list->tail->next = buf;
+				list->tail = buf;
+			}
+			s->wb_size += buf->sz;
+			if (empty && enable_write(ss, s, true)) {
+				skynet_error(NULL, "socket-server : enable write of socket (%d) failed.", id);
+			}
+		}
+		dec_sending_ref(ss, id);
+	}
+	multicast_release(m);
+}
+
 // return type
 static int
-ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
-	int fd = ss->recvctrl_fd;
-	// the length of message is one byte, so 256 buffer size is enough.
-	uint8_t buffer[256];
-	uint8_t header[2];
-	block_readpipe(fd, header, sizeof(header));
-	int type = header[0];
-	int len = header[1];
-	block_readpipe(fd, buffer, len);
-	// ctrl command only exist in local fd, so don't worry about endian.
+ctrl_cmd_(struct socket_server *ss, int type, uint8_t *buffer, struct socket_message *result) {
 	switch (type) {
 	case 'R':
 		return resume_socket(ss,(struct request_resumepause *)buffer, result);
@@ -1469,6 +2989,12 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 		dec_sending_ref(ss, request->id);
 		return ret;
 	}
+	case 'F': {
+		struct request_sendfile * request = (struct request_sendfile *) buffer;
+		int ret = sendfile_socket(ss, request, result);
+		dec_sending_ref(ss, request->id);
+		return ret;
+	}
 	case 'A': {
 		struct request_send_udp * rsu = (struct request_send_udp *)buffer;
 		return send_socket(ss, &rsu->send, result, PRIORITY_HIGH, rsu->address);
@@ -1483,6 +3009,21 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	case 'U':
 		add_udp_socket(ss, (struct request_udp *)buffer);
 		return -1;
+	case 'Y':
+		ratelimit_socket(ss, (struct request_ratelimit *)buffer);
+		return -1;
+	case 'Z':
+		throttle_refill(ss);
+		zerocopy_check(ss);
+		return -1;
+	case 'H':
+		frame_socket(ss, (struct request_frame *)buffer);
+		return -1;
+	case 'M':
+		multicast_socket(ss, (struct request_multicast *)buffer);
+		return -1;
+	case 'E':
+		return tls_socket(ss, (struct request_tls *)buffer, result);
 	default:
 		skynet_error(NULL, "socket-server error: Unknown ctrl %c.",type);
 		return -1;
@@ -1491,89 +3032,596 @@ ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
 	return -1;
 }
 
-// return -1 (ignore) when error
+// Commands are drained from the queue one by one by socket_server_poll without any syscall,
+// the slot is released after the command is handled, so the request is never copied in socket thread.
 static int
-forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
-	int sz = s->p.size;
-	char * buffer = MALLOC(sz);
-	int n = (int)read(s->fd, buffer, sz);
+ctrl_cmd(struct socket_server *ss, struct socket_message *result) {
+	struct ctrl_slot *slot = ctrl_head(ss);
+	assert(slot);
+	int ret = ctrl_cmd_(ss, slot->type, slot->u.buffer, result);
+	ctrl_pop(ss, slot);
+	return ret;
+}
+
+// the peer closed the stream, returns the type to report
+static int
+read_eof(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	if (s->closing) {
+		// Rare case : if s->closing is true, reading event is disable, and SOCKET_CLOSE is raised.
+		if (nomore_sending_data(s)) {
+			force_close(ss,s,l,result);
+		}
+		return -1;
+	}
+	int t = ATOM_LOAD(&s->type);
+	if (t == SOCKET_TYPE_HALFCLOSE_READ) {
+		// Rare case : Already shutdown read.
+		return -1;
+	}
+	if (t == SOCKET_TYPE_HALFCLOSE_WRITE) {
+		// Remote shutdown read (write error) before.
+		force_close(ss,s,l,result);
+	} else {
+		close_read(ss, s, result);
+	}
+	return SOCKET_CLOSE;
+}
+
+// read at most sz bytes into buffer, returns the size read (> 0), or 0 and set *type (-1 when nothing to report)
+static int
+read_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result, char * buffer, int sz, int *type) {
+	int n = (int)sp_read(ss->event_fd, s->fd, buffer, sz);
 	if (n<0) {
-		FREE(buffer);
 		switch(errno) {
 		case EINTR:
 		case AGAIN_WOULDBLOCK:
+			*type = -1;
 			break;
 		default:
-			return report_error(s, result, strerror(errno));
+			*type = report_error(s, result, strerror(errno));
+			break;
 		}
-		return -1;
+		return 0;
 	}
 	if (n==0) {
-		FREE(buffer);
-		if (s->closing) {
-			// Rare case : if s->closing is true, reading event is disable, and SOCKET_CLOSE is raised.
-			if (nomore_sending_data(s)) {
-				force_close(ss,s,l,result);
+		*type = read_eof(ss, s, l, result);
+		return 0;
+	}
+
+	if (halfclose_read(s)) {
+		// discard recv data (Rare case : if socket is HALFCLOSE_READ, reading event is disable.)
+		*type = -1;
+		return 0;
+	}
+
+	stat_read(ss,s,n);
+	limit_read(ss,s,n);
+	return n;
+}
+
+// decode the data of tls into buffer, returns the size, or SOCKET_TLS_CLOSE / SOCKET_TLS_ERROR
+static int
+tls_decode(struct socket_tls *t, char * buffer, int sz) {
+	int n = 0;
+	while (n < sz) {
+		int r = t->i->read(t->tls, buffer + n, sz - n);
+		if (r <= 0) {
+			if (r < 0 && n == 0)
+				return r;
+			break;
+		}
+		n += r;
+	}
+	return n;
+}
+
+// read at most sz bytes of decoded data from a tls socket into buffer, see read_tcp
+static int
+read_tls(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result, char * buffer, int sz, int *type) {
+	struct socket_tls *t = s->tls;
+	// the decoded data left by last read first, the buffer is full (read_more) if there is more
+	int n = tls_decode(t, buffer, sz);
+	if (n == 0) {
+		if (ss->tlsbuffer == NULL) {
+			ss->tlsbuffer = MALLOC(TLS_READ_BUFFER);
+		}
+		// sz is less than the read buffer size only if it's limited by the tokens of read rate limit
+		int rsz = sz < s->p.size ? sz : TLS_READ_BUFFER;
+		if (rsz > TLS_READ_BUFFER) {
+			rsz = TLS_READ_BUFFER;
+		}
+		int rn = read_tcp(ss, s, l, result, ss->tlsbuffer, rsz, type);
+		if (rn == 0) {
+			return 0;
+		}
+		if (t->i->input(t->tls, ss->tlsbuffer, rn) < 0) {
+			n = SOCKET_TLS_ERROR;
+		} else {
+			n = tls_decode(t, buffer, sz);
+		}
+	}
+	if (n == SOCKET_TLS_CLOSE) {
+		*type = read_eof(ss, s, l, result);
+		return 0;
+	}
+	// send the handshake messages, and the data kept before the handshake finished
+	if (n < 0 || !tls_flush(ss, s)) {
+		*type = report_error(s, result, "tls error");
+		return 0;
+	}
+	if (n == 0) {
+		*type = -1;
+	}
+	return n;
+}
+
+static inline int
+read_stream(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result, char * buffer, int sz, int *type) {
+	if (s->tls) {
+		return read_tls(ss, s, l, result, buffer, sz, type);
+	}
+	return read_tcp(ss, s, l, result, buffer, sz, type);
+}
+
+// the read buffer size, limited by the tokens of read rate limit
+static inline int
+read_size(struct socket_server *ss, struct socket *s) {
+	int sz = s->p.size;
+	if (ATOM_LOAD(&s->rlimit.rate)) {
+		// read rate limit, don't read more than the tokens
+		limit_refill(&s->rlimit, ss->time);
+		int64_t quota = limit_quota(&s->rlimit);
+		if (quota < sz)
+			sz = (int)quota;
+	}
+	return sz;
+}
+
+// adjust the read buffer size by the last read, returns true if the buffer is full (there may be more data)
+static inline bool
+read_more(struct socket *s, int sz, int n) {
+	if (sz < s->p.size) {
+		// limited by the tokens, don't change the read buffer size
+		return n == sz;
+	}
+	if (n == sz) {
+		s->p.size *= 2;
+		return true;
+	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
+		s->p.size /= 2;
+	}
+	return false;
+}
+
+static inline uint32_t
+frame_size(const uint8_t *h, int header) {
+	if (header == 2) {
+		return (uint32_t)h[0] << 8 | h[1];
+	}
+	return (uint32_t)h[0] << 24 | (uint32_t)h[1] << 16 | (uint32_t)h[2] << 8 | h[3];
+}
+
+// begin an uncomplete pack after the header is read, returns false if the size is larger than max
+static bool
+frame_begin(struct socket_frame *f, const uint8_t *head) {
+	uint32_t len = frame_size(head, f->header);
+	if (len > (uint32_t)f->max) {
+		return false;
+	}
+	f->pack_n = 0;
+	f->pack_sz = (int)len;
+	if (f->batch) {
+		f->pack_sz += f->header;
+	}
+	f->pack = buffer_pool_alloc(f->pack_sz);
+	if (f->batch) {
+		memcpy(f->pack, head, f->header);
+		f->pack_n = f->header;
+	}
+	return true;
+}
+
+// the bytes of complete frames (with headers) at the beginning of p, or -1 if a frame is too large
+static int
+frame_batch(struct socket_frame *f, const uint8_t *p, int n) {
+	int sz = 0;
+	while (n - sz >= f->header) {
+		uint32_t len = frame_size(p + sz, f->header);
+		if (len > (uint32_t)f->max) {
+			return -1;
+		}
+		if ((uint32_t)(n - sz - f->header) < len) {
+			break;
+		}
+		sz += f->header + (int)len;
+	}
+	return sz;
+}
+
+static inline int
+frame_message(struct socket_frame *f, struct socket_message *result, char *data, int sz) {
+	result->data = data;
+	result->ud = sz;
+	return f->batch ? SOCKET_DATA : SOCKET_FRAME;
+}
+
+// split the frames in f->rbuf, returns the message type when a message is ready in result,
+// SOCKET_ERR if a frame is too large, or -1 when the data in rbuf is consumed (it may be kept in f->pack)
+static int
+frame_split(struct socket_frame *f, struct socket_message *result) {
+	while (f->roff < f->rn) {
+		uint8_t * p = (uint8_t *)f->rbuf + f->roff;
+		int n = f->rn - f->roff;
+		if (f->pack) {
+			int need = f->pack_sz - f->pack_n;
+			if (need > n) {
+				need = n;
+			}
+			memcpy(f->pack + f->pack_n, p, need);
+			f->pack_n += need;
+			f->roff += need;
+			if (f->pack_n < f->pack_sz) {
+				return -1;
 			}
+			char * pack = f->pack;
+			f->pack = NULL;
+			return frame_message(f, result, pack, f->pack_sz);
+		}
+		if (f->head_n == 0 && n >= f->header) {
+			// complete frames in rbuf
+			if (f->batch) {
+				int sz = frame_batch(f, p, n);
+				if (sz < 0) {
+					return SOCKET_ERR;
+				}
+				if (sz > 0) {
+					char * data;
+					if (f->roff == 0) {
+						// send rbuf itself, and the rest (an uncomplete frame) is moved to f->head / f->pack
+						f->roff = sz;
+						while (f->roff < f->rn && f->head_n < f->header) {
+							f->head[f->head_n++] = f->rbuf[f->roff++];
+						}
+						if (f->head_n == f->header) {
+							f->head_n = 0;
+							if (!frame_begin(f, f->head)) {
+								// f->rbuf is still owned by f, and released by free_frame
+								return SOCKET_ERR;
+							}
+							memcpy(f->pack + f->pack_n, f->rbuf + f->roff, f->rn - f->roff);
+							f->pack_n += f->rn - f->roff;
+						}
+						data = buffer_pool_shrink(f->rbuf, f->rbuf_sz, sz);
+						f->rbuf = NULL;
+						f->roff = f->rn = 0;
+					} else {
+						data = buffer_pool_alloc(sz);
+						memcpy(data, p, sz);
+						f->roff += sz;
+					}
+					return frame_message(f, result, data, sz);
+				}
+			} else {
+				uint32_t len = frame_size(p, f->header);
+				if (len > (uint32_t)f->max) {
+					return SOCKET_ERR;
+				}
+				if (len <= (uint32_t)(n - f->header)) {
+					char * data = buffer_pool_alloc(len);
+					memcpy(data, p + f->header, len);
+					f->roff += f->header + (int)len;
+					return frame_message(f, result, data, (int)len);
+				}
+			}
+		}
+		// uncomplete frame
+		while (f->roff < f->rn && f->head_n < f->header) {
+			f->head[f->head_n++] = f->rbuf[f->roff++];
+		}
+		if (f->head_n < f->header) {
 			return -1;
 		}
-		int t = ATOM_LOAD(&s->type);
-		if (t == SOCKET_TYPE_HALFCLOSE_READ) {
-			// Rare case : Already shutdown read.
+		f->head_n = 0;
+		if (!frame_begin(f, f->head)) {
+			return SOCKET_ERR;
+		}
+		if (f->pack_n == f->pack_sz) {
+			// empty frame
+			char * pack = f->pack;
+			f->pack = NULL;
+			return frame_message(f, result, pack, f->pack_sz);
+		}
+	}
+	return -1;
+}
+
+static int
+frame_error(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	force_close(ss, s, l, result);
+	result->data = "frame too large";
+	return SOCKET_ERR;
+}
+
+// forward the frames split by the header (see socket_server_frame), returns SOCKET_MORE if there are more frames
+static int
+forward_message_frame(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	struct socket_frame *f = s->frame;
+	result->opaque = s->opaque;
+	result->id = s->id;
+	for (;;) {
+		int type = frame_split(f, result);
+		if (type == SOCKET_ERR) {
+			return frame_error(ss, s, l, result);
+		}
+		if (type != -1) {
+			if (f->roff < f->rn || f->more) {
+				return SOCKET_MORE;
+			}
+			return type;
+		}
+		if (f->rbuf) {
+			buffer_pool_free(f->rbuf, f->rbuf_sz);
+			f->rbuf = NULL;
+			f->roff = f->rn = 0;
+		}
+		if (s->throttle & THROTTLE_READ) {
 			return -1;
 		}
-		if (t == SOCKET_TYPE_HALFCLOSE_WRITE) {
-			// Remote shutdown read (write error) before.
-			force_close(ss,s,l,result);
-		} else {
-			close_read(ss, s, result);
+		int sz = read_size(ss, s);
+		int n;
+		if (f->pack && f->pack_sz - f->pack_n >= sz) {
+			// the rest of a large frame, read into the pack directly
+			n = read_stream(ss, s, l, result, f->pack + f->pack_n, sz, &type);
+			if (n == 0) {
+				return type;
+			}
+			f->more = read_more(s, sz, n);
+			f->pack_n += n;
+			if (f->pack_n < f->pack_sz) {
+				return -1;
+			}
+			char * pack = f->pack;
+			f->pack = NULL;
+			result->opaque = s->opaque;
+			result->id = s->id;
+			type = frame_message(f, result, pack, f->pack_sz);
+			return f->more ? SOCKET_MORE : type;
 		}
-		return SOCKET_CLOSE;
+		char * buffer = buffer_pool_alloc(sz);
+		n = read_stream(ss, s, l, result, buffer, sz, &type);
+		if (n == 0) {
+			buffer_pool_free(buffer, sz);
+			return type;
+		}
+		f->more = read_more(s, sz, n);
+		f->rbuf = buffer;
+		f->rbuf_sz = sz;
+		f->rn = n;
+		result->opaque = s->opaque;
+		result->id = s->id;
 	}
+}
 
-	if (halfclose_read(s)) {
-		// discard recv data (Rare case : if socket is HALFCLOSE_READ, reading event is disable.)
-		FREE(buffer);
+// return -1 (ignore) when error
+static int
+forward_message_tcp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	if (s->frame) {
+		return forward_message_frame(ss, s, l, result);
+	}
+	if (s->throttle & THROTTLE_READ) {
+		// paused by rate limit, the event may be in the same batch of sp_wait
 		return -1;
 	}
+	int sz = read_size(ss, s);
+	// the buffer will be released by buffer_pool_free (or skynet_free) in the service
+	char * buffer = buffer_pool_alloc(sz);
+	int type;
+	int n = read_stream(ss, s, l, result, buffer, sz, &type);
+	if (n == 0) {
+		buffer_pool_free(buffer, sz);
+		return type;
+	}
 
-	stat_read(ss,s,n);
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = n;
+	// the service frees it with n, so it should be in the class of n
+	result->data = buffer_pool_shrink(buffer, sz, n);
+
+	return read_more(s, sz, n) ? SOCKET_MORE : SOCKET_DATA;
+}
+
+static int
+gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
+	int addrsz = 1;
+	udp_address[0] = (uint8_t)protocol;
+	if (protocol == PROTOCOL_UDP) {
+		memcpy(udp_address+addrsz, &sa->v4.sin_port, sizeof(sa->v4.sin_port));
+		addrsz += sizeof(sa->v4.sin_port);
+		memcpy(udp_address+addrsz, &sa->v4.sin_addr, sizeof(sa->v4.sin_addr));
+		addrsz += sizeof(sa->v4.sin_addr);
+	} else {
+		memcpy(udp_address+addrsz, &sa->v6.sin6_port, sizeof(sa->v6.sin6_port));
+		addrsz += sizeof(sa->v6.sin6_port);
+		memcpy(udp_address+addrsz, &sa->v6.sin6_addr, sizeof(sa->v6.sin6_addr));
+		addrsz += sizeof(sa->v6.sin6_addr);
+	}
+	return addrsz;
+}
+
+// the size of the udp address of a datagram, or 0 if it doesn't match the protocol of the socket
+static inline int
+udp_address_size(struct socket *s, socklen_t slen) {
+	if (s->protocol == PROTOCOL_UNIX) {
+		// the address of unix datagram is the type only
+		return 1;
+	} else if (slen == sizeof(struct sockaddr_in)) {
+		return s->protocol == PROTOCOL_UDP ? 1 + 2 + 4 : 0;
+	} else {
+		return s->protocol == PROTOCOL_UDPv6 ? 1 + 2 + 16 : 0;
+	}
+}
+
+static inline void
+udp_address_gen(struct socket *s, union sockaddr_all *sa, uint8_t *udp_address) {
+	if (s->protocol == PROTOCOL_UNIX) {
+		udp_address[0] = PROTOCOL_UNIX;
+	} else {
+		gen_udp_address(s->protocol, sa, udp_address);
+	}
+}
+
+static int
+udp_message(struct socket_server *ss, struct socket *s, const uint8_t *buffer, int n, union sockaddr_all *sa, socklen_t slen, struct socket_message * result) {
+	int addrsz = udp_address_size(s, slen);
+	if (addrsz == 0)
+		return -1;
+	// the service frees it by skynet_socket_free_buffer with the size of data and address
+	uint8_t * data = buffer_pool_alloc(n + addrsz);
+	memcpy(data, buffer, n);
+	udp_address_gen(s, sa, data + n);
+
+	result->opaque = s->opaque;
+	result->id = s->id;
+	result->ud = n;
+	result->data = (char *)data;
+
+	return SOCKET_UDP;
+}
+
+// put a datagram into the message of SOCKET_UDPBATCH, returns the end of the record
+static uint8_t *
+udp_record(struct socket *s, uint8_t *p, const uint8_t *buffer, int n, union sockaddr_all *sa, int addrsz) {
+	p[0] = (uint8_t)(n >> 8);
+	p[1] = (uint8_t)n;
+	udp_address_gen(s, sa, p + 2);
+	memcpy(p + 2 + addrsz, buffer, n);
+	return p + 2 + addrsz + n;
+}
 
+static inline int
+udp_batch_report(struct socket *s, uint8_t *data, int sz, struct socket_message * result) {
 	result->opaque = s->opaque;
 	result->id = s->id;
-	result->ud = n;
-	result->data = buffer;
+	result->ud = sz;
+	result->data = (char *)data;
+	return SOCKET_UDPBATCH;
+}
 
-	if (n == sz) {
-		s->p.size *= 2;
-		return SOCKET_MORE;
-	} else if (sz > MIN_READ_BUFFER && n*2 < sz) {
-		s->p.size /= 2;
+#ifdef UDP_BATCH
+
+static struct udp_batch *
+udp_batch_create() {
+	struct udp_batch * b = MALLOC(sizeof(*b));
+	b->id = -1;
+	b->n = 0;
+	b->index = 0;
+	int i;
+	for (i=0;i<UDP_BATCH;i++) {
+		b->iov[i].iov_base = b->buffer[i];
+		b->iov[i].iov_len = MAX_UDP_PACKAGE;
+		memset(&b->msg[i], 0, sizeof(b->msg[i]));
+		b->msg[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msg[i].msg_hdr.msg_iovlen = 1;
+		b->msg[i].msg_hdr.msg_name = &b->addr[i];
 	}
+	return b;
+}
 
-	return SOCKET_DATA;
+// all the datagrams left in the batch as one SOCKET_UDPBATCH message
+static int
+udp_batch_message(struct socket_server *ss, struct socket *s, struct udp_batch *b, struct socket_message * result) {
+	int sz = 0;
+	int i;
+	for (i=b->index;i<b->n;i++) {
+		int addrsz = udp_address_size(s, b->msg[i].msg_hdr.msg_namelen);
+		if (addrsz > 0) {
+			sz += 2 + addrsz + (int)b->msg[i].msg_len;
+		}
+	}
+	uint8_t * data = sz > 0 ? buffer_pool_alloc(sz) : NULL;
+	uint8_t * p = data;
+	for (i=b->index;i<b->n;i++) {
+		struct mmsghdr * m = &b->msg[i];
+		int n = (int)m->msg_len;
+		stat_read(ss,s,n);
+		limit_read(ss,s,n);
+		int addrsz = udp_address_size(s, m->msg_hdr.msg_namelen);
+		if (addrsz > 0) {
+			p = udp_record(s, p, b->buffer[i], n, &b->addr[i], addrsz);
+		}
+		// or protocol mismatch, drop it
+	}
+	b->index = b->n;
+	if (data == NULL)
+		return -1;
+	return udp_batch_report(s, data, sz, result);
 }
 
+// Read a batch of datagrams by recvmmsg, and forward one of them for each call (or all of them in batch mode).
+// socket_server_poll calls it again for the same event until it returns -1.
 static int
-gen_udp_address(int protocol, union sockaddr_all *sa, uint8_t * udp_address) {
-	int addrsz = 1;
-	udp_address[0] = (uint8_t)protocol;
-	if (protocol == PROTOCOL_UDP) {
-		memcpy(udp_address+addrsz, &sa->v4.sin_port, sizeof(sa->v4.sin_port));
-		addrsz += sizeof(sa->v4.sin_port);
-		memcpy(udp_address+addrsz, &sa->v4.sin_addr, sizeof(sa->v4.sin_addr));
-		addrsz += sizeof(sa->v4.sin_addr);
-	} else {
-		memcpy(udp_address+addrsz, &sa->v6.sin6_port, sizeof(sa->v6.sin6_port));
-		addrsz += sizeof(sa->v6.sin6_port);
-		memcpy(udp_address+addrsz, &sa->v6.sin6_addr, sizeof(sa->v6.sin6_addr));
-		addrsz += sizeof(sa->v6.sin6_addr);
+forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	struct udp_batch * b = ss->udpbatch;
+	if (b == NULL) {
+		b = ss->udpbatch = udp_batch_create();
+	}
+	for (;;) {
+		if (b->id != s->id || b->index >= b->n) {
+			if (s->throttle & THROTTLE_READ) {
+				// paused by rate limit, the datagrams received already are forwarded.
+				b->n = 0;
+				return -1;
+			}
+			int i;
+			for (i=0;i<UDP_BATCH;i++) {
+				b->msg[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+			}
+			int n = recvmmsg(s->fd, b->msg, UDP_BATCH, 0, NULL);
+			if (n<0) {
+				b->n = 0;
+				switch(errno) {
+				case EINTR:
+				case AGAIN_WOULDBLOCK:
+					return -1;
+				}
+				int error = errno;
+				// close when error
+				force_close(ss, s, l, result);
+				result->data = strerror(error);
+				return SOCKET_ERR;
+			}
+			b->id = s->id;
+			b->n = n;
+			b->index = 0;
+			if (n == 0)
+				return -1;
+		}
+		if (s->udpbatch) {
+			int type = udp_batch_message(ss, s, b, result);
+			if (type == SOCKET_UDPBATCH)
+				return type;
+			continue;
+		}
+		struct mmsghdr * m = &b->msg[b->index];
+		int n = (int)m->msg_len;
+		stat_read(ss,s,n);
+		limit_read(ss,s,n);
+		int type = udp_message(ss, s, b->buffer[b->index], n, &b->addr[b->index], m->msg_hdr.msg_namelen, result);
+		++b->index;
+		if (type == SOCKET_UDP)
+			return type;
+		// protocol mismatch, drop it
 	}
-	return addrsz;
 }
 
+#else
+
 static int
 forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message * result) {
+	if (s->throttle & THROTTLE_READ) {
+		return -1;
+	}
 	union sockaddr_all sa;
 	socklen_t slen = sizeof(sa);
 	int n = recvfrom(s->fd, ss->udpbuffer,MAX_UDP_PACKAGE,0,&sa.s,&slen);
@@ -1590,29 +3638,23 @@ forward_message_udp(struct socket_server *ss, struct socket *s, struct socket_lo
 		return SOCKET_ERR;
 	}
 	stat_read(ss,s,n);
+	limit_read(ss,s,n);
 
-	uint8_t * data;
-	if (slen == sizeof(sa.v4)) {
-		if (s->protocol != PROTOCOL_UDP)
-			return -1;
-		data = MALLOC(n + 1 + 2 + 4);
-		gen_udp_address(PROTOCOL_UDP, &sa, data + n);
-	} else {
-		if (s->protocol != PROTOCOL_UDPv6)
+	if (s->udpbatch) {
+		// one datagram for each read without recvmmsg
+		int addrsz = udp_address_size(s, slen);
+		if (addrsz == 0)
 			return -1;
-		data = MALLOC(n + 1 + 2 + 16);
-		gen_udp_address(PROTOCOL_UDPv6, &sa, data + n);
+		int sz = 2 + addrsz + n;
+		uint8_t * data = buffer_pool_alloc(sz);
+		udp_record(s, data, ss->udpbuffer, n, &sa, addrsz);
+		return udp_batch_report(s, data, sz, result);
 	}
-	memcpy(data, ss->udpbuffer, n);
-
-	result->opaque = s->opaque;
-	result->id = s->id;
-	result->ud = n;
-	result->data = (char *)data;
-
-	return SOCKET_UDP;
+	return udp_message(ss, s, ss->udpbuffer, n, &sa, slen, result);
 }
 
+#endif
+
 static int
 report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l, struct socket_message *result) {
 	int error;
@@ -1625,6 +3667,7 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 		return SOCKET_ERR;
 	} else {
 		ATOM_STORE(&s->type , SOCKET_TYPE_CONNECTED);
+		sp_stream(ss->event_fd, s->fd);
 		result->opaque = s->opaque;
 		result->id = s->id;
 		result->ud = 0;
@@ -1638,6 +3681,11 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 		union sockaddr_all u;
 		socklen_t slen = sizeof(u);
 		if (getpeername(s->fd, &u.s, &slen) == 0) {
+			if (u.s.sa_family == AF_UNIX) {
+				getname(&u, slen, ss->buffer, sizeof(ss->buffer));
+				result->data = ss->buffer;
+				return SOCKET_OPEN;
+			}
 			void * sin_addr = (u.s.sa_family == AF_INET) ? (void*)&u.v4.sin_addr : (void *)&u.v6.sin6_addr;
 			if (inet_ntop(u.s.sa_family, sin_addr, ss->buffer, sizeof(ss->buffer))) {
 				result->data = ss->buffer;
@@ -1649,26 +3697,12 @@ report_connect(struct socket_server *ss, struct socket *s, struct socket_lock *l
 	}
 }
 
-static int
-getname(union sockaddr_all *u, char *buffer, size_t sz) {
-	char tmp[INET6_ADDRSTRLEN];
-	void * sin_addr = (u->s.sa_family == AF_INET) ? (void*)&u->v4.sin_addr : (void *)&u->v6.sin6_addr;
-	if (inet_ntop(u->s.sa_family, sin_addr, tmp, sizeof(tmp))) {
-		int sin_port = ntohs((u->s.sa_family == AF_INET) ? u->v4.sin_port : u->v6.sin6_port);
-		snprintf(buffer, sz, "%s:%d", tmp, sin_port);
-		return 1;
-	} else {
-		buffer[0] = '\0';
-		return 0;
-	}
-}
-
 // return 0 when failed, or -1 when file limit
 static int
 report_accept(struct socket_server *ss, struct socket *s, struct socket_message *result) {
 	union sockaddr_all u;
 	socklen_t len = sizeof(u);
-	int client_fd = accept(s->fd, &u.s, &len);
+	int client_fd = sp_accept(ss->event_fd, s->fd, &u.s, &len);
 	if (client_fd < 0) {
 		if (errno == EMFILE || errno == ENFILE) {
 			result->opaque = s->opaque;
@@ -1706,12 +3740,13 @@ report_accept(struct socket_server *ss, struct socket *s, struct socket_message
 	stat_read(ss,s,1);
 
 	ATOM_STORE(&ns->type , SOCKET_TYPE_PACCEPT);
+	sp_stream(ss->event_fd, client_fd);
 	result->opaque = s->opaque;
 	result->id = s->id;
 	result->ud = id;
 	result->data = NULL;
 
-	if (getname(&u, ss->buffer, sizeof(ss->buffer))) {
+	if (getname(&u, len, ss->buffer, sizeof(ss->buffer))) {
 		result->data = ss->buffer;
 	}
 
@@ -1753,7 +3788,20 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 			}
 		}
 		if (ss->event_index == ss->event_n) {
-			ss->event_n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT);
+			if (ss->spin > 0 && spin_wait(ss)) {
+				ss->checkctrl = 1;
+				if (more) {
+					*more = 0;
+				}
+				continue;
+			}
+			if (ctrl_prepare_sleep(ss)) {
+				ss->checkctrl = 1;
+				continue;
+			}
+			ATOM_FINC(&ss->block_n);
+			ss->event_n = sp_wait(ss->event_fd, ss->ev, MAX_EVENT, -1);
+			ATOM_STORE(&ss->ctrl_sleep, 0);
 			ss->checkctrl = 1;
 			if (more) {
 				*more = 0;
@@ -1771,7 +3819,8 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 		struct event *e = &ss->ev[ss->event_index++];
 		struct socket *s = e->s;
 		if (s == NULL) {
-			// dispatch pipe message at beginning
+			// ctrl commands are dispatched at beginning, only clear the notify fd here
+			ctrl_clear_notify(ss);
 			continue;
 		}
 		struct socket_lock l;
@@ -1799,14 +3848,14 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 					type = forward_message_tcp(ss, s, &l, result);
 					if (type == SOCKET_MORE) {
 						--ss->event_index;
-						return SOCKET_DATA;
+						return (s->frame && !s->frame->batch) ? SOCKET_FRAME : SOCKET_DATA;
 					}
 				} else {
 					type = forward_message_udp(ss, s, &l, result);
-					if (type == SOCKET_UDP) {
+					if (type == SOCKET_UDP || type == SOCKET_UDPBATCH) {
 						// try read again
 						--ss->event_index;
-						return SOCKET_UDP;
+						return type;
 					}
 				}
 				if (e->write && type != SOCKET_CLOSE && type != SOCKET_ERR) {
@@ -1825,6 +3874,14 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 				return type;
 			}
 			if (e->error) {
+				if (zerocopy_complete(ss, s) > 0) {
+					// the completions of MSG_ZEROCOPY are reported by the error queue
+					if (s->closing && nomore_sending_data(s) && s->zc.head == NULL) {
+						// finish writing
+						force_close(ss, s, &l, result);
+					}
+					break;
+				}
 				int error;
 				socklen_t len = sizeof(error);
 				int code = getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &error, &len);
@@ -1853,27 +3910,81 @@ socket_server_poll(struct socket_server *ss, struct socket_message * result, int
 }
 
 static void
-send_request(struct socket_server *ss, struct request_package *request, char type, int len) {
-	request->header[6] = (uint8_t)type;
-	request->header[7] = (uint8_t)len;
-	const char * req = (const char *)request + offsetof(struct request_package, header[6]);
+ctrl_notify(struct socket_server *ss) {
+#ifdef __linux__
+	uint64_t v = 1;
+#else
+	uint8_t v = 0;
+#endif
 	for (;;) {
-		ssize_t n = write(ss->sendctrl_fd, req, len+2);
+		ssize_t n = write(ss->sendctrl_fd, &v, sizeof(v));
 		if (n<0) {
-			if (errno != EINTR) {
-				skynet_error(NULL, "socket-server : send ctrl command error %s.", strerror(errno));
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				skynet_error(NULL, "socket-server : send ctrl notify error %s.", strerror(errno));
 			}
-			continue;
 		}
-		assert(n == len+2);
 		return;
 	}
 }
 
+// Sleep until the slot at pos is released by socket thread (ctrl_pop), like blocking write to a full pipe.
+// full_wait is set before checking the slot, and ctrl_pop checks full_wait after releasing the slot, so the wakeup is never lost.
+static void
+ctrl_wait_full(struct ctrl_queue *q, struct ctrl_slot *slot, size_t pos) {
+	pthread_mutex_lock(&q->full_lock);
+	ATOM_FINC(&q->full_wait);
+	while ((intptr_t)ATOM_LOAD(&slot->seq) - (intptr_t)pos < 0) {
+		pthread_cond_wait(&q->full_cond, &q->full_lock);
+	}
+	ATOM_FDEC(&q->full_wait);
+	pthread_mutex_unlock(&q->full_lock);
+}
+
+// Multi-producer lock-free push into ss->ctrl (See Dmitry Vyukov's bounded MPMC queue),
+// and write the notify fd only when socket thread is going to sleep in sp_wait.
+static void
+send_request(struct socket_server *ss, struct request_package *request, char type, int len) {
+	assert(len < MAX_CTRL_REQUEST);
+	struct ctrl_queue *q = &ss->ctrl;
+	struct ctrl_slot *slot;
+	size_t pos = ATOM_LOAD(&q->tail);
+	int spin = 0;
+	for (;;) {
+		slot = &q->slot[pos & (CTRL_QUEUE_SIZE-1)];
+		size_t seq = ATOM_LOAD(&slot->seq);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (ATOM_CAS_SIZET(&q->tail, pos, pos+1))
+				break;
+		} else if (diff < 0) {
+			// The queue is full, wait for socket thread.
+			if (++spin < CTRL_FULL_SPIN) {
+				sched_yield();
+			} else {
+				ctrl_wait_full(q, slot, pos);
+				spin = 0;
+			}
+		}
+		pos = ATOM_LOAD(&q->tail);
+	}
+	slot->type = (uint8_t)type;
+	memcpy(slot->u.buffer, request->u.buffer, len);
+	ATOM_STORE(&slot->seq, pos + 1);
+
+	while (ATOM_LOAD(&ss->ctrl_sleep)) {
+		if (ATOM_CAS(&ss->ctrl_sleep, 1, 0)) {
+			ctrl_notify(ss);
+			break;
+		}
+	}
+}
+
 static int
 open_request(struct socket_server *ss, struct request_package *req, uintptr_t opaque, const char *addr, int port) {
 	int len = strlen(addr);
-	if (len + sizeof(req->u.open) >= 256) {
+	if (len + sizeof(req->u.open) >= MAX_CTRL_REQUEST) {
 		skynet_error(NULL, "socket-server error: Invalid addr %s.",addr);
 		return -1;
 	}
@@ -1907,7 +4018,9 @@ socket_server_connect(struct socket_server *ss, uintptr_t opaque, const char * a
 
 static inline int
 can_direct_write(struct socket *s, int id) {
-	return s->id == id && nomore_sending_data(s) && ATOM_LOAD(&s->type) == SOCKET_TYPE_CONNECTED && ATOM_LOAD(&s->udpconnecting) == 0;
+	return s->id == id && nomore_sending_data(s) && ATOM_LOAD(&s->type) == SOCKET_TYPE_CONNECTED && ATOM_LOAD(&s->udpconnecting) == 0
+		&& ATOM_LOAD(&s->coalesce) == 0 && ATOM_LOAD(&s->zerocopy) == 0 && ATOM_LOAD(&s->wlimit.rate) == 0
+		&& ATOM_LOAD(&s->tls_on) == 0;
 }
 
 // 数据入列
@@ -1915,7 +4028,7 @@ can_direct_write(struct socket *s, int id) {
 int
 socket_server_send(struct socket_server *ss, struct socket_sendbuffer *buf) {
 	int id = buf->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id) || s->closing) {
 		free_buffer(ss, buf);
 		return -1;
@@ -1942,7 +4055,7 @@ socket_server_send(struct socket_server *ss, struct socket_sendbuffer *buf) {
 					so.free_func((void *)buf->buffer);
 					return -1;
 				}
-				n = sendto(s->fd, so.buffer, so.sz, 0, &sa.s, sasz);
+				n = udp_sendto(s, so.buffer, so.sz, &sa, sasz);
 			}
 			if (n<0) {
 				// ignore error, let socket thread try again
@@ -1975,7 +4088,7 @@ socket_server_send(struct socket_server *ss, struct socket_sendbuffer *buf) {
 		socket_unlock(&l);
 	}
 
-	inc_sending_ref(s, id);
+	inc_sending_ref(ss, s, id);
 
 	struct request_package request;
 	request_init(&request);
@@ -1991,13 +4104,13 @@ int
 socket_server_send_lowpriority(struct socket_server *ss, struct socket_sendbuffer *buf) {
 	int id = buf->id;
 
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		free_buffer(ss, buf);
 		return -1;
 	}
 
-	inc_sending_ref(s, id);
+	inc_sending_ref(ss, s, id);
 
 	struct request_package request;
 	request_init(&request);
@@ -2008,6 +4121,60 @@ socket_server_send_lowpriority(struct socket_server *ss, struct socket_sendbuffe
 	return 0;
 }
 
+// The buffer is freed by socket server after it's sent to all the sockets
+void
+socket_server_multicast(struct socket_server *ss, const void *buffer, size_t sz, const int *ids, int n) {
+	if (n <= 0) {
+		FREE((void *)buffer);
+		return;
+	}
+	struct socket_multicast * m = MALLOC(sizeof(*m) + (n-1) * sizeof(int));
+	m->ref = 1;	// released by socket thread after all the sockets are appended
+	m->n = n;
+	m->sz = sz;
+	m->buffer = buffer;
+	int i;
+	for (i=0;i<n;i++) {
+		int id = ids[i];
+		struct socket * s = get_socket(ss, id);
+		if (socket_invalid(s, id) || s->protocol != PROTOCOL_TCP) {
+			m->id[i] = -1;
+		} else {
+			// keep the order with the direct writes, see socket_server_send
+			inc_sending_ref(ss, s, id);
+			m->id[i] = id;
+		}
+	}
+
+	struct request_package request;
+	request_init(&request);
+	request.u.multicast.m = m;
+
+	send_request(ss, &request, 'M', sizeof(request.u.multicast));
+}
+
+// return -1 when error, 0 when success
+int
+socket_server_sendfile(struct socket_server *ss, int id, int fd, int64_t offset, int64_t sz) {
+	struct socket * s = get_socket(ss, id);
+	if (socket_invalid(s, id) || s->closing || offset < 0 || sz < 0) {
+		close(fd);
+		return -1;
+	}
+
+	inc_sending_ref(ss, s, id);
+
+	struct request_package request;
+	request_init(&request);
+	request.u.sendfile.id = id;
+	request.u.sendfile.fd = fd;
+	request.u.sendfile.offset = offset;
+	request.u.sendfile.sz = sz;
+
+	send_request(ss, &request, 'F', sizeof(request.u.sendfile));
+	return 0;
+}
+
 void
 socket_server_exit(struct socket_server *ss) {
 	struct request_package request;
@@ -2036,16 +4203,64 @@ socket_server_shutdown(struct socket_server *ss, uintptr_t opaque, int id) {
 	send_request(ss, &request, 'K', sizeof(request.u.close));
 }
 
+// returns true if the connection to the unix socket is refused, it's a socket file left by an exited process.
+static bool
+unix_stale(const struct sockaddr_un *sa, socklen_t len, int type) {
+	int fd = socket(AF_UNIX, type, 0);
+	if (fd < 0)
+		return false;
+	// nonblocking, don't wait when the backlog of a live listen socket is full
+	sp_nonblocking(fd);
+	bool stale = connect(fd, (const struct sockaddr *)sa, len) != 0 && errno == ECONNREFUSED;
+	close(fd);
+	return stale;
+}
+
+// bind unix domain socket to path, remove the socket file left by last process first.
+// It fails with EADDRINUSE if the path is bound by a live socket.
+static int
+do_bind_unix(const char *path, int protocol) {
+	struct sockaddr_un sa;
+	socklen_t len = unix_address(path, &sa);
+	if (len == 0)
+		return -1;
+	int type = protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM;
+	int fd = socket(AF_UNIX, type, 0);
+	if (fd < 0)
+		return -1;
+#ifdef S_ISSOCK
+	struct stat st;
+	if (path[0] != '@' && stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (!unix_stale(&sa, len, type)) {
+			close(fd);
+			errno = EADDRINUSE;
+			return -1;
+		}
+		unlink(path);
+	}
+#endif
+	if (bind(fd, (struct sockaddr *)&sa, len) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
 // return -1 means failed
-// or return AF_INET or AF_INET6
+// or return AF_INET or AF_INET6 or AF_UNIX (host is "unix:path")
 static int
-do_bind(const char *host, int port, int protocol, int *family) {
+do_bind(const char *host, int port, int protocol, int *family, bool reuseport) {
 	int fd;
 	int status;
 	int reuse = 1;
 	struct addrinfo ai_hints;
 	struct addrinfo *ai_list = NULL;
 	char portstr[16];
+	const char * path = unix_path(host);
+	if (path) {
+		*family = AF_UNIX;
+		return do_bind_unix(path, protocol);
+	}
 	if (host == NULL || host[0] == 0) {
 		host = "0.0.0.0";	// INADDR_ANY
 	}
@@ -2072,6 +4287,15 @@ do_bind(const char *host, int port, int protocol, int *family) {
 	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int))==-1) {
 		goto _failed;
 	}
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (void *)&reuse, sizeof(int))==-1) {
+			goto _failed;
+		}
+#else
+		goto _failed;
+#endif
+	}
 	status = bind(fd, (struct sockaddr *)ai_list->ai_addr, ai_list->ai_addrlen);
 	if (status != 0)
 		goto _failed;
@@ -2086,9 +4310,9 @@ _failed_fd:
 }
 
 static int
-do_listen(const char * host, int port, int backlog) {
+do_listen(const char * host, int port, int backlog, bool reuseport) {
 	int family = 0;
-	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family);
+	int listen_fd = do_bind(host, port, IPPROTO_TCP, &family, reuseport);
 	if (listen_fd < 0) {
 		return -1;
 	}
@@ -2099,9 +4323,9 @@ do_listen(const char * host, int port, int backlog) {
 	return listen_fd;
 }
 
-int
-socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
-	int fd = do_listen(addr, port, backlog);
+static int
+listen_(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog, bool reuseport) {
+	int fd = do_listen(addr, port, backlog, reuseport);
 	if (fd < 0) {
 		return -1;
 	}
@@ -2119,6 +4343,16 @@ socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * ad
 	return id;
 }
 
+int
+socket_server_listen(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return listen_(ss, opaque, addr, port, backlog, false);
+}
+
+int
+socket_server_listen_reuseport(struct socket_server *ss, uintptr_t opaque, const char * addr, int port, int backlog) {
+	return listen_(ss, opaque, addr, port, backlog, true);
+}
+
 int
 socket_server_bind(struct socket_server *ss, uintptr_t opaque, int fd) {
 	struct request_package request;
@@ -2161,6 +4395,100 @@ socket_server_nodelay(struct socket_server *ss, int id) {
 	send_request(ss, &request, 'T', sizeof(request.u.setopt));
 }
 
+void
+socket_server_coalesce(struct socket_server *ss, int id, int size) {
+	struct request_package request;
+	request_init(&request);
+	request.u.setopt.id = id;
+	request.u.setopt.what = SOCKOPT_COALESCE;
+	request.u.setopt.value = size;
+	send_request(ss, &request, 'T', sizeof(request.u.setopt));
+}
+
+void
+socket_server_udp_batch(struct socket_server *ss, int id, int batch) {
+	struct request_package request;
+	request_init(&request);
+	request.u.setopt.id = id;
+	request.u.setopt.what = SOCKOPT_UDPBATCH;
+	request.u.setopt.value = batch;
+	send_request(ss, &request, 'T', sizeof(request.u.setopt));
+}
+
+void
+socket_server_zerocopy(struct socket_server *ss, int id, int size) {
+	struct request_package request;
+	request_init(&request);
+	request.u.setopt.id = id;
+	request.u.setopt.what = SOCKOPT_ZEROCOPY;
+	request.u.setopt.value = size;
+	send_request(ss, &request, 'T', sizeof(request.u.setopt));
+}
+
+void
+socket_server_ratelimit(struct socket_server *ss, int id, int read, int packet, int write) {
+	struct request_package request;
+	request_init(&request);
+	request.u.ratelimit.id = id;
+	request.u.ratelimit.read = read;
+	request.u.ratelimit.packet = packet;
+	request.u.ratelimit.write = write;
+	struct socket *s = get_socket(ss, id);
+	if (s->id == id && write > 0) {
+		// turn off direct write at once, so the data sent after this call is limited.
+		ATOM_STORE(&s->wlimit.rate, write);
+	}
+	send_request(ss, &request, 'Y', sizeof(request.u.ratelimit));
+}
+
+void
+socket_server_busypoll(struct socket_server *ss, int spin, int busy_poll) {
+	ss->spin = spin > 0 ? spin : 0;
+	ss->busy_poll = busy_poll > 0 ? busy_poll : 0;
+}
+
+void
+socket_server_pollstat(struct socket_server *ss, struct socket_poll_stat *stat) {
+	stat->spin = ATOM_LOAD(&ss->spin_n);
+	stat->hit = ATOM_LOAD(&ss->spin_hit);
+	stat->spin_us = ATOM_LOAD(&ss->spin_us);
+	stat->block = ATOM_LOAD(&ss->block_n);
+}
+
+void
+socket_server_frame(struct socket_server *ss, int id, int header, int max, int batch) {
+	if (header != 0 && header != 2 && header != 4) {
+		skynet_error(NULL, "socket-server : invalid frame header size %d", header);
+		return;
+	}
+	int limit = (header == 2) ? 0xffff : INT_MAX - 4;
+	if (max <= 0 || max > limit) {
+		max = limit;
+	}
+	struct request_package request;
+	request_init(&request);
+	request.u.frame.id = id;
+	request.u.frame.header = header;
+	request.u.frame.max = max;
+	request.u.frame.batch = batch;
+	send_request(ss, &request, 'H', sizeof(request.u.frame));
+}
+
+void
+socket_server_tls(struct socket_server *ss, int id, void *tls, const struct socket_tls_interface *i) {
+	struct socket *s = get_socket(ss, id);
+	if (s->id == id) {
+		// turn off direct write at once, the data sent after this call is encoded.
+		ATOM_STORE(&s->tls_on, 1);
+	}
+	struct request_package request;
+	request_init(&request);
+	request.u.tls.id = id;
+	request.u.tls.tls = tls;
+	request.u.tls.i = i;
+	send_request(ss, &request, 'E', sizeof(request.u.tls));
+}
+
 void
 socket_server_userobject(struct socket_server *ss, struct socket_object_interface *soi) {
 	ss->soi = *soi;
@@ -2174,7 +4502,7 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 	int family;
 	if (port != 0 || addr != NULL) {
 		// bind
-		fd = do_bind(addr, port, IPPROTO_UDP, &family);
+		fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 		if (fd < 0) {
 			return -1;
 		}
@@ -2206,13 +4534,13 @@ socket_server_udp(struct socket_server *ss, uintptr_t opaque, const char * addr,
 int
 socket_server_udp_listen(struct socket_server *ss, uintptr_t opaque, const char* addr, int port){
 	int fd;
-	if (port == 0){
+	if (port == 0 && unix_path(addr) == NULL){
 		return -1;
 	}
 
 	int family;
 	// bind
-	fd = do_bind(addr, port, IPPROTO_UDP, &family);
+	fd = do_bind(addr, port, IPPROTO_UDP, &family, false);
 	if (fd < 0) {
 		return -1;
 	}
@@ -2235,8 +4563,43 @@ socket_server_udp_listen(struct socket_server *ss, uintptr_t opaque, const char*
 	return id;
 }
 
+// connect an unix domain datagram socket, it's ready at once, so add it as an udp socket.
+static int
+udp_dial_unix(struct socket_server *ss, uintptr_t opaque, const char *path) {
+	struct sockaddr_un sa;
+	socklen_t len = unix_address(path, &sa);
+	if (len == 0)
+		return -1;
+	int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&sa, len) != 0) {
+		close(fd);
+		return -1;
+	}
+	sp_nonblocking(fd);
+	int id = reserve_id(ss);
+	if (id < 0) {
+		close(fd);
+		return -1;
+	}
+	struct request_package request;
+	request_init(&request);
+	request.u.udp.id = id;
+	request.u.udp.fd = fd;
+	request.u.udp.opaque = opaque;
+	request.u.udp.family = AF_UNIX;
+
+	send_request(ss, &request, 'U', sizeof(request.u.udp));
+	return id;
+}
+
 int
 socket_server_udp_dial(struct socket_server *ss, uintptr_t opaque, const char* addr, int port){
+	const char * path = unix_path(addr);
+	if (path) {
+		return udp_dial_unix(ss, opaque, path);
+	}
 	int status;
 	struct addrinfo ai_hints;
 	struct addrinfo *ai_list = NULL;
@@ -2294,7 +4657,7 @@ socket_server_udp_dial(struct socket_server *ss, uintptr_t opaque, const char* a
 int
 socket_server_udp_send(struct socket_server *ss, const struct socket_udp_address *addr, struct socket_sendbuffer *buf) {
 	int id = buf->id;
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		free_buffer(ss, buf);
 		return -1;
@@ -2330,7 +4693,7 @@ socket_server_udp_send(struct socket_server *ss, const struct socket_udp_address
 				so.free_func((void *)buf->buffer);
 				return -1;
 			}
-			int n = sendto(s->fd, so.buffer, so.sz, 0, &sa.s, sasz);
+			int n = udp_sendto(s, so.buffer, so.sz, &sa, sasz);
 			if (n >= 0) {
 				// sendto succ
 				stat_write(ss,s,n);
@@ -2356,7 +4719,7 @@ socket_server_udp_send(struct socket_server *ss, const struct socket_udp_address
 
 int
 socket_server_udp_connect(struct socket_server *ss, int id, const char * addr, int port) {
-	struct socket * s = &ss->slot[HASH_ID(id)];
+	struct socket * s = get_socket(ss, id);
 	if (socket_invalid(s, id)) {
 		return -1;
 	}
@@ -2421,6 +4784,9 @@ socket_server_udp_address(struct socket_server *ss, struct socket_message *msg,
 	case PROTOCOL_UDPv6:
 		*addrsz = 1+2+16;  // IPv6 地址长度：1字节类型 + 2字节端口 + 16字节IPv6地址
 		break;
+	case PROTOCOL_UNIX:
+		*addrsz = 1; // unix domain datagram：只有 1 字节类型，回复时发给已连接的对端
+		break;
 	default:
 		return NULL; // 未知地址类型，返回空
 	}
@@ -2445,8 +4811,24 @@ socket_info_release(struct socket_info *si) {
 	}
 }
 
+static void
+query_tcpinfo(struct socket *s, struct socket_info *si) {
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+	if (getsockopt(s->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+		si->tcpinfo = 1;
+		si->rtt = ti.tcpi_rtt;
+		si->rttvar = ti.tcpi_rttvar;
+		si->retransmits = ti.tcpi_total_retrans;
+		si->cwnd = ti.tcpi_snd_cwnd;
+		si->unacked = ti.tcpi_unacked;
+	}
+#endif
+}
+
 static int
-query_info(struct socket *s, struct socket_info *si) {
+query_info(struct socket *s, struct socket_info *si, int tcpinfo) {
 	union sockaddr_all u;
 	socklen_t slen = sizeof(u);
 	int closing = 0;
@@ -2458,7 +4840,7 @@ query_info(struct socket *s, struct socket_info *si) {
 	case SOCKET_TYPE_LISTEN:
 		si->type = SOCKET_INFO_LISTEN;
 		if (getsockname(s->fd, &u.s, &slen) == 0) {
-			getname(&u, si->name, sizeof(si->name));
+			getname(&u, slen, si->name, sizeof(si->name));
 		}
 		break;
 	case SOCKET_TYPE_HALFCLOSE_READ:
@@ -2468,12 +4850,16 @@ query_info(struct socket *s, struct socket_info *si) {
 		if (s->protocol == PROTOCOL_TCP) {
 			si->type = closing ? SOCKET_INFO_CLOSING : SOCKET_INFO_TCP;
 			if (getpeername(s->fd, &u.s, &slen) == 0) {
-				getname(&u, si->name, sizeof(si->name));
+				getname(&u, slen, si->name, sizeof(si->name));
+			}
+			if (tcpinfo) {
+				query_tcpinfo(s, si);
 			}
 		} else {
 			si->type = SOCKET_INFO_UDP;
-			if (udp_socket_address(s, s->p.udp_address, &u)) {
-				getname(&u, si->name, sizeof(si->name));
+			slen = udp_socket_address(s, s->p.udp_address, &u);
+			if (slen) {
+				getname(&u, slen, si->name, sizeof(si->name));
 			}
 		}
 		break;
@@ -2486,6 +4872,7 @@ query_info(struct socket *s, struct socket_info *si) {
 	si->write = s->stat.write;
 	si->rtime = s->stat.rtime;
 	si->wtime = s->stat.wtime;
+	si->wcall = s->stat.wcall;
 	si->wbuffer = s->wb_size;
 	si->reading = s->reading;
 	si->writing = s->writing;
@@ -2494,14 +4881,16 @@ query_info(struct socket *s, struct socket_info *si) {
 }
 
 struct socket_info *
-socket_server_info(struct socket_server *ss) {
+socket_server_info(struct socket_server *ss, int tcpinfo) {
 	int i;
 	struct socket_info * si = NULL;
-	for (i=0;i<MAX_SOCKET;i++) {
-		struct socket * s = &ss->slot[i];
+	int n = ATOM_LOAD(&ss->slot_n);
+	for (i=0;i<n;i++) {
+		struct socket * s = slot_index(ss, i);
 		int id = s->id;
 		struct socket_info temp;
-		if (query_info(s, &temp) && s->id == id) {
+		temp.tcpinfo = 0;
+		if (query_info(s, &temp, tcpinfo) && s->id == id) {
 			// socket_server_info may call in different thread, so check socket id again
 			si = socket_info_create(si);
 			temp.next = si->next;
@@ -2510,3 +4899,17 @@ socket_server_info(struct socket_server *ss) {
 	}
 	return si;
 }
+
+struct socket_info *
+socket_server_info_id(struct socket_server *ss, int id, int tcpinfo) {
+	struct socket * s = get_socket(ss, id);
+	struct socket_info temp;
+	temp.tcpinfo = 0;
+	if (s->id == id && query_info(s, &temp, tcpinfo) && s->id == id) {
+		struct socket_info * si = socket_info_create(NULL);
+		temp.next = si->next;
+		*si = temp;
+		return si;
+	}
+	return NULL;
+}
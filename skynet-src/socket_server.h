@@ -13,6 +13,8 @@
 #define SOCKET_EXIT 5
 #define SOCKET_UDP 6
 #define SOCKET_WARNING 7
+#define SOCKET_FRAME 10
+#define SOCKET_UDPBATCH 11
 
 // Only for internal use
 #define SOCKET_RST 8
@@ -27,7 +29,12 @@ struct socket_message {
 	char * data;
 };
 
-struct socket_server * socket_server_create(uint64_t time);
+// max_socket is rounded up to power of 2 (<= 2^24), 0 for default (65536). The socket table grows by segment up to it.
+struct socket_server * socket_server_create(uint64_t time, int max_socket);
+// Low latency mode, call it before the socket thread starts : the socket thread polls with zero timeout for spin microseconds
+// before blocking, and set SO_BUSY_POLL (microseconds, linux only) of the new sockets if busy_poll > 0.
+void socket_server_busypoll(struct socket_server *, int spin, int busy_poll);
+void socket_server_pollstat(struct socket_server *, struct socket_poll_stat *);
 void socket_server_release(struct socket_server *);
 void socket_server_updatetime(struct socket_server *, uint64_t time);
 int socket_server_poll(struct socket_server *, struct socket_message *result, int *more);
@@ -41,14 +48,35 @@ void socket_server_pause(struct socket_server *, uintptr_t opaque, int id);
 // return -1 when error
 int socket_server_send(struct socket_server *, struct socket_sendbuffer *buffer);
 int socket_server_send_lowpriority(struct socket_server *, struct socket_sendbuffer *buffer);
+// send the same buffer (allocated by skynet_malloc, owned by socket server) to n tcp sockets.
+// The buffer is shared by all the sockets with a reference count, and it's never copied.
+void socket_server_multicast(struct socket_server *, const void *buffer, size_t sz, const int *ids, int n);
+// send sz bytes of file fd from offset, after the data sent before. fd will be closed by socket server.
+int socket_server_sendfile(struct socket_server *, int id, int fd, int64_t offset, int64_t sz);
 
 // ctrl command below returns id
 int socket_server_listen(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
+// listen with SO_REUSEPORT, several listen sockets (in different services) can share one port, the kernel balances the connections.
+int socket_server_listen_reuseport(struct socket_server *, uintptr_t opaque, const char * addr, int port, int backlog);
 int socket_server_connect(struct socket_server *, uintptr_t opaque, const char * addr, int port);
 int socket_server_bind(struct socket_server *, uintptr_t opaque, int fd);
 
 // for tcp
 void socket_server_nodelay(struct socket_server *, int id);
+// Coalesce small writes : the data is not written by the sender directly, but by socket thread with one writev in next poll cycle,
+// or at once when the pending bytes >= size. size = 0 turns it off.
+void socket_server_coalesce(struct socket_server *, int id, int size);
+// Send the buffers not less than size with MSG_ZEROCOPY (linux only), size = 0 turns it off.
+// The buffer is freed after the kernel reports the completion by the error queue of the socket.
+void socket_server_zerocopy(struct socket_server *, int id, int size);
+// Token bucket rate limit (per second, 0 for unlimited) of read bytes, read packets and write bytes.
+// The socket stops reading (or writing) when it exceeds the limit, and resumes when the tokens are refilled.
+void socket_server_ratelimit(struct socket_server *, int id, int read, int packet, int write);
+// Split the stream into frames by a big-endian length header (header = 2 or 4 bytes, 0 turns it off) in socket thread.
+// If batch is 0, each frame without header is reported as SOCKET_FRAME; otherwise the complete frames (with headers)
+// of one read are reported as one SOCKET_DATA. A frame larger than max (<= 0 for the limit of header) raises SOCKET_ERR.
+// Call it before socket_server_start, the uncomplete frame is discarded when it turns off.
+void socket_server_frame(struct socket_server *, int id, int header, int max, int batch);
 
 struct socket_udp_address;
 
@@ -68,6 +96,9 @@ int socket_server_udp_listen(struct socket_server *ss, uintptr_t opaque, const c
 int socket_server_udp_send(struct socket_server *, const struct socket_udp_address *, struct socket_sendbuffer *buffer);
 // extract the address of the message, struct socket_message * should be SOCKET_UDP
 const struct socket_udp_address * socket_server_udp_address(struct socket_server *, struct socket_message *, int *addrsz);
+// Report the datagrams of one read (recvmmsg) as one SOCKET_UDPBATCH message instead of one SOCKET_UDP for each, batch = 0 turns it off.
+// The message is a list of records : 2 bytes size of payload (big-endian), the udp address (see socket_server_udp_address), payload.
+void socket_server_udp_batch(struct socket_server *, int id, int batch);
 
 struct socket_object_interface {
 	const void * (*buffer)(const void *);
@@ -78,6 +109,34 @@ struct socket_object_interface {
 // if you send package with type SOCKET_BUFFER_OBJECT, use soi.
 void socket_server_userobject(struct socket_server *, struct socket_object_interface *soi);
 
-struct socket_info * socket_server_info(struct socket_server *);
+#define SOCKET_TLS_CLOSE (-1)
+#define SOCKET_TLS_ERROR (-2)
+
+// A TLS layer (see ltls.c) of tcp socket, all the functions are called in socket thread.
+struct socket_tls_interface {
+	// feed the encoded data read from socket, returns 0, or SOCKET_TLS_ERROR
+	int (*input)(void *tls, const void *data, int sz);
+	// decode at most sz bytes into buffer, returns the size (0 if it needs more input), SOCKET_TLS_CLOSE or SOCKET_TLS_ERROR
+	int (*read)(void *tls, void *buffer, int sz);
+	// encode the data, returns sz, 0 if the handshake is not finished, or SOCKET_TLS_ERROR
+	int (*write)(void *tls, const void *data, int sz);
+	// the size of encoded data to send, and move them into buffer
+	int (*pending)(void *tls);
+	int (*output)(void *tls, void *buffer, int sz);
+	// close notify
+	void (*shutdown)(void *tls);
+	void (*release)(void *tls);
+};
+
+// Attach a tls layer to the socket, the socket server owns tls after this call and releases it by i->release.
+// The data read is decoded and the data sent is encoded in socket thread, so the services read and write plaintext.
+// Call it before socket_server_start for the server side, or after connected for the client side (the client hello is sent at once).
+// The interface i must be valid until the socket server exits.
+void socket_server_tls(struct socket_server *, int id, void *tls, const struct socket_tls_interface *i);
+
+// tcpinfo : sample rtt, retransmits, cwnd, etc. of tcp connections by TCP_INFO (one more syscall for each connection)
+struct socket_info * socket_server_info(struct socket_server *, int tcpinfo);
+// the info of one socket, NULL if id is not a socket in use
+struct socket_info * socket_server_info_id(struct socket_server *, int id, int tcpinfo);
 
 #endif
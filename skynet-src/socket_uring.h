@@ -0,0 +1,1055 @@
+#ifndef poll_socket_uring_h
+#define poll_socket_uring_h
+
+// io_uring backend of socket_poll.h , build with -DUSE_IO_URING (linux 5.6+, the completion mode needs 6.0+).
+//
+// Completion mode (SP_COMPLETION) :
+//   Stream sockets (sp_stream) receive by a multishot IORING_OP_RECV into a ring of provided buffers, the data
+//   is queued for each fd and copied out by sp_read, so there is no read syscall.
+//   Listen sockets (sp_listen) accept by a multishot IORING_OP_ACCEPT, sp_accept takes the queued fds.
+//   The writes of socket thread (sp_send) are queued as IORING_OP_SENDMSG with MSG_DONTWAIT, they are submitted
+//   with the wait in one io_uring_enter and done inline (the data is copied before io_uring_enter returns),
+//   the result is reported by a write event (see sp_sendstate). POLLOUT is polled only when the kernel buffer is full.
+// Readiness mode :
+//   The other fds (connecting sockets, ctrl eventfd, udp and bind fds), and all the fds when the kernel doesn't
+//   support provided buffer ring, keep the level triggered model of epoll : every fd has at most one oneshot
+//   IORING_OP_POLL_ADD in flight, and it is re-armed in the next sp_wait.
+// sp_wait reports an fd again while it has queued data (level triggered), and all the requests are submitted
+// with the wait, so sp_enable costs no syscall.
+
+#include <netdb.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <linux/io_uring.h>
+
+#include "skynet_malloc.h"
+
+#define SP_COMPLETION
+
+#define URING_ENTRIES 1024
+#define URING_CQ_ENTRIES 4096
+// provided buffers for recv (power of 2)
+#define URING_BUF_COUNT 512
+#define URING_BUF_SIZE 8192
+#define URING_BUF_GROUP 0
+// concurrent sends and the max buffers of one send
+#define URING_SEND_SLOTS 256
+#define URING_SEND_IOV 64
+
+// user_data : type (4 bits) | gen (28 bits) | fd (32 bits)
+#define URING_POLL 0
+#define URING_RECV 1
+#define URING_ACCEPT 2
+#define URING_SEND 3	// the fd is the index of send slot
+#define URING_CANCEL 4
+#define URING_GEN_MASK 0x0fffffff
+
+#define URING_MODE_POLL 0
+#define URING_MODE_STREAM 1
+#define URING_MODE_LISTEN 2
+
+#define uring_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define uring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+// the accepted fds (or -errno) of a listen socket
+struct uring_accept {
+	int head;
+	int n;
+	int cap;
+	int fd[1];
+};
+
+struct uring_fd {
+	void * ud;
+	uint32_t gen;	// increased when the poll request is removed, so stale completions can be ignored
+	uint32_t life;	// increased by sp_add and sp_del, the completions of recv/accept/send with an old life are stale
+	short mask;	// the events of poll request : POLLIN / POLLOUT / POLLERR
+	uint8_t mode;	// URING_MODE_*
+	bool armed;	// a poll request is in flight
+	bool dirty;	// in the rearm list
+	bool rd;	// read enabled
+	bool wr;	// write enabled
+	bool kick;	// completion mode : report a write event in next sp_wait (write is enabled)
+	bool wait_out;	// completion mode : the kernel buffer is full, poll POLLOUT
+	bool errq;	// completion mode : poll POLLERR for the error queue (MSG_ZEROCOPY)
+	bool multi;	// multishot recv/accept in flight
+	bool cancel;	// multishot recv/accept is canceled
+	bool eof;	// recv is finished, err is 0 for eof or errno
+	bool send_busy;	// a send in flight
+	bool send_done;	// the result of send (send_res) is not taken by sp_sendstate
+	int err;
+	int send_res;
+	size_t send_len;
+	uint32_t ev_seq;	// e[ev_idx] is the event of this fd when ev_seq == wait_seq
+	int ev_idx;
+	// received data : provided buffers linked by buf_next, read from rq_off of rq_head
+	int rq_head;
+	int rq_tail;
+	int rq_off;
+	// the data copied from provided buffers when read is disabled, so the buffers are not held by a paused socket
+	char * spill;
+	int spill_sz;
+	int spill_off;
+	struct uring_accept * aq;
+};
+
+struct uring_send {
+	struct msghdr msg;
+	struct iovec iov[URING_SEND_IOV];
+	int sock;
+	uint32_t life;
+	int next;	// free list
+};
+
+struct uring_poll {
+	int ring_fd;
+	// submission ring
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned sq_pending;
+	// completion ring
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	// mmap regions
+	void *sq_ptr;
+	size_t sq_sz;
+	void *cq_ptr;
+	size_t cq_sz;
+	size_t sqes_sz;
+	// fd table
+	struct uring_fd *fds;
+	int fds_cap;
+	int *rearm;
+	int rearm_n;
+	uint32_t wait_seq;
+	// completion mode, NULL buffer ring for readiness mode
+	struct io_uring_buf_ring *br;
+	uint16_t br_tail;
+	char *bufs;
+	int buf_next[URING_BUF_COUNT];
+	int buf_len[URING_BUF_COUNT];
+	bool multi_recv;
+	bool multi_accept;
+	struct uring_send *send;
+	int send_free;
+};
+
+static bool
+sp_invalid(struct uring_poll *u) {
+	return u == NULL;
+}
+
+static void
+uring_unmap(struct uring_poll *u) {
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_sz);
+	if (u->cq_ptr && u->cq_ptr != u->sq_ptr)
+		munmap(u->cq_ptr, u->cq_sz);
+	if (u->sq_ptr)
+		munmap(u->sq_ptr, u->sq_sz);
+	if (u->br)
+		munmap(u->br, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+}
+
+static inline void
+uring_buf_recycle(struct uring_poll *u, int bid) {
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUF_COUNT - 1)];
+	b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUF_SIZE);
+	b->len = URING_BUF_SIZE;
+	b->bid = bid;
+	++u->br_tail;
+	uring_store_release(&u->br->tail, u->br_tail);
+}
+
+// register the provided buffer ring, returns false if the kernel doesn't support it (before 5.19)
+static bool
+uring_completion_init(struct uring_poll *u) {
+	void *br = mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (br == MAP_FAILED)
+		return false;
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)br;
+	reg.ring_entries = URING_BUF_COUNT;
+	reg.bgid = URING_BUF_GROUP;
+	if (syscall(__NR_io_uring_register, u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+		munmap(br, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+		return false;
+	}
+	u->br = br;
+	u->bufs = skynet_malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+	int i;
+	for (i=0;i<URING_BUF_COUNT;i++) {
+		uring_buf_recycle(u, i);
+	}
+	u->send = skynet_malloc(URING_SEND_SLOTS * sizeof(struct uring_send));
+	for (i=0;i<URING_SEND_SLOTS;i++) {
+		u->send[i].next = i + 1 < URING_SEND_SLOTS ? i + 1 : -1;
+	}
+	u->send_free = 0;
+	u->multi_recv = true;
+	u->multi_accept = true;
+	return true;
+}
+
+static struct uring_poll *
+sp_create() {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+	int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0)
+		return NULL;
+	struct uring_poll *u = skynet_malloc(sizeof(*u));
+	memset(u, 0, sizeof(*u));
+	u->ring_fd = fd;
+	u->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_sz > u->sq_sz)
+			u->sq_sz = u->cq_sz;
+		u->cq_sz = u->sq_sz;
+	}
+	u->sq_ptr = mmap(NULL, u->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (u->sq_ptr == MAP_FAILED) {
+		u->sq_ptr = NULL;
+		goto _failed;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ptr = u->sq_ptr;
+	} else {
+		u->cq_ptr = mmap(NULL, u->cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (u->cq_ptr == MAP_FAILED) {
+			u->cq_ptr = NULL;
+			goto _failed;
+		}
+	}
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		goto _failed;
+	}
+	char *sq = u->sq_ptr;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	char *cq = u->cq_ptr;
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	u->wait_seq = 1;
+	// readiness mode only if it fails
+	uring_completion_init(u);
+	return u;
+_failed:
+	uring_unmap(u);
+	close(fd);
+	skynet_free(u);
+	return NULL;
+}
+
+// release the received data and the accepted fds of f
+static void
+uring_clear(struct uring_poll *u, struct uring_fd *f) {
+	while (f->rq_head >= 0) {
+		int bid = f->rq_head;
+		f->rq_head = u->buf_next[bid];
+		uring_buf_recycle(u, bid);
+	}
+	f->rq_tail = -1;
+	f->rq_off = 0;
+	skynet_free(f->spill);
+	f->spill = NULL;
+	f->spill_sz = f->spill_off = 0;
+	if (f->aq) {
+		int i;
+		for (i=f->aq->head;i<f->aq->n;i++) {
+			if (f->aq->fd[i] >= 0)
+				close(f->aq->fd[i]);
+		}
+		skynet_free(f->aq);
+		f->aq = NULL;
+	}
+}
+
+static void
+sp_release(struct uring_poll *u) {
+	int i;
+	for (i=0;i<u->fds_cap;i++) {
+		struct uring_fd *f = &u->fds[i];
+		if (f->mode != URING_MODE_POLL) {
+			skynet_free(f->spill);
+			if (f->aq) {
+				int j;
+				for (j=f->aq->head;j<f->aq->n;j++) {
+					if (f->aq->fd[j] >= 0)
+						close(f->aq->fd[j]);
+				}
+				skynet_free(f->aq);
+			}
+		}
+	}
+	uring_unmap(u);
+	close(u->ring_fd);
+	skynet_free(u->bufs);
+	skynet_free(u->send);
+	skynet_free(u->fds);
+	skynet_free(u->rearm);
+	skynet_free(u);
+}
+
+static int
+uring_enter(struct uring_poll *u, unsigned min_complete) {
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+	for (;;) {
+		int r = (int)syscall(__NR_io_uring_enter, u->ring_fd, u->sq_pending, min_complete, flags, NULL, 0);
+		if (r < 0) {
+			if (errno == EINTR && min_complete == 0)
+				continue;
+			return -1;
+		}
+		if ((unsigned)r >= u->sq_pending) {
+			u->sq_pending = 0;
+		} else {
+			u->sq_pending -= r;
+		}
+		return 0;
+	}
+}
+
+static struct io_uring_sqe *
+uring_sqe(struct uring_poll *u) {
+	unsigned tail = *u->sq_tail;
+	if (tail - uring_load_acquire(u->sq_head) > *u->sq_mask) {
+		// submission ring is full, submit now
+		uring_enter(u, 0);
+		if (tail - uring_load_acquire(u->sq_head) > *u->sq_mask)
+			return NULL;
+	}
+	unsigned idx = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[idx] = idx;
+	uring_store_release(u->sq_tail, tail + 1);
+	++u->sq_pending;
+	return sqe;
+}
+
+static inline uint64_t
+uring_userdata(int type, uint32_t gen, int sock) {
+	return (uint64_t)type << 60 | (uint64_t)(gen & URING_GEN_MASK) << 32 | (uint32_t)sock;
+}
+
+static inline uint32_t
+uring_pollmask(short mask) {
+	uint32_t m = (uint16_t)mask;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	m = __swahw32(m);
+#endif
+	return m;
+}
+
+static bool
+uring_poll_add(struct uring_poll *u, int sock, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL)
+		return false;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sock;
+	sqe->poll32_events = uring_pollmask(f->mask);
+	sqe->user_data = uring_userdata(URING_POLL, f->gen, sock);
+	f->armed = true;
+	return true;
+}
+
+static void
+uring_poll_remove(struct uring_poll *u, int sock, struct uring_fd *f) {
+	if (f->armed) {
+		struct io_uring_sqe *sqe = uring_sqe(u);
+		if (sqe) {
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = uring_userdata(URING_POLL, f->gen, sock);
+			sqe->user_data = uring_userdata(URING_CANCEL, 0, sock);
+		}
+		f->armed = false;
+	}
+	++f->gen;
+}
+
+// arm multishot recv (stream) or accept (listen)
+static bool
+uring_multi(struct uring_poll *u, int sock, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL)
+		return false;
+	sqe->fd = sock;
+	if (f->mode == URING_MODE_STREAM) {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUF_GROUP;
+		sqe->user_data = uring_userdata(URING_RECV, f->life, sock);
+	} else {
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->user_data = uring_userdata(URING_ACCEPT, f->life, sock);
+	}
+	f->multi = true;
+	f->cancel = false;
+	return true;
+}
+
+// cancel the multishot recv/accept, the last completion (without IORING_CQE_F_MORE) clears f->multi
+static bool
+uring_cancel(struct uring_poll *u, int sock, struct uring_fd *f) {
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL)
+		return false;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = uring_userdata(f->mode == URING_MODE_STREAM ? URING_RECV : URING_ACCEPT, f->life, sock);
+	sqe->user_data = uring_userdata(URING_CANCEL, 0, sock);
+	f->cancel = true;
+	return true;
+}
+
+static void
+uring_mark(struct uring_poll *u, int sock, struct uring_fd *f) {
+	if (!f->dirty) {
+		f->dirty = true;
+		u->rearm[u->rearm_n++] = sock;
+	}
+}
+
+// the events of poll request
+static short
+uring_mask(struct uring_fd *f) {
+	switch (f->mode) {
+	case URING_MODE_STREAM:
+		return ((f->wr && f->wait_out) ? POLLOUT : 0) | (f->errq ? POLLERR : 0);
+	case URING_MODE_LISTEN:
+		return 0;
+	default:
+		return (f->rd ? POLLIN : 0) | (f->wr ? POLLOUT : 0);
+	}
+}
+
+// update the poll request in next sp_wait
+static void
+uring_update(struct uring_poll *u, int sock, struct uring_fd *f) {
+	short mask = uring_mask(f);
+	if (f->mask != mask) {
+		uring_poll_remove(u, sock, f);
+		f->mask = mask;
+	}
+	uring_mark(u, sock, f);
+}
+
+static inline bool
+uring_readable(struct uring_fd *f) {
+	if (f->mode == URING_MODE_STREAM)
+		return f->rq_head >= 0 || f->spill_off < f->spill_sz || f->eof;
+	if (f->mode == URING_MODE_LISTEN)
+		return f->aq && f->aq->head < f->aq->n;
+	return false;
+}
+
+// copy the received data out of the provided buffers
+static void
+uring_spill(struct uring_poll *u, struct uring_fd *f) {
+	int sz = f->spill_sz - f->spill_off;
+	int bid;
+	for (bid = f->rq_head; bid >= 0; bid = u->buf_next[bid]) {
+		sz += u->buf_len[bid];
+	}
+	sz -= f->rq_off;
+	char *spill = skynet_malloc(sz);
+	int n = f->spill_sz - f->spill_off;
+	if (n > 0)
+		memcpy(spill, f->spill + f->spill_off, n);
+	skynet_free(f->spill);
+	while (f->rq_head >= 0) {
+		bid = f->rq_head;
+		int len = u->buf_len[bid] - f->rq_off;
+		memcpy(spill + n, u->bufs + (size_t)bid * URING_BUF_SIZE + f->rq_off, len);
+		n += len;
+		f->rq_off = 0;
+		f->rq_head = u->buf_next[bid];
+		uring_buf_recycle(u, bid);
+	}
+	f->rq_tail = -1;
+	f->spill = spill;
+	f->spill_sz = sz;
+	f->spill_off = 0;
+}
+
+static struct uring_fd *
+uring_getfd(struct uring_poll *u, int sock) {
+	if (sock >= u->fds_cap) {
+		int cap = u->fds_cap ? u->fds_cap : 1024;
+		while (cap <= sock)
+			cap *= 2;
+		u->fds = skynet_realloc(u->fds, cap * sizeof(struct uring_fd));
+		memset(u->fds + u->fds_cap, 0, (cap - u->fds_cap) * sizeof(struct uring_fd));
+		int i;
+		for (i=u->fds_cap;i<cap;i++) {
+			u->fds[i].rq_head = -1;
+			u->fds[i].rq_tail = -1;
+		}
+		u->rearm = skynet_realloc(u->rearm, cap * sizeof(int));
+		u->fds_cap = cap;
+	}
+	return &u->fds[sock];
+}
+
+// the event of fd in this sp_wait, NULL if e is full
+static struct event *
+uring_event(struct uring_poll *u, struct uring_fd *f, struct event *e, int max, int *n) {
+	if (f->ev_seq == u->wait_seq)
+		return &e[f->ev_idx];
+	if (*n >= max)
+		return NULL;
+	struct event *ev = &e[*n];
+	f->ev_seq = u->wait_seq;
+	f->ev_idx = (*n)++;
+	ev->s = f->ud;
+	ev->read = false;
+	ev->write = false;
+	ev->error = false;
+	ev->eof = false;
+	return ev;
+}
+
+// reset the fd state, the completions of the last life are stale
+static void
+uring_reset(struct uring_poll *u, int sock, struct uring_fd *f) {
+	uring_poll_remove(u, sock, f);
+	if (f->multi && !f->cancel)
+		uring_cancel(u, sock, f);
+	uring_clear(u, f);
+	++f->life;
+	f->ud = NULL;
+	f->mask = 0;
+	f->mode = URING_MODE_POLL;
+	f->rd = false;
+	f->wr = false;
+	f->kick = false;
+	f->wait_out = false;
+	f->errq = false;
+	f->multi = false;
+	f->cancel = false;
+	f->eof = false;
+	f->err = 0;
+	f->send_busy = false;
+	f->send_done = false;
+	f->rq_head = -1;
+	f->rq_tail = -1;
+}
+
+static int
+sp_add(struct uring_poll *u, int sock, void *ud) {
+	if (sock < 0)
+		return 1;
+	struct uring_fd *f = uring_getfd(u, sock);
+	uring_reset(u, sock, f);
+	f->ud = ud;
+	f->rd = true;
+	f->mask = POLLIN;
+	uring_mark(u, sock, f);
+	return 0;
+}
+
+static void
+sp_del(struct uring_poll *u, int sock) {
+	if (sock < 0 || sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	bool flush = f->armed || f->multi || f->send_busy;
+	uring_reset(u, sock, f);
+	if (flush) {
+		// The requests hold a reference of the file, remove them now because the fd will be closed soon.
+		// A send queued is done (copied) in io_uring_enter, so its buffers can be released after sp_del.
+		while (u->sq_pending && uring_enter(u, 0) == 0)
+			;
+	}
+}
+
+static int
+sp_enable(struct uring_poll *u, int sock, void *ud, bool read_enable, bool write_enable) {
+	if (sock < 0 || sock >= u->fds_cap)
+		return 1;
+	struct uring_fd *f = &u->fds[sock];
+	f->ud = ud;
+	if (f->mode != URING_MODE_POLL && write_enable && !f->wr) {
+		// try to send in next sp_wait, poll POLLOUT only if the kernel buffer is full
+		f->kick = true;
+	}
+	f->rd = read_enable;
+	f->wr = write_enable;
+	if (!write_enable)
+		f->kick = false;
+	uring_update(u, sock, f);
+	return 0;
+}
+
+static void
+sp_stream(struct uring_poll *u, int sock) {
+	if (!u->multi_recv || sock < 0 || sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	f->mode = URING_MODE_STREAM;
+	if (f->wr)
+		f->kick = true;
+	uring_update(u, sock, f);
+}
+
+static void
+sp_listen(struct uring_poll *u, int sock) {
+	if (!u->multi_accept || sock < 0 || sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	f->mode = URING_MODE_LISTEN;
+	uring_update(u, sock, f);
+}
+
+static void
+sp_errqueue(struct uring_poll *u, int sock) {
+	if (sock < 0 || sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	f->errq = true;
+	uring_update(u, sock, f);
+}
+
+// the kernel doesn't support the multishot request, turn the fd to readiness mode
+static void
+uring_fallback(struct uring_poll *u, int sock, struct uring_fd *f) {
+	if (f->mode == URING_MODE_STREAM) {
+		u->multi_recv = false;
+	} else {
+		u->multi_accept = false;
+	}
+	f->mode = URING_MODE_POLL;
+	f->kick = false;
+	uring_update(u, sock, f);
+}
+
+static ssize_t
+sp_read(struct uring_poll *u, int sock, void *buffer, size_t sz) {
+	if (sock >= u->fds_cap || u->fds[sock].mode != URING_MODE_STREAM)
+		return read(sock, buffer, sz);
+	struct uring_fd *f = &u->fds[sock];
+	char *p = buffer;
+	size_t n = 0;
+	if (f->spill) {
+		size_t len = f->spill_sz - f->spill_off;
+		if (len > sz)
+			len = sz;
+		memcpy(p, f->spill + f->spill_off, len);
+		n = len;
+		f->spill_off += len;
+		if (f->spill_off == f->spill_sz) {
+			skynet_free(f->spill);
+			f->spill = NULL;
+			f->spill_sz = f->spill_off = 0;
+		}
+	}
+	while (n < sz && f->rq_head >= 0) {
+		int bid = f->rq_head;
+		size_t len = u->buf_len[bid] - f->rq_off;
+		if (len > sz - n)
+			len = sz - n;
+		memcpy(p + n, u->bufs + (size_t)bid * URING_BUF_SIZE + f->rq_off, len);
+		n += len;
+		f->rq_off += len;
+		if (f->rq_off == u->buf_len[bid]) {
+			f->rq_off = 0;
+			f->rq_head = u->buf_next[bid];
+			if (f->rq_head < 0)
+				f->rq_tail = -1;
+			uring_buf_recycle(u, bid);
+		}
+	}
+	if (n > 0)
+		return n;
+	if (f->eof) {
+		if (f->err) {
+			errno = f->err;
+			return -1;
+		}
+		return 0;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+static int
+sp_accept(struct uring_poll *u, int sock, struct sockaddr *addr, socklen_t *len) {
+	if (sock >= u->fds_cap || u->fds[sock].mode != URING_MODE_LISTEN)
+		return accept(sock, addr, len);
+	struct uring_accept *aq = u->fds[sock].aq;
+	if (aq == NULL || aq->head == aq->n) {
+		errno = EAGAIN;
+		return -1;
+	}
+	int fd = aq->fd[aq->head++];
+	if (aq->head == aq->n)
+		aq->head = aq->n = 0;
+	if (fd < 0) {
+		errno = -fd;
+		return -1;
+	}
+	// multishot accept doesn't return the address
+	if (getpeername(fd, addr, len) != 0) {
+		addr->sa_family = AF_UNSPEC;
+	}
+	return fd;
+}
+
+static int
+sp_send(struct uring_poll *u, int sock, const struct iovec *iov, int n) {
+	if (sock >= u->fds_cap || u->send_free < 0)
+		return -1;
+	struct uring_fd *f = &u->fds[sock];
+	if (f->mode != URING_MODE_STREAM || f->send_busy || f->send_done)
+		return -1;
+	struct io_uring_sqe *sqe = uring_sqe(u);
+	if (sqe == NULL)
+		return -1;
+	int idx = u->send_free;
+	struct uring_send *sd = &u->send[idx];
+	u->send_free = sd->next;
+	if (n > URING_SEND_IOV)
+		n = URING_SEND_IOV;
+	size_t total = 0;
+	int i;
+	for (i=0;i<n;i++) {
+		sd->iov[i] = iov[i];
+		total += iov[i].iov_len;
+	}
+	memset(&sd->msg, 0, sizeof(sd->msg));
+	sd->msg.msg_iov = sd->iov;
+	sd->msg.msg_iovlen = n;
+	sd->sock = sock;
+	sd->life = f->life;
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = sock;
+	sqe->addr = (uint64_t)(uintptr_t)&sd->msg;
+	sqe->len = 1;
+	// MSG_DONTWAIT : returns -EAGAIN instead of waiting in kernel, so the send is done in io_uring_enter
+	sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+	sqe->user_data = uring_userdata(URING_SEND, 0, idx);
+	f->send_busy = true;
+	f->send_len = total;
+	return 0;
+}
+
+static int
+sp_sendstate(struct uring_poll *u, int sock, ssize_t *sz, size_t *total) {
+	if (sock >= u->fds_cap)
+		return SP_SEND_IDLE;
+	struct uring_fd *f = &u->fds[sock];
+	if (f->send_busy)
+		return SP_SEND_BUSY;
+	if (!f->send_done)
+		return SP_SEND_IDLE;
+	f->send_done = false;
+	*total = f->send_len;
+	if (f->send_res < 0) {
+		errno = -f->send_res;
+		*sz = -1;
+	} else {
+		*sz = f->send_res;
+	}
+	return SP_SEND_DONE;
+}
+
+static void
+uring_push_accept(struct uring_fd *f, int fd) {
+	struct uring_accept *aq = f->aq;
+	if (aq == NULL || aq->n == aq->cap) {
+		int cap = aq ? aq->cap * 2 : 16;
+		struct uring_accept *q = skynet_malloc(sizeof(*q) + (cap - 1) * sizeof(int));
+		q->head = 0;
+		q->n = 0;
+		q->cap = cap;
+		if (aq) {
+			q->n = aq->n - aq->head;
+			memcpy(q->fd, aq->fd + aq->head, q->n * sizeof(int));
+			skynet_free(aq);
+		}
+		f->aq = aq = q;
+	}
+	aq->fd[aq->n++] = fd;
+}
+
+static void
+uring_complete_recv(struct uring_poll *u, struct io_uring_cqe *cqe, int sock, uint32_t life, struct event *e, int max, int *n) {
+	int bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	struct uring_fd *f = sock < u->fds_cap ? &u->fds[sock] : NULL;
+	if (f == NULL || (f->life & URING_GEN_MASK) != life || f->mode != URING_MODE_STREAM) {
+		// stale
+		if (bid >= 0)
+			uring_buf_recycle(u, bid);
+		return;
+	}
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		f->multi = false;
+	int res = cqe->res;
+	if (res > 0 && bid >= 0) {
+		u->buf_len[bid] = res;
+		u->buf_next[bid] = -1;
+		if (f->rq_tail >= 0) {
+			u->buf_next[f->rq_tail] = bid;
+		} else {
+			f->rq_head = bid;
+		}
+		f->rq_tail = bid;
+	} else {
+		if (bid >= 0)
+			uring_buf_recycle(u, bid);
+		if (res == 0) {
+			f->eof = true;
+			f->err = 0;
+		} else if (res == -EINVAL && !f->eof && f->rq_head < 0 && f->spill == NULL) {
+			uring_fallback(u, sock, f);
+			struct event *ev = uring_event(u, f, e, max, n);
+			if (ev && f->rd)
+				ev->read = true;
+			return;
+		} else if (res != -ENOBUFS && res != -ECANCELED) {
+			// re-armed in next sp_wait for ENOBUFS (the buffers are held in this batch)
+			f->eof = true;
+			f->err = -res;
+		}
+	}
+	uring_mark(u, sock, f);
+	if (f->rd && uring_readable(f)) {
+		struct event *ev = uring_event(u, f, e, max, n);
+		if (ev)
+			ev->read = true;
+	}
+}
+
+static void
+uring_complete_accept(struct uring_poll *u, struct io_uring_cqe *cqe, int sock, uint32_t life, struct event *e, int max, int *n) {
+	struct uring_fd *f = sock < u->fds_cap ? &u->fds[sock] : NULL;
+	int res = cqe->res;
+	if (f == NULL || (f->life & URING_GEN_MASK) != life || f->mode != URING_MODE_LISTEN) {
+		// stale
+		if (res >= 0)
+			close(res);
+		return;
+	}
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+		f->multi = false;
+	if (res == -EINVAL && (f->aq == NULL || f->aq->head == f->aq->n)) {
+		uring_fallback(u, sock, f);
+	} else if (res != -ECANCELED) {
+		uring_push_accept(f, res);
+	}
+	uring_mark(u, sock, f);
+	if (f->rd && (f->mode == URING_MODE_POLL || uring_readable(f))) {
+		struct event *ev = uring_event(u, f, e, max, n);
+		if (ev)
+			ev->read = true;
+	}
+}
+
+static void
+uring_complete_send(struct uring_poll *u, struct io_uring_cqe *cqe, int idx, struct event *e, int max, int *n) {
+	struct uring_send *sd = &u->send[idx];
+	int sock = sd->sock;
+	uint32_t life = sd->life;
+	sd->next = u->send_free;
+	u->send_free = idx;
+	if (sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	if (f->life != life || !f->send_busy)
+		return;
+	f->send_busy = false;
+	f->send_done = true;
+	f->send_res = cqe->res;
+	if (cqe->res == -EAGAIN || (cqe->res >= 0 && (size_t)cqe->res < f->send_len)) {
+		// the kernel buffer is full
+		f->wait_out = true;
+	}
+	uring_update(u, sock, f);
+	struct event *ev = uring_event(u, f, e, max, n);
+	if (ev)
+		ev->write = true;
+}
+
+static void
+uring_complete_poll(struct uring_poll *u, struct io_uring_cqe *cqe, int sock, uint32_t gen, struct event *e, int max, int *n) {
+	if (sock >= u->fds_cap)
+		return;
+	struct uring_fd *f = &u->fds[sock];
+	if ((f->gen & URING_GEN_MASK) != gen) {
+		// removed by sp_del or sp_enable
+		return;
+	}
+	f->armed = false;
+	uring_mark(u, sock, f);
+	struct event *ev = uring_event(u, f, e, max, n);
+	if (ev == NULL)
+		return;
+	if (cqe->res < 0) {
+		ev->error = true;
+		return;
+	}
+	unsigned flag = (unsigned)cqe->res;
+	if (f->mode == URING_MODE_STREAM) {
+		// the data and eof are reported by recv
+		if (flag & POLLOUT) {
+			f->wait_out = false;
+			ev->write = true;
+			uring_update(u, sock, f);
+		}
+		if (flag & POLLERR) {
+			ev->error = true;
+		} else if ((flag & POLLHUP) && !(flag & POLLOUT)) {
+			// don't poll the error queue of a dead connection
+			f->errq = false;
+			uring_update(u, sock, f);
+		}
+		return;
+	}
+	ev->write = (flag & POLLOUT) != 0;
+	ev->read = (flag & POLLIN) != 0;
+	ev->error = (flag & POLLERR) != 0;
+	ev->eof = (flag & POLLHUP) != 0;
+}
+
+// arm the requests of the fds in rearm list, and report the fds which have queued data (level triggered)
+static void
+uring_flush(struct uring_poll *u, struct event *e, int max, int *n) {
+	int count = u->rearm_n;
+	int k = 0;
+	int i;
+	for (i=0;i<count;i++) {
+		int sock = u->rearm[i];
+		struct uring_fd *f = &u->fds[sock];
+		bool keep = false;
+		if (f->mask && !f->armed && !uring_poll_add(u, sock, f)) {
+			// the submission ring is full, retry in next sp_wait
+			keep = true;
+		}
+		if (f->mode != URING_MODE_POLL) {
+			bool want = f->rd && !f->eof;
+			if (want) {
+				if (!f->multi && !uring_multi(u, sock, f))
+					keep = true;
+			} else if (f->multi && !f->cancel) {
+				if (!uring_cancel(u, sock, f))
+					keep = true;
+			}
+			if (!f->rd && f->rq_head >= 0) {
+				uring_spill(u, f);
+			}
+			bool readable = f->rd && uring_readable(f);
+			if (readable || f->kick) {
+				struct event *ev = uring_event(u, f, e, max, n);
+				if (ev) {
+					ev->read |= readable;
+					ev->write |= f->kick;
+					f->kick = false;
+				}
+				// check it again in next sp_wait
+				keep = true;
+			}
+		}
+		if (keep) {
+			u->rearm[k++] = sock;
+		} else {
+			f->dirty = false;
+		}
+	}
+	// the fds marked during flush (by uring_sqe) are appended after count
+	for (i=count;i<u->rearm_n;i++) {
+		u->rearm[k++] = u->rearm[i];
+	}
+	u->rearm_n = k;
+}
+
+static int
+sp_wait(struct uring_poll *u, struct event *e, int max, int timeout) {
+	int n = 0;
+	++u->wait_seq;
+	for (;;) {
+		uring_flush(u, e, max, &n);
+		unsigned head = *u->cq_head;
+		if (head == uring_load_acquire(u->cq_tail) && n == 0 && timeout != 0) {
+			// only 0 (submit and don't wait) or infinite timeout is supported
+			if (uring_enter(u, 1))
+				return -1;
+		} else if (u->sq_pending) {
+			if (uring_enter(u, 0))
+				return -1;
+		}
+		unsigned tail = uring_load_acquire(u->cq_tail);
+		while (head != tail && n < max) {
+			struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+			++head;
+			uint64_t userdata = cqe->user_data;
+			int type = (int)(userdata >> 60);
+			uint32_t gen = (uint32_t)(userdata >> 32) & URING_GEN_MASK;
+			int sock = (int)(uint32_t)userdata;
+			switch (type) {
+			case URING_POLL:
+				uring_complete_poll(u, cqe, sock, gen, e, max, &n);
+				break;
+			case URING_RECV:
+				uring_complete_recv(u, cqe, sock, gen, e, max, &n);
+				break;
+			case URING_ACCEPT:
+				uring_complete_accept(u, cqe, sock, gen, e, max, &n);
+				break;
+			case URING_SEND:
+				uring_complete_send(u, cqe, sock, e, max, &n);
+				break;
+			default:
+				// URING_CANCEL
+				break;
+			}
+		}
+		uring_store_release(u->cq_head, head);
+		if (n > 0 || timeout == 0)
+			break;
+	}
+	return n;
+}
+
+static void
+sp_nonblocking(int fd) {
+	int flag = fcntl(fd, F_GETFL, 0);
+	if ( -1 == flag ) {
+		return;
+	}
+
+	fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+}
+
+#endif
@@ -0,0 +1,70 @@
+-- check the socket read buffer pool : a burst grows the read buffer to 64K, and the small reads after it
+-- shrink it again. The large blocks should go back to their own classes, so the next burst takes them from pool.
+-- usage : testbufferpool [rounds]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local rounds = ...
+rounds = tonumber(rounds) or 16
+
+local PORT = 8016
+local BURST = 1024 * 1024
+local SMALL = 100
+-- 11 classes (64B .. 64K), 1M for each central list and 64K (4 blocks at least) for each thread cache
+local POOL_LIMIT = 11 * 1024 * 1024 + (9 * 64 + 4 * 32 + 4 * 64) * 1024 * (tonumber(skynet.getenv "thread") + 1)
+
+local function connect()
+	local id = socket.listen("127.0.0.1", PORT)
+	local fd
+	socket.start(id, function(newfd)
+		socket.start(newfd)
+		fd = newfd
+	end)
+	local c = assert(socket.open("127.0.0.1", PORT))
+	socket.nodelay(c)
+	while not fd do
+		skynet.sleep(1)
+	end
+	socket.close(id)
+	return c, fd
+end
+
+-- returns the hits and allocs of the burst
+local function round(c, fd)
+	local burst = string.rep("x", BURST)
+	skynet.fork(function()
+		socket.write(c, burst)
+	end)
+	local s1 = socket.poolstat()
+	assert(socket.read(fd, BURST) == burst)
+	local s2 = socket.poolstat()
+	-- the read buffer shrinks by half for each small read
+	for i = 1, 64 do
+		local s = string.rep(tostring(i % 10), SMALL)
+		socket.write(c, s)
+		assert(socket.read(fd, SMALL) == s)
+	end
+	return s2.hit - s1.hit, s2.alloc - s1.alloc
+end
+
+skynet.start(function()
+	local c, fd = connect()
+	round(c, fd)
+	local hit, alloc = 0, 0
+	for i = 2, rounds do
+		local h, a = round(c, fd)
+		hit = hit + h
+		alloc = alloc + a
+	end
+	local stat = socket.poolstat()
+	hit = hit * 100 / alloc
+	print(string.format("burst hit %.2f%%, %d bytes in pool", hit, stat.bytes))
+	-- if a 64K block is filed by the bytes of a small read, it's not in the 64K class for the next burst
+	assert(hit > 75, "burst misses the pool")
+	assert(stat.bytes <= POOL_LIMIT, "pool grows")
+	socket.close(c)
+	socket.close(fd)
+	print("buffer pool ok")
+	skynet.exit()
+end)
@@ -0,0 +1,57 @@
+-- Round trip latency of socket thread, compare the config socket_spin = 0 and socket_spin = 50 (microseconds)
+-- usage : testbusypoll [count] [interval]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local driver = require "skynet.socketdriver"
+
+local count, interval = ...
+count = tonumber(count) or 2000
+interval = tonumber(interval) or 0	-- 1/100 second between the pings, so the socket thread may sleep
+
+local PORT = 8013
+
+local function percentile(t, p)
+	return t[math.max(1, math.floor(#t * p))]
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	socket.start(id, function(fd)
+		socket.start(fd)
+		driver.nodelay(fd)
+		while true do
+			local str = socket.read(fd)
+			if str then
+				socket.write(fd, str)
+			else
+				socket.close(fd)
+				return
+			end
+		end
+	end)
+	local c = assert(socket.open("127.0.0.1", PORT))
+	driver.nodelay(c)
+	local before = socket.pollstat()
+	local rtt = {}
+	for i = 1, count do
+		local t = skynet.hpc()
+		socket.write(c, "ping")
+		assert(socket.read(c, 4))
+		rtt[i] = (skynet.hpc() - t) / 1000	-- microseconds
+		if interval > 0 then
+			skynet.sleep(interval)
+		end
+	end
+	socket.close(c)
+	socket.close(id)
+	table.sort(rtt)
+	local stat = socket.pollstat()
+	local spin = stat.spin - before.spin
+	print(string.format("socket_spin = %s : rtt p50 %.1fus, p99 %.1fus, max %.1fus",
+		skynet.getenv "socket_spin" or 0, percentile(rtt, 0.5), percentile(rtt, 0.99), rtt[#rtt]))
+	print(string.format("spin %d, hit %d (%.2f%%), spin time %.1fms, block %d",
+		spin, stat.hit - before.hit, spin > 0 and (stat.hit - before.hit) * 100 / spin or 0,
+		(stat.spin_us - before.spin_us) / 1000, stat.block - before.block))
+	skynet.exit()
+end)
@@ -0,0 +1,150 @@
+-- check socket.contiguous : the received data is kept in one contiguous block instead of a list of nodes,
+-- and compare the read throughput of the two modes
+-- usage : testcontiguous [mbytes]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode, port, total, piece = ...
+
+local PORT = 8015
+
+if mode == "writer" then
+
+skynet.start(function()
+	total, piece = tonumber(total), tonumber(piece)
+	local c = socket.open("127.0.0.1", tonumber(port))
+	local data = string.rep(string.rep("x", 99) .. "\n", piece // 100 + 1):sub(1, piece)
+	socket.nodelay(c)
+	-- the small pieces arrive one by one
+	local yield = piece < 512 and 1 or 16
+	for i = 1, total // piece do
+		socket.write(c, data)
+		if i % yield == 0 then
+			skynet.sleep(0)
+		end
+	end
+	socket.close(c)
+	skynet.exit()
+end)
+
+else
+
+local mb = tonumber(mode) or 64
+
+local function listen()
+	local id = socket.listen("127.0.0.1", PORT)
+	local fd
+	socket.start(id, function(newfd)
+		socket.start(newfd)
+		fd = newfd
+	end)
+	return function()
+		while not fd do
+			skynet.sleep(1)
+		end
+		local ret = fd
+		fd = nil
+		return ret
+	end, id
+end
+
+local function random_string(n)
+	local t = {}
+	for i = 1, n do
+		t[i] = math.random(0, 9) == 0 and "\n" or string.char(math.random(97, 122))
+	end
+	return table.concat(t)
+end
+
+local function test_read(accept)
+	local data = random_string(512 * 1024)
+	for _, contiguous in ipairs { false, true, "later" } do
+		local c = socket.open("127.0.0.1", PORT)
+		local fd = accept()
+		if contiguous == true then
+			socket.contiguous(fd)
+		end
+		skynet.fork(function()
+			local i = 1
+			while i <= #data do
+				local n = math.random(1, 3000)
+				socket.write(c, data:sub(i, i + n - 1))
+				i = i + n
+				skynet.sleep(0)
+			end
+		end)
+		local pos = 1
+		local ops = 0
+		while pos <= #data do
+			ops = ops + 1
+			if contiguous == "later" and ops == 100 then
+				-- switch with buffered data
+				socket.contiguous(fd)
+			end
+			local r = math.random(1, 3)
+			if r == 1 then
+				local n = math.min(math.random(1, 10000), #data - pos + 1)
+				local s = socket.read(fd, n)
+				assert(s == data:sub(pos, pos + n - 1))
+				pos = pos + n
+			elseif r == 2 then
+				local e = data:find("\n", pos, true)
+				if e then
+					local s = socket.readline(fd)
+					assert(s == data:sub(pos, e - 1))
+					pos = e + 1
+				end
+			else
+				local s = socket.read(fd)
+				assert(s == data:sub(pos, pos + #s - 1))
+				pos = pos + #s
+			end
+		end
+		socket.close(c)
+		socket.close(fd)
+	end
+	print("read ok")
+end
+
+local function bench(accept, name, piece, read, total, wait)
+	local result = {}
+	for _, contiguous in ipairs { false, true } do
+		local writer = skynet.newservice(SERVICE_NAME, "writer", PORT, total or mb * 1024 * 1024, piece)
+		local fd = accept()
+		if contiguous then
+			socket.contiguous(fd)
+		end
+		if wait then
+			-- all the data is buffered before reading
+			skynet.sleep(wait)
+		end
+		local t = skynet.hpc()
+		local n = 0
+		while true do
+			local s = read(fd)
+			if not s then
+				break
+			end
+			n = n + #s
+		end
+		t = (skynet.hpc() - t) / 1e9
+		socket.close(fd)
+		table.insert(result, n / t / 1024 / 1024)
+	end
+	print(string.format("%-46s nodes %8.1f MB/s, contiguous %8.1f MB/s", name, result[1], result[2]))
+end
+
+skynet.start(function()
+	local accept, id = listen()
+	test_read(accept)
+	bench(accept, "read(64K) from 512 bytes packets", 512, function(fd) return socket.read(fd, 65536) end)
+	bench(accept, "read(64K) from 200K buffered 64 bytes packets", 64, function(fd) return socket.read(fd, 65536) end, 200 * 1024, 100)
+	bench(accept, "read(16) from 64K packets", 65536, function(fd) return socket.read(fd, 16) end)
+	bench(accept, "readline (100 bytes) from 4K packets", 4096, function(fd) return socket.readline(fd) end)
+	socket.close(id)
+	print("contiguous ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,214 @@
+-- check the length-prefixed framing in socket thread (socket.frame), with socket.read, gateserver and the C gate
+-- usage : testframe
+
+local skynet = require "skynet"
+
+local mode = ...
+
+-- each test listens on a new port, because the listen socket is closed asynchronously
+local PORT = 8006
+
+local function pack(header, s)
+	return string.pack(header == 2 and ">s2" or ">s4", s)
+end
+
+if mode == "gate" then
+
+-- gateserver registers the socket protocol itself, so don't require skynet.socket
+local gateserver = require "snax.gateserver"
+local netpack = require "skynet.netpack"
+
+local recv = {}
+local waiting
+
+local handler = {}
+
+function handler.connect(fd)
+	gateserver.openclient(fd)
+end
+
+function handler.message(fd, msg, sz)
+	table.insert(recv, netpack.tostring(msg, sz))
+	if waiting and #recv >= waiting.n then
+		skynet.wakeup(waiting.co)
+	end
+end
+
+local CMD = {}
+
+function CMD.wait(n)
+	if #recv < n then
+		waiting = { n = n, co = coroutine.running() }
+		skynet.wait(waiting.co)
+	end
+	return recv
+end
+
+function handler.command(cmd, source, ...)
+	return CMD[cmd](...)
+end
+
+gateserver.start(handler)
+
+return
+end
+
+local socket = require "skynet.socket"
+require "skynet.manager"	-- skynet.launch / skynet.kill
+
+-- frames of random size, sent in random pieces
+local function send_frames(fd, header, frames)
+	local stream = {}
+	for i, s in ipairs(frames) do
+		stream[i] = pack(header, s)
+	end
+	stream = table.concat(stream)
+	local i = 1
+	while i <= #stream do
+		local n = math.random(1, 300)
+		socket.write(fd, stream:sub(i, i + n - 1))
+		i = i + n
+		if math.random(4) == 1 then
+			skynet.sleep(0)
+		end
+	end
+end
+
+local function gen_frames(n, max)
+	local frames = {}
+	for i = 1, n do
+		local sz = math.random(0, max)
+		frames[i] = string.rep(string.char(65 + i % 26), sz)
+	end
+	return frames
+end
+
+local function test_read(header, batch)
+	PORT = PORT + 1
+	local id = socket.listen("127.0.0.1", PORT)
+	local frames = gen_frames(200, header == 2 and 1000 or 5000)
+	local co = coroutine.running()
+	local recv = {}
+	local done
+	socket.start(id, function(fd)
+		socket.frame(fd, header, nil, batch)
+		socket.start(fd)
+		if batch then
+			-- each read gets complete frames
+			while #recv < #frames do
+				local data = assert(socket.read(fd))
+				local pos = 1
+				while pos <= #data do
+					local s
+					s, pos = string.unpack(header == 2 and ">s2" or ">s4", data, pos)
+					table.insert(recv, s)
+				end
+			end
+		else
+			-- the frames without header are read as stream
+			recv = { assert(socket.read(fd, #table.concat(frames))) }
+			frames = { table.concat(frames) }
+		end
+		socket.close(fd)
+		done = true
+		skynet.wakeup(co)
+	end)
+	local c = socket.open("127.0.0.1", PORT)
+	send_frames(c, header, frames)
+	if not done then
+		skynet.wait(co)
+	end
+	socket.close(c)
+	socket.close(id)
+	assert(#recv == #frames)
+	for i = 1, #frames do
+		assert(recv[i] == frames[i], i)
+	end
+	print("socket.read", header, batch and "batch" or "frame", "ok")
+end
+
+local function test_gateserver(batch)
+	PORT = PORT + 1
+	local gate = skynet.newservice(SERVICE_NAME, "gate")
+	skynet.call(gate, "lua", "open", { address = "127.0.0.1", port = PORT, frame = batch and "batch" or true })
+	local frames = gen_frames(200, 1000)
+	local c = socket.open("127.0.0.1", PORT)
+	send_frames(c, 2, frames)
+	local recv = skynet.call(gate, "lua", "wait", #frames)
+	assert(#recv == #frames)
+	for i = 1, #frames do
+		assert(recv[i] == frames[i], i)
+	end
+	socket.close(c)
+	skynet.call(gate, "lua", "close")
+	skynet.kill(gate)
+	print("gateserver", batch and "batch" or "frame", "ok")
+end
+
+local function test_gate(header)
+	PORT = PORT + 1
+	local frames = gen_frames(100, 70000)
+	-- the gate ignores empty packages
+	frames[10] = ""
+	frames[50] = ""
+	local expect = {}
+	for _, s in ipairs(frames) do
+		if s ~= "" then
+			table.insert(expect, s)
+		end
+	end
+	local recv = {}
+	local co = coroutine.running()
+	local gate
+	skynet.dispatch("text", function(_, _, msg)
+		local fd, cmd = msg:match "(%d+) (%a+)"
+		if cmd == "open" then
+			skynet.send(gate, "text", "start " .. fd)
+		end
+	end)
+	skynet.dispatch("client", function(_, _, msg)
+		skynet.ignoreret()	-- session is fd
+		table.insert(recv, msg)
+		if #recv == #expect then
+			skynet.wakeup(co)
+		end
+	end)
+	gate = skynet.launch("gate", string.format("%s %s 127.0.0.1:%d 0 16", header == 2 and "S" or "L", skynet.address(skynet.self()), PORT))
+	skynet.send(gate, "text", "broker " .. skynet.address(skynet.self()))
+	local c = socket.open("127.0.0.1", PORT)
+	send_frames(c, header, frames)
+	skynet.wait(co)
+	for i = 1, #expect do
+		assert(recv[i] == expect[i], i)
+	end
+	-- the frame larger than 16M closes the connection
+	socket.write(c, string.pack(">I4", 0x1000000))
+	assert(socket.read(c) == false)
+	socket.close(c)
+	skynet.kill(gate)
+	print("gate", header, "ok")
+end
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	pack = function(text) return text end,
+	unpack = skynet.tostring,
+}
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	unpack = skynet.tostring,
+}
+
+skynet.start(function()
+	test_read(2, true)
+	test_read(4, true)
+	test_read(2, false)
+	test_gateserver(false)
+	test_gateserver(true)
+	test_gate(4)
+	print("frame ok")
+	skynet.exit()
+end)
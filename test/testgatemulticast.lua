@@ -0,0 +1,142 @@
+-- check the multicast of the C gate (all connections, a list of ids, a named group), and compare it with one write per connection
+-- usage : testgatemulticast [clients] [size] [count]
+
+local skynet = require "skynet"
+require "skynet.manager"
+local socket = require "skynet.socket"
+
+local clients, size, count = ...
+clients = tonumber(clients) or 100
+size = tonumber(size) or 1024
+count = tonumber(count) or 100
+
+local PORT = 8007
+
+local MULTICAST_ALL = 0xffffffff
+local MULTICAST_LIST = 0xfffffffe
+local MULTICAST_GROUP = 0xfffffffd
+
+skynet.register_protocol {
+	name = "text",
+	id = skynet.PTYPE_TEXT,
+	pack = function(text) return text end,
+	unpack = skynet.tostring,
+}
+
+skynet.register_protocol {
+	name = "client",
+	id = skynet.PTYPE_CLIENT,
+	pack = function(msg) return msg end,
+	unpack = skynet.tostring,
+}
+
+local gate
+local server = {}	-- fds in gate
+
+local function send_all(msg)
+	skynet.send(gate, "client", msg .. string.pack("<I4", MULTICAST_ALL))
+end
+
+local function send_list(msg, ids)
+	local t = { msg }
+	for _, id in ipairs(ids) do
+		table.insert(t, string.pack("<I4", id))
+	end
+	table.insert(t, string.pack("<I4<I4", #ids, MULTICAST_LIST))
+	skynet.send(gate, "client", table.concat(t))
+end
+
+local function send_group(msg, name)
+	skynet.send(gate, "client", msg .. name .. string.pack("<B<I4", #name, MULTICAST_GROUP))
+end
+
+local function send_each(msg)
+	for _, fd in ipairs(server) do
+		skynet.send(gate, "client", msg .. string.pack("<I4", fd))
+	end
+end
+
+local function expect(c, msg)
+	local data = assert(socket.read(c, #msg))
+	assert(data == msg)
+end
+
+skynet.start(function()
+	skynet.dispatch("text", function(_, _, msg)
+		local fd, cmd = msg:match "(%d+) (%a+)"
+		if cmd == "open" then
+			skynet.send(gate, "text", "start " .. fd)
+			table.insert(server, tonumber(fd))
+		end
+	end)
+	gate = skynet.launch("gate", string.format("S %s 127.0.0.1:%d 0 %d", skynet.address(skynet.self()), PORT, clients))
+	local c = {}
+	for i = 1, clients do
+		c[i] = assert(socket.open("127.0.0.1", PORT))
+	end
+	while #server < clients do
+		skynet.sleep(1)
+	end
+
+	send_all "all"
+	for i = 1, clients do
+		expect(c[i], "all")
+	end
+
+	-- the ids not belong to the gate are ignored
+	local half = {}
+	for i = 1, clients, 2 do
+		table.insert(half, server[i])
+	end
+	table.insert(half, 0x7fffffff)
+	send_list("list", half)
+	-- the connections are accepted in order, so server[i] is the peer of c[i]
+	for i = 1, clients, 2 do
+		expect(c[i], "list")
+	end
+
+	skynet.send(gate, "text", "join odd " .. table.concat(half, " "))
+	skynet.send(gate, "text", "leave odd " .. server[1])
+	send_group("group", "odd")
+	send_group("nobody", "none")
+	send_all "end"
+	for i = 1, clients do
+		if i % 2 == 1 and i ~= 1 then
+			expect(c[i], "group")
+		end
+		expect(c[i], "end")
+	end
+	print("multicast : all, list, group ok")
+
+	-- benchmark
+	local msg = string.rep("x", size)
+	local function bench(what, f)
+		local t = skynet.now()
+		for i = 1, count do
+			f(msg)
+		end
+		for i = 1, clients do
+			expect(c[i], string.rep(msg, count))
+		end
+		local ti = (skynet.now() - t) / 100
+		print(string.format("%s : %d clients x %d packets (%d bytes) in %.2fs", what, clients, count, size, ti))
+	end
+	bench("multicast", send_all)
+	bench("write each", send_each)
+
+	-- the closed connection leaves the group
+	socket.close(c[3])
+	skynet.sleep(10)
+	send_group("group", "odd")
+	for i = 5, clients, 2 do
+		expect(c[i], "group")
+	end
+	for i = 1, clients do
+		if i ~= 3 then
+			socket.close(c[i])
+		end
+	end
+	skynet.kill(gate)
+	print("multicast ok")
+	skynet.exit()
+end)
@@ -0,0 +1,190 @@
+-- check the keep-alive pool of httpc (httpc.keepalive), and compare the requests per second with a new connection for each request
+-- usage : testhttpckeepalive [requests]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local httpd = require "http.httpd"
+local httpc = require "http.httpc"
+local sockethelper = require "http.sockethelper"
+
+local mode, n = ...
+
+local PORT = 8010
+
+if mode == "server" then
+
+-- a local httpd stand-in, keeps the connection until the client closes it
+local accepted = 0
+local conns = {}
+
+local function serve(fd)
+	socket.start(fd)
+	socket.nodelay(fd)
+	accepted = accepted + 1
+	conns[fd] = true
+	local read = sockethelper.readfunc(fd)
+	local write = sockethelper.writefunc(fd)
+	while true do
+		local code, url = httpd.read_request(read)
+		if code ~= 200 then
+			break
+		end
+		if url == "/close" then
+			httpd.write_response(write, 200, url, { connection = "close" })
+			break
+		elseif url == "/chunked" then
+			local i = 0
+			httpd.write_response(write, 200, function()
+				i = i + 1
+				if i <= 3 then
+					return tostring(i)
+				end
+			end)
+		else
+			httpd.write_response(write, 200, url)
+		end
+	end
+	conns[fd] = nil
+	socket.close(fd)
+end
+
+local command = {}
+
+function command.stat()
+	local n = 0
+	for _ in pairs(conns) do
+		n = n + 1
+	end
+	return accepted, n
+end
+
+-- close all the connections, the idle connections in client pool are broken
+function command.kick()
+	for fd in pairs(conns) do
+		socket.close(fd)
+	end
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	socket.start(id, function(fd)
+		skynet.fork(serve, fd)
+	end)
+	skynet.dispatch("lua", function(_, _, cmd)
+		skynet.ret(skynet.pack(command[cmd]()))
+	end)
+end)
+
+else
+
+n = tonumber(mode) or 2000
+
+local HOST = "127.0.0.1:" .. PORT
+
+local server
+
+local function stat()
+	return skynet.call(server, "lua", "stat")
+end
+
+local function get(url)
+	local code, body = httpc.get(HOST, url)
+	assert(code == 200 and body == url, body)
+end
+
+local function test_pool()
+	httpc.keepalive { timeout = 50, max = 2 }
+	local accepted = stat()
+	for i = 1, 10 do
+		get("/" .. i)
+	end
+	assert(stat() == accepted + 1)
+	-- chunked body
+	local code, body = httpc.get(HOST, "/chunked")
+	assert(code == 200 and body == "123")
+	assert(httpc.head(HOST, "/head") == 200)
+	get("/next")
+	assert(stat() == accepted + 1)
+	-- connection: close
+	get("/close")
+	get("/next")
+	assert(stat() == accepted + 2)
+	-- the connection closed by server is not reused
+	skynet.call(server, "lua", "kick")
+	get("/kick")
+	assert(stat() == accepted + 3)
+	-- max connections per host
+	local done = 0
+	for i = 1, 20 do
+		skynet.fork(function()
+			get("/max" .. i)
+			done = done + 1
+		end)
+	end
+	while done < 20 do
+		skynet.sleep(1)
+	end
+	local a, c = stat()
+	assert(c <= 2 and a <= accepted + 5, a)
+	-- idle timeout
+	skynet.sleep(60)
+	assert(select(2, stat()) == 0)
+	print("pool ok")
+end
+
+local function test_pipeline()
+	httpc.keepalive { max = 2, pipeline = 8 }
+	get("/warmup")
+	local accepted = stat()
+	local done = 0
+	for i = 1, 100 do
+		skynet.fork(function()
+			get("/pipeline" .. i)
+			done = done + 1
+		end)
+	end
+	while done < 100 do
+		skynet.sleep(1)
+	end
+	local a, c = stat()
+	assert(c <= 2 and a <= accepted + 1)
+	httpc.keepalive(false)
+	print("pipeline ok")
+end
+
+local function bench(name, concurrent, conf)
+	httpc.keepalive(conf)
+	local t = skynet.hpc()
+	local done = 0
+	local co = coroutine.running()
+	for i = 1, concurrent do
+		skynet.fork(function()
+			for j = 1, n // concurrent do
+				get("/bench")
+			end
+			done = done + 1
+			if done == concurrent then
+				skynet.wakeup(co)
+			end
+		end)
+	end
+	skynet.wait(co)
+	local ti = (skynet.hpc() - t) / 1e9
+	httpc.keepalive(false)
+	print(string.format("%-40s %8.0f req/s", name, n // concurrent * concurrent / ti))
+end
+
+skynet.start(function()
+	server = skynet.newservice(SERVICE_NAME, "server")
+	test_pool()
+	test_pipeline()
+	bench("sequential, new connection", 1)
+	bench("sequential, keep-alive", 1, {})
+	bench("16 coroutines, new connection", 16)
+	bench("16 coroutines, keep-alive 4 conns", 16, { max = 4 })
+	bench("16 coroutines, keep-alive 4 conns x 8", 16, { max = 4, pipeline = 8 })
+	print("httpc keepalive ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,194 @@
+-- check httpd.keepalive : keep-alive connections, pipelined requests, request and idle limits of each connection,
+-- and compare the requests per second with one request per connection, and with a raw socket server (the socket layer)
+-- usage : testhttpdkeepalive [requests]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local httpd = require "http.httpd"
+local sockethelper = require "http.sockethelper"
+
+local mode, port, requests, idle, parser = ...
+
+if mode == "server" then
+
+local function handle(url, method, header, body)
+	if url == "/error" then
+		error "handler error"
+	end
+	return 200, url .. body, { server = "skynet" }
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", tonumber(port))
+	socket.start(id, function(fd)
+		skynet.fork(function()
+			socket.start(fd)
+			socket.nodelay(fd)
+			local read = sockethelper.readfunc(fd)
+			if parser == "lua" then
+				-- not a sockethelper.readfunc, the request is parsed in lua
+				local r = read
+				read = function(sz)
+					return r(sz)
+				end
+			end
+			local interface = { read = read, write = sockethelper.writefunc(fd) }
+			httpd.keepalive(fd, interface, handle, { requests = tonumber(requests), idle = tonumber(idle) })
+			socket.close(fd)
+		end)
+	end)
+end)
+
+elseif mode == "raw" then
+
+-- the socket layer : read the request header and write a fixed response
+local RESPONSE = "HTTP/1.1 200 OK\r\nserver: skynet\r\ncontent-length: 6\r\n\r\n/bench"
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", tonumber(port))
+	socket.start(id, function(fd)
+		skynet.fork(function()
+			socket.start(fd)
+			socket.nodelay(fd)
+			while socket.readline(fd, "\r\n\r\n") do
+				socket.write(fd, RESPONSE)
+			end
+			socket.close(fd)
+		end)
+	end)
+end)
+
+else
+
+local n = tonumber(mode) or 20000
+
+local PORT = 8011	-- 8011 : c parser, 8012 : lua parser, 8013 : raw socket
+
+local function request(url, extra, body)
+	body = body or ""
+	return string.format("GET %s HTTP/1.1\r\nhost: 127.0.0.1\r\n%scontent-length: %d\r\n\r\n%s", url, extra or "", #body, body)
+end
+
+-- returns code, header, body or nil if the connection is closed
+local function response(c)
+	local h = socket.readline(c, "\r\n\r\n")
+	if not h then
+		return
+	end
+	local code = assert(tonumber(h:match "^HTTP/1.1 (%d+)"))
+	local header = {}
+	for k, v in h:gmatch "\r\n([^:]+): ([^\r]*)" do
+		header[k] = v
+	end
+	local body = ""
+	local len = tonumber(header["content-length"])
+	if len and len > 0 then
+		body = socket.read(c, len)
+	end
+	return code, header, body
+end
+
+local function test_server(port, requests)
+	-- pipelined requests in one write
+	local c = socket.open("127.0.0.1", port)
+	local t = {}
+	for i = 1, 10 do
+		t[i] = request("/" .. i, nil, i % 2 == 0 and "body" or nil)
+	end
+	socket.write(c, table.concat(t))
+	for i = 1, 10 do
+		local code, header, body = response(c)
+		assert(code == 200 and header.server == "skynet" and header.connection == nil)
+		assert(body == "/" .. i .. (i % 2 == 0 and "body" or ""))
+	end
+	-- connection: close
+	socket.write(c, request("/close", "connection: close\r\n"))
+	local code, header = response(c)
+	assert(code == 200 and header.connection == "close")
+	assert(socket.read(c) == false)
+	socket.close(c)
+
+	-- the max requests per connection
+	if requests then
+		c = socket.open("127.0.0.1", port)
+		for i = 1, requests do
+			socket.write(c, request("/" .. i))
+			local code, header = response(c)
+			assert(code == 200)
+			assert(header.connection == (i == requests and "close" or nil))
+		end
+		assert(socket.read(c) == false)
+		socket.close(c)
+	end
+
+	-- http/1.0
+	c = socket.open("127.0.0.1", port)
+	socket.write(c, "GET /1.0 HTTP/1.0\r\nconnection: keep-alive\r\n\r\n")
+	local code, header = response(c)
+	assert(code == 200 and header.connection == "keep-alive")
+	socket.write(c, "GET /1.0 HTTP/1.0\r\n\r\n")
+	local code, header = response(c)
+	assert(code == 200 and header.connection == "close")
+	assert(socket.read(c) == false)
+	socket.close(c)
+
+	-- error in handler
+	c = socket.open("127.0.0.1", port)
+	socket.write(c, request("/error"))
+	local code, header = response(c)
+	assert(code == 500 and header.connection == "close")
+	socket.close(c)
+
+	-- idle timeout
+	c = socket.open("127.0.0.1", port)
+	socket.write(c, request("/idle"))
+	assert(response(c) == 200)
+	local t = skynet.now()
+	assert(socket.read(c) == false)
+	assert(skynet.now() - t >= 40)
+	socket.close(c)
+	print(string.format("server %d ok", port))
+end
+
+local function bench(name, port, pipeline, reconnect)
+	local req = request("/bench")
+	local batch = string.rep(req, pipeline)
+	local t = skynet.hpc()
+	local c
+	for i = 1, n // pipeline do
+		if not c then
+			c = socket.open("127.0.0.1", port)
+		end
+		socket.write(c, batch)
+		for j = 1, pipeline do
+			local code, _, body = response(c)
+			assert(code == 200 and body == "/bench")
+		end
+		if reconnect then
+			socket.close(c)
+			c = nil
+		end
+	end
+	local ti = (skynet.hpc() - t) / 1e9
+	if c then
+		socket.close(c)
+	end
+	print(string.format("%-36s %8.0f req/s", name, n // pipeline * pipeline / ti))
+end
+
+skynet.start(function()
+	skynet.newservice(SERVICE_NAME, "server", PORT, 1000000, 50)
+	skynet.newservice(SERVICE_NAME, "server", PORT + 1, 12, 50, "lua")
+	skynet.newservice(SERVICE_NAME, "raw", PORT + 2)
+	test_server(PORT + 1, 12)
+	test_server(PORT)
+	bench("httpd, one request per connection", PORT, 1, true)
+	bench("httpd, keep-alive", PORT, 1)
+	bench("httpd, keep-alive, pipeline 32", PORT, 32)
+	bench("raw socket, keep-alive", PORT + 2, 1)
+	bench("raw socket, keep-alive, pipeline 32", PORT + 2, 32)
+	print("httpd keepalive ok")
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,143 @@
+-- check the http request parser in socket buffer (socket.readrequest, used by httpd.read_request),
+-- and compare it with the parser in lua (internal.recvheader / parseheader)
+-- usage : testhttpparser [rounds]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local httpd = require "http.httpd"
+local internal = require "http.internal"
+local sockethelper = require "http.sockethelper"
+
+local rounds = ...
+rounds = tonumber(rounds) or 50
+
+local PORT = 8009
+
+local REQUEST = table.concat {
+	"POST /api/v1/user?id=1 HTTP/1.1\r\n",
+	"Host: 127.0.0.1\r\n",
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n",
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",
+	"Accept-Encoding: gzip, deflate\r\n",
+	"Cookie: a=1\r\n",
+	"Cookie: b=2\r\n",
+	"X-Long: first\r\n",
+	"\tsecond\r\n",
+	"Content-Length: 5\r\n",
+	"\r\n",
+	"hello",
+}
+
+local function check(code, url, method, header, body)
+	assert(code == 200, code)
+	assert(url == "/api/v1/user?id=1")
+	assert(method == "POST")
+	assert(header.host == "127.0.0.1")
+	assert(header["accept-encoding"] == "gzip, deflate")
+	assert(header.cookie[1] == "a=1" and header.cookie[2] == "b=2")
+	assert(header["x-long"] == "firstsecond")
+	assert(body == "hello")
+end
+
+local function accept(id)
+	local fd
+	socket.start(id, function(newfd)
+		socket.start(newfd)
+		fd = newfd
+	end)
+	return function()
+		while not fd do
+			skynet.sleep(1)
+		end
+		local ret = fd
+		fd = nil
+		return ret
+	end
+end
+
+local function test_parse(listen)
+	local c = socket.open("127.0.0.1", PORT)
+	local fd = listen()
+	local read = sockethelper.readfunc(fd)
+	-- split the request at every position, the header is found incrementally
+	for i = 1, #REQUEST - 1 do
+		skynet.fork(function()
+			socket.write(c, REQUEST:sub(1, i))
+			skynet.sleep(0)
+			socket.write(c, REQUEST:sub(i + 1))
+		end)
+		check(httpd.read_request(read))
+	end
+	-- pipelined requests, lf only
+	socket.write(c, REQUEST .. REQUEST:gsub("\r\n", "\n"))
+	check(httpd.read_request(read))
+	check(httpd.read_request(read))
+	-- errors
+	socket.write(c, "GET / HTTP/2.0\r\n\r\n")
+	assert(httpd.read_request(read) == 505)
+	socket.write(c, "GET / HTTP/1.1\r\nbad header\r\n\r\n")
+	assert(httpd.read_request(read) == 400)
+	socket.write(c, "GET /" .. string.rep("x", internal.LIMIT) .. " HTTP/1.1\r\n\r\n")
+	assert(httpd.read_request(read) == 413)
+	socket.close(c)
+	socket.close(fd)
+	-- disconnected before the end of header
+	c = socket.open("127.0.0.1", PORT)
+	fd = listen()
+	socket.write(c, "GET / HTTP/1.1\r\n")
+	socket.close(c)
+	assert(httpd.read_request(sockethelper.readfunc(fd)) == nil)
+	socket.close(fd)
+	print("parse ok")
+end
+
+-- only the header parsing is timed : the requests are in socket buffer before parsing
+local function test_bench(listen)
+	local c = socket.open("127.0.0.1", PORT)
+	local fd = listen()
+	local read = sockethelper.readfunc(fd)
+	local batch = (100 * 1024) // #REQUEST
+	local data = string.rep(REQUEST, batch)
+	local c_time = 0
+	for i = 1, rounds do
+		socket.write(c, data)
+		-- wait for all the data (less than the buffer limit of socket) arrived
+		skynet.sleep(5)
+		local t = skynet.hpc()
+		for j = 1, batch do
+			check(httpd.read_request(read))
+		end
+		c_time = c_time + skynet.hpc() - t
+	end
+	socket.close(c)
+	socket.close(fd)
+
+	-- lua parser, read from memory
+	local lua_time = 0
+	for i = 1, rounds do
+		local t = skynet.hpc()
+		for j = 1, batch do
+			local s = REQUEST
+			local readbytes = function(sz)
+				local ret = s:sub(1, sz)
+				s = s:sub(#ret + 1)
+				return ret
+			end
+			check(httpd.read_request(readbytes))
+		end
+		lua_time = lua_time + skynet.hpc() - t
+	end
+	local n = rounds * batch
+	print(string.format("read_request %d requests : socket buffer %.0f req/s, lua %.0f req/s",
+		n, n / (c_time / 1e9), n / (lua_time / 1e9)))
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	local listen = accept(id)
+	test_parse(listen)
+	test_bench(listen)
+	socket.close(id)
+	print("httpparser ok")
+	skynet.exit()
+end)
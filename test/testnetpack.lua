@@ -0,0 +1,263 @@
+-- check netpack with gateserver : 2/4 bytes header split in any piece, the max package size,
+-- and compare the packages per second of netpack.batch with one netpack.pop per package
+-- usage : testnetpack [packages]
+
+local skynet = require "skynet"
+
+local mode, impl = ...
+
+-- each test listens on a new port, because the listen socket is closed asynchronously
+local PORT = 8016
+
+if mode == "gate" then
+
+local netpack = require "skynet.netpack"
+
+if impl == "pop" then
+	-- one package per call, as the dispatch loop of netpack.pop
+	local one = {}
+	netpack.batch = function(queue)
+		local fd, msg, sz = netpack.pop(queue)
+		if fd then
+			one[1], one[2], one[3] = fd, msg, sz
+			return one
+		end
+	end
+end
+
+-- gateserver registers the socket protocol itself, so don't require skynet.socket
+local gateserver = require "snax.gateserver"
+
+local recv = {}	-- { fd = { package1, package2, ... } }
+local count = 0
+local keep = true
+local errors = {}
+local waiting
+
+local handler = {}
+
+function handler.connect(fd)
+	gateserver.openclient(fd)
+end
+
+function handler.message(fd, msg, sz)
+	if keep then
+		local r = recv[fd]
+		if not r then
+			r = {}
+			recv[fd] = r
+		end
+		table.insert(r, netpack.tostring(msg, sz))
+	else
+		skynet.trash(msg, sz)
+	end
+	count = count + 1
+	if waiting and waiting.n and count >= waiting.n then
+		skynet.wakeup(waiting.co)
+	end
+end
+
+function handler.error(fd, msg)
+	table.insert(errors, msg)
+	if waiting and waiting.error then
+		skynet.wakeup(waiting.co)
+	end
+end
+
+local CMD = {}
+
+function CMD.wait(n)
+	if count < n then
+		waiting = { n = n, co = coroutine.running() }
+		skynet.wait(waiting.co)
+		waiting = nil
+	end
+	local r = recv
+	recv = {}
+	count = 0
+	return r
+end
+
+function CMD.error()
+	if #errors == 0 then
+		waiting = { error = true, co = coroutine.running() }
+		skynet.wait(waiting.co)
+		waiting = nil
+	end
+	return errors
+end
+
+function CMD.keep(v)
+	keep = v
+end
+
+function handler.command(cmd, source, ...)
+	return CMD[cmd](...)
+end
+
+gateserver.start(handler)
+
+return
+end
+
+local socket = require "skynet.socket"
+local netpack = require "skynet.netpack"
+require "skynet.manager"	-- skynet.kill
+
+local n = tonumber(mode) or 200000
+
+local function pack(header, s)
+	return string.pack(header == 2 and ">s2" or ">s4", s)
+end
+
+local function gen_packages(n, max)
+	local t = {}
+	for i = 1, n do
+		t[i] = string.rep(string.char(65 + i % 26), math.random(0, max))
+	end
+	return t
+end
+
+-- send the packages in random pieces, so the headers are split too
+local function send_pieces(c, header, packages)
+	local data = {}
+	for i, s in ipairs(packages) do
+		data[i] = pack(header, s)
+	end
+	data = table.concat(data)
+	local i = 1
+	while i <= #data do
+		local sz = math.random(1, 7) == 1 and math.random(1, 5) or math.random(1, 4096)
+		socket.write(c, data:sub(i, i + sz - 1))
+		i = i + sz
+		if math.random(1, 4) == 1 then
+			skynet.sleep(0)
+		end
+	end
+end
+
+local function open_gate(conf, impl)
+	PORT = PORT + 1
+	local gate = skynet.newservice(SERVICE_NAME, "gate", impl)
+	conf.address = "127.0.0.1"
+	conf.port = PORT
+	skynet.call(gate, "lua", "open", conf)
+	return gate
+end
+
+local function close_gate(gate)
+	skynet.call(gate, "lua", "close")
+	skynet.kill(gate)
+end
+
+local function test_pack()
+	for _, header in ipairs { 2, 4 } do
+		local s = string.rep("x", 1000)
+		local msg, sz = netpack.pack(s, header)
+		assert(sz == 1000 + header)
+		assert(netpack.tostring(msg, sz) == pack(header, s))
+		-- pack lightuserdata/size
+		msg, sz = netpack.pack(skynet.pack(s))
+		local m2, sz2 = netpack.pack(msg, sz, header)
+		assert(sz2 == sz + header)
+		assert(netpack.tostring(m2, sz2):sub(header + 1) == netpack.tostring(msg, sz))
+	end
+	assert(not pcall(netpack.pack, string.rep("x", 0x10000)))
+	assert(pcall(netpack.pack, string.rep("x", 0x10000), 4))
+	assert(not pcall(netpack.pack, "x", 3))
+	print("pack ok")
+end
+
+local function test_header(header, frame)
+	local gate = open_gate({ header = header, frame = frame })
+	local packages = gen_packages(300, header == 2 and 3000 or 100000)
+	-- several connections at the same time, the uncomplete packages of each connection are kept apart
+	local conns = {}
+	for i = 1, 4 do
+		conns[i] = socket.open("127.0.0.1", PORT)
+	end
+	for i = 1, 4 do
+		skynet.fork(send_pieces, conns[i], header, packages)
+	end
+	local recv = skynet.call(gate, "lua", "wait", #packages * 4)
+	local n = 0
+	for fd, r in pairs(recv) do
+		n = n + 1
+		assert(#r == #packages)
+		for i = 1, #packages do
+			assert(r[i] == packages[i], i)
+		end
+	end
+	assert(n == 4)
+	for i = 1, 4 do
+		socket.close(conns[i])
+	end
+	close_gate(gate)
+	print("header", header, frame == "batch" and "batch" or frame and "frame" or "netpack", "ok")
+end
+
+local function test_max(header)
+	local max = 1000
+	local gate = open_gate({ header = header, maxpacket = max })
+	local c = socket.open("127.0.0.1", PORT)
+	send_pieces(c, header, { string.rep("a", max) })
+	local _, recv = next(skynet.call(gate, "lua", "wait", 1))
+	assert(#recv == 1 and recv[1] == string.rep("a", max))
+	-- the package before a too large one is delivered, the packages after it are discarded, and the connection is closed
+	send_pieces(c, header, { "b", string.rep("c", max + 1), "d" })
+	local errors = skynet.call(gate, "lua", "error")
+	assert(errors[1] == "package too large", errors[1])
+	assert(socket.read(c) == false)
+	_, recv = next(skynet.call(gate, "lua", "wait", 1))
+	assert(#recv == 1 and recv[1] == "b")
+	socket.close(c)
+	close_gate(gate)
+	print("max", header, "ok")
+end
+
+local function bench(impl, conns)
+	local gate = open_gate({ header = 2, nodelay = true }, impl)
+	skynet.call(gate, "lua", "keep", false)
+	local cs = {}
+	for i = 1, conns do
+		cs[i] = socket.open("127.0.0.1", PORT)
+	end
+	-- 64 small packages in each write, so several packages are in the queue at once
+	local batch = string.rep(pack(2, string.rep("x", 32)), 64)
+	local total = n // 64 // conns * 64 * conns
+	local t = skynet.hpc()
+	for i = 1, conns do
+		skynet.fork(function()
+			for j = 1, total // 64 // conns do
+				socket.write(cs[i], batch)
+				if j % 8 == 0 then
+					skynet.sleep(0)
+				end
+			end
+		end)
+	end
+	skynet.call(gate, "lua", "wait", total)
+	t = (skynet.hpc() - t) / 1e9
+	for i = 1, conns do
+		socket.close(cs[i])
+	end
+	close_gate(gate)
+	return total / t
+end
+
+skynet.start(function()
+	test_pack()
+	test_header(2)
+	test_header(4)
+	test_header(4, true)
+	test_header(4, "batch")
+	test_max(2)
+	test_max(4)
+	for _, conns in ipairs { 1, 64 } do
+		local pop = bench("pop", conns)
+		local batch = bench("batch", conns)
+		print(string.format("%d connections, %d bytes packages : pop %.0f/s, batch %.0f/s", conns, 34, pop, batch))
+	end
+	print("testnetpack ok")
+	skynet.exit()
+end)
@@ -0,0 +1,72 @@
+-- check the read / write rate limit of socket.ratelimit
+-- usage : testratelimit [rate] [size]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local rate, size = ...
+rate = tonumber(rate) or 100 * 1024
+size = tonumber(size) or 300 * 1024
+
+local PORT = 8005
+
+local function recv_all(fd, n)
+	local t = skynet.now()
+	local total = 0
+	while total < n do
+		local s = assert(socket.read(fd))
+		total = total + #s
+	end
+	return (skynet.now() - t) / 100
+end
+
+-- the bucket is full (1 second of tokens) at the beginning, so the expected time is (size - rate) / rate
+local function check(what, ti)
+	local expect = (size - rate) / rate
+	print(string.format("%s limit %d bytes/s : %d bytes in %.2fs (expect %.2fs)", what, rate, size, ti, expect))
+	assert(ti > expect * 0.8 and ti < expect * 1.5 + 0.1)
+end
+
+skynet.start(function()
+	local data = string.rep("x", size)
+	local id = socket.listen("127.0.0.1", PORT)
+	local server = {}
+	socket.start(id, function(fd)
+		socket.start(fd)
+		table.insert(server, fd)
+	end)
+
+	-- read limit : the client writes all at once, and the server reads slowly
+	local c = socket.open("127.0.0.1", PORT)
+	while #server < 1 do
+		skynet.sleep(1)
+	end
+	local s = server[1]
+	socket.ratelimit(s, rate)
+	socket.write(c, data)
+	check("read", recv_all(s, size))
+
+	-- packet limit : 20 packets per second
+	socket.ratelimit(s, nil, 20)
+	local t = skynet.now()
+	local count = 0
+	for i = 1, 40 do
+		socket.write(c, "x")
+		count = count + #assert(socket.read(s))
+	end
+	local ti = (skynet.now() - t) / 100
+	print(string.format("packet limit 20/s : %d packets in %.2fs", count, ti))
+	assert(ti > 0.8)
+	socket.ratelimit(s)
+
+	-- write limit
+	socket.ratelimit(s, nil, nil, rate)
+	socket.write(s, data)
+	check("write", recv_all(c, size))
+
+	socket.close(c)
+	socket.close(s)
+	socket.close(id)
+	print("ratelimit ok")
+	skynet.exit()
+end)
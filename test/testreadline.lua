@@ -0,0 +1,133 @@
+-- check socket.readline : the separator is searched by memchr across the buffer nodes, and the scan position
+-- is remembered when the line is not complete.
+-- usage : testreadline [mbytes]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode, port, mb = ...
+
+local PORT = 8014
+
+if mode == "writer" then
+
+local command = {}
+
+-- the lines are written in pieces, so they are in different buffer nodes
+function command.lines(c, lines, piece)
+	local data = table.concat(lines)
+	for i = 1, #data, piece do
+		socket.write(c, data:sub(i, i + piece - 1))
+		skynet.sleep(0)
+	end
+end
+
+-- a long line arrives in small pieces, readline checks it after each piece
+function command.longline(c, size, piece)
+	local s = string.rep("x", piece)
+	for i = 1, size // piece do
+		socket.write(c, s)
+		skynet.sleep(0)
+	end
+	socket.write(c, "\r\n")
+end
+
+function command.bulk(c, line, n)
+	local batch = string.rep(line, 1000)
+	for i = 1, n // 1000 do
+		socket.write(c, batch)
+		skynet.sleep(0)
+	end
+end
+
+skynet.start(function()
+	local c = socket.open("127.0.0.1", tonumber(port))
+	socket.nodelay(c)
+	skynet.dispatch("lua", function(_, _, cmd, ...)
+		command[cmd](c, ...)
+		skynet.ret()
+	end)
+end)
+
+else
+
+mb = tonumber(mode) or 32
+
+local function random_line(sep)
+	while true do
+		local t = {}
+		for i = 1, math.random(0, 200) do
+			-- '\r', '\n' and '-' inside the line
+			local c = math.random(0, 3)
+			t[i] = c == 0 and ("\r\n-"):sub(math.random(1,3)) or string.char(math.random(97, 122))
+		end
+		local line = table.concat(t) .. sep
+		if line:find(sep, 1, true) == #line - #sep + 1 then
+			return line
+		end
+	end
+end
+
+local function test_lines(writer, fd)
+	for _, sep in ipairs { "\n", "\r\n", "\r\n\r\n", "--boundary--boundary--" } do
+		for _, piece in ipairs { 1, 3, 17, 1000 } do
+			local lines = {}
+			for i = 1, 100 do
+				lines[i] = random_line(sep)
+			end
+			skynet.fork(skynet.call, writer, "lua", "lines", lines, piece)
+			for i = 1, 100 do
+				assert(socket.readline(fd, sep) .. sep == lines[i], sep)
+			end
+		end
+	end
+	-- switch the separator, the remembered position is for the last separator
+	skynet.fork(skynet.call, writer, "lua", "lines", { "a\nb\r\n", "c\r\n" }, 1)
+	assert(socket.readline(fd, "\r\n") == "a\nb")
+	assert(socket.readline(fd, "\n") == "c\r")
+	print("readline ok")
+end
+
+local function cpu()
+	return skynet.stat "cpu"
+end
+
+local function bench(writer, fd)
+	-- a long line : the readline checks don't rescan the line
+	local size, piece = 1024 * 1024, 1024
+	local t = cpu()
+	skynet.fork(skynet.call, writer, "lua", "longline", size, piece)
+	assert(#socket.readline(fd, "\r\n") == size)
+	print(string.format("long line %dK in %d bytes pieces : %.2fms cpu", size // 1024, piece, (cpu() - t) * 1000))
+
+	local line = string.rep("x", 98) .. "\r\n"
+	local n = mb * 1024 * 1024 // #line // 1000 * 1000
+	t = skynet.hpc()
+	skynet.fork(skynet.call, writer, "lua", "bulk", line, n)
+	for i = 1, n do
+		socket.readline(fd, "\r\n")
+	end
+	t = (skynet.hpc() - t) / 1e9
+	print(string.format("%d lines (%d bytes) : %.0f lines/s", n, #line, n / t))
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	local fd
+	socket.start(id, function(newfd)
+		socket.start(newfd)
+		fd = newfd
+	end)
+	local writer = skynet.newservice(SERVICE_NAME, "writer", PORT)
+	while not fd do
+		skynet.sleep(1)
+	end
+	test_lines(writer, fd)
+	bench(writer, fd)
+	socket.close(fd)
+	socket.close(id)
+	print("testreadline ok")
+	skynet.exit()
+end)
+
+end
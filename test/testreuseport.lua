@@ -0,0 +1,53 @@
+-- several services listen the same port with SO_REUSEPORT, and the kernel balances the connections among them.
+-- usage : testreuseport [listeners] [connections]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode = ...
+
+local PORT = 8005
+
+if mode == "listener" then
+
+skynet.start(function()
+	local count = 0
+	local id = socket.listen("127.0.0.1", PORT, nil, true)
+	socket.start(id, function(fd)
+		count = count + 1
+		socket.close(fd)
+	end)
+	skynet.dispatch("lua", function()
+		socket.close(id)
+		skynet.ret(skynet.pack(count))
+		skynet.exit()
+	end)
+end)
+
+else
+
+local n, connections = ...
+n = tonumber(n) or 4
+connections = tonumber(connections) or 1000
+
+skynet.start(function()
+	local listeners = {}
+	for i = 1, n do
+		listeners[i] = skynet.newservice(SERVICE_NAME, "listener")
+	end
+	for i = 1, connections do
+		local id = socket.open("127.0.0.1", PORT)
+		socket.close(id)
+	end
+	skynet.sleep(100)
+	local total = 0
+	for i, addr in ipairs(listeners) do
+		local count = skynet.call(addr, "lua")
+		total = total + count
+		print(string.format("listener %d : %d connections", i, count))
+	end
+	print(string.format("total : %d/%d", total, connections))
+	skynet.exit()
+end)
+
+end
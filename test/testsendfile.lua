@@ -0,0 +1,45 @@
+-- send a file (and strings around it) by socket.sendfile, and check what the client receives
+-- usage : testsendfile [filename]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local filename = ... or "lualib/skynet.lua"
+
+local PORT = 8004
+
+skynet.start(function()
+	local f = assert(io.open(filename, "rb"))
+	local content = f:read "a"
+	f:close()
+	local half = #content // 2
+
+	local id = socket.listen("127.0.0.1", PORT)
+	socket.start(id, function(fd)
+		socket.start(fd)
+		socket.write(fd, "BEGIN\n")
+		assert(socket.sendfile(fd, filename))
+		socket.write(fd, "\n")
+		-- the second half of file
+		assert(socket.sendfile(fd, filename, half))
+		socket.write(fd, "\nEND\n")
+		socket.close(fd)
+	end)
+
+	local c = socket.open("127.0.0.1", PORT)
+	local expect = "BEGIN\n" .. content .. "\n" .. content:sub(half + 1) .. "\nEND\n"
+	local recv = {}
+	while true do
+		local s = socket.read(c)
+		if not s then
+			break
+		end
+		table.insert(recv, s)
+	end
+	recv = table.concat(recv)
+	socket.close(c)
+	socket.close(id)
+	assert(recv == expect, string.format("%d ~= %d", #recv, #expect))
+	print("sendfile ok", #recv)
+	skynet.exit()
+end)
@@ -0,0 +1,74 @@
+-- Echo benchmark for socket server (compare the poll backends, eg. build with/without -DUSE_IO_URING)
+-- usage : testsocketbench [clients] [size] [seconds]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode = ...
+
+local PORT = 8002
+
+if mode == "client" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, size, ti)
+		local id = assert(socket.open("127.0.0.1", PORT))
+		local msg = string.rep("x", size)
+		local count = 0
+		local stop = skynet.now() + ti * 100
+		while skynet.now() < stop do
+			socket.write(id, msg)
+			assert(socket.read(id, size))
+			count = count + 1
+		end
+		socket.close(id)
+		skynet.ret(skynet.pack(count))
+		skynet.exit()
+	end)
+end)
+
+else
+
+local clients, size, ti = ...
+clients = tonumber(clients) or 16
+size = tonumber(size) or 64
+ti = tonumber(ti) or 5
+
+local function echo(id)
+	socket.start(id)
+	while true do
+		local str = socket.read(id)
+		if str then
+			socket.write(id, str)
+		else
+			socket.close(id)
+			return
+		end
+	end
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	socket.start(id, function(fd)
+		skynet.fork(echo, fd)
+	end)
+	print(string.format("echo bench : clients = %d, size = %d, time = %ds", clients, size, ti))
+	local total = 0
+	local finish = 0
+	for i = 1, clients do
+		skynet.fork(function()
+			local c = skynet.newservice(SERVICE_NAME, "client")
+			local count = skynet.call(c, "lua", size, ti)
+			total = total + count
+			finish = finish + 1
+		end)
+	end
+	while finish < clients do
+		skynet.sleep(10)
+	end
+	print(string.format("echo bench : %d round trips, %.0f rtt/s, %.2f MB/s", total, total / ti, total * size * 2 / ti / 1024 / 1024))
+	socket.close(id)
+	skynet.exit()
+end)
+
+end
@@ -0,0 +1,210 @@
+-- check the tls layer in socket thread (tlshelper.attach) : echo, bulk transfer, close_notify, interoperation with
+-- the tls of lua services (tlshelper.readfunc/writefunc), and compare the throughput of the two.
+-- It needs the ltls module (make TLS_MODULE=ltls), enablessl = "true" in config, and openssl command for a self-signed certificate.
+-- usage : testtls [mbytes]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local tls = require "http.tlshelper"
+
+local mode, port, impl, cert, key = ...
+
+local PORT = 8030
+
+if mode == "server" then
+
+-- echo server, close the connection after "QUIT"
+skynet.start(function()
+	local ctx = tls.newctx()
+	ctx:set_cert(cert, key)
+	local id = socket.listen("127.0.0.1", tonumber(port))
+	socket.start(id, function(fd)
+		if impl == "socket" then
+			tls.attach(fd, ctx, "server")
+			socket.start(fd)
+			socket.nodelay(fd)
+			skynet.fork(function()
+				while true do
+					local s = socket.read(fd)
+					if not s then
+						break
+					end
+					socket.write(fd, s)
+					if s == "QUIT" then
+						break
+					end
+				end
+				socket.close(fd)
+			end)
+		else
+			socket.start(fd)
+			socket.nodelay(fd)
+			skynet.fork(function()
+				local tls_ctx = tls.newtls("server", ctx)
+				pcall(function()
+					tls.init_responsefunc(fd, tls_ctx)()
+					local read = tls.readfunc(fd, tls_ctx)
+					local write = tls.writefunc(fd, tls_ctx)
+					while true do
+						local s = read()
+						if s ~= "" then
+							write(s)
+							if s == "QUIT" then
+								break
+							end
+						end
+					end
+				end)
+				tls_ctx:close()
+				socket.close(fd)
+			end)
+		end
+	end)
+end)
+
+else
+
+local mb = tonumber(mode) or 64
+
+local ctx
+
+-- returns read(sz), write(s), close()
+local function open(port, impl)
+	local fd = assert(socket.open("127.0.0.1", port))
+	socket.nodelay(fd)
+	if impl == "socket" then
+		tls.attach(fd, ctx, "client", "localhost")
+		return function(sz)
+			return socket.read(fd, sz)
+		end, function(s)
+			socket.write(fd, s)
+		end, function()
+			socket.close(fd)
+		end
+	end
+	local tls_ctx = tls.newtls("client", ctx)
+	tls.init_requestfunc(fd, tls_ctx)("localhost")
+	local read = tls.readfunc(fd, tls_ctx)
+	return function(sz)
+		local ok, s = pcall(read, sz)
+		return ok and s
+	end, tls.writefunc(fd, tls_ctx), function()
+		tls_ctx:close()
+		socket.close(fd)
+	end
+end
+
+local function random_string(n)
+	local t = {}
+	for i = 1, n do
+		t[i] = string.char(math.random(0, 255))
+	end
+	return table.concat(t)
+end
+
+local function test_echo(port, client, server)
+	local read, write, close = open(port, client)
+	-- the first write is sent before the handshake is finished
+	for i = 1, 200 do
+		local s = random_string(math.random(1, 3000))
+		write(s)
+		assert(read(#s) == s)
+	end
+	-- larger than a tls record (16K) and the read buffer
+	local data = random_string(1024 * 1024)
+	skynet.fork(function()
+		for i = 1, #data, 100000 do
+			write(data:sub(i, i + 99999))
+		end
+	end)
+	assert(read(#data) == data)
+	-- the server closes the connection
+	write "QUIT"
+	assert(read(4) == "QUIT")
+	assert(not read(1))
+	close()
+	print(string.format("echo %s client, %s server ok", client, server))
+end
+
+local function test_error(port)
+	-- not a tls client, the server closes the connection
+	local fd = socket.open("127.0.0.1", port)
+	socket.write(fd, "GET / HTTP/1.1\r\n\r\n")
+	assert(socket.read(fd) == false)
+	socket.close(fd)
+	-- the client closes the connection, close_notify is sent
+	local read, write, close = open(port, "socket")
+	write "hello"
+	assert(read(5) == "hello")
+	close()
+	print("error ok")
+end
+
+local function bench(port, impl, piece, total)
+	local read, write, close = open(port, impl)
+	local data = random_string(piece)
+	local n = total // piece
+	local t = skynet.hpc()
+	if piece >= 4096 then
+		-- bulk : write and read at the same time
+		skynet.fork(function()
+			for i = 1, n do
+				write(data)
+			end
+		end)
+		local size = n * piece
+		while size > 0 do
+			local sz = size > 65536 and 65536 or size
+			assert(read(sz))
+			size = size - sz
+		end
+	else
+		-- request and response
+		for i = 1, n do
+			write(data)
+			assert(read(piece))
+		end
+	end
+	t = (skynet.hpc() - t) / 1e9
+	close()
+	return n, n * piece / t / 1024 / 1024, n / t
+end
+
+skynet.start(function()
+	local dir = os.tmpname()
+	os.remove(dir)
+	local cert, key = dir .. "-cert.pem", dir .. "-key.pem"
+	local ok = os.execute(string.format("openssl req -x509 -newkey rsa:2048 -nodes -keyout %s -out %s -subj /CN=localhost -days 1 2>/dev/null", key, cert))
+	if not ok then
+		print("openssl command is needed")
+		skynet.exit()
+		return
+	end
+	ctx = tls.newctx()
+	skynet.newservice(SERVICE_NAME, "server", PORT, "socket", cert, key)
+	skynet.newservice(SERVICE_NAME, "server", PORT + 1, "lua", cert, key)
+	os.remove(cert)
+	os.remove(key)
+
+	test_echo(PORT, "socket", "socket")
+	test_echo(PORT + 1, "socket", "lua")
+	test_echo(PORT, "lua", "socket")
+	test_echo(PORT + 1, "lua", "lua")
+	test_error(PORT)
+
+	local total = mb * 1024 * 1024
+	for _, piece in ipairs { 64 * 1024, 4096 } do
+		local _, lua_mbs = bench(PORT + 1, "lua", piece, total)
+		local _, socket_mbs = bench(PORT, "socket", piece, total)
+		print(string.format("echo %5d bytes writes : tlshelper %8.1f MB/s, socket thread %8.1f MB/s", piece, lua_mbs, socket_mbs))
+	end
+	for _, piece in ipairs { 64, 1024 } do
+		local _, _, lua_rps = bench(PORT + 1, "lua", piece, piece * 20000)
+		local _, _, socket_rps = bench(PORT, "socket", piece, piece * 20000)
+		print(string.format("request/response %5d bytes : tlshelper %8.0f/s, socket thread %8.0f/s", piece, lua_rps, socket_rps))
+	end
+	print("testtls ok")
+	skynet.exit()
+end)
+
+end
@@ -40,9 +40,32 @@ local function client_v6()
 	end
 end
 
+-- the datagrams of one read are in one socket message, see socket.udp_batch
+local function server_batch()
+	local host
+	host = socket.udp(function(str, from)
+		print("server batch recv", str, socket.udp_address(from))
+		socket.sendto(host, from, "OK " .. str)
+	end , "127.0.0.1", 8767)
+	socket.udp_batch(host)
+end
+
+local function client_batch()
+	local c = socket.udp(function(str, from)
+		print("client batch recv", str, socket.udp_address(from))
+	end)
+	socket.udp_batch(c)
+	socket.udp_connect(c, "127.0.0.1", 8767)
+	for i=1,20 do
+		socket.write(c, "hello " .. i)
+	end
+end
+
 skynet.start(function()
 	skynet.fork(server)
 	skynet.fork(client)
 	skynet.fork(server_v6)
 	skynet.fork(client_v6)
+	skynet.fork(server_batch)
+	skynet.fork(client_batch)
 end)
@@ -0,0 +1,77 @@
+-- UDP packets per second benchmark (the socket thread reads datagrams by recvmmsg on linux)
+-- usage : testudpbench [senders] [size] [seconds] [batch]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local mode = ...
+
+local PORT = 8006
+
+if mode == "sender" then
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_,_, size, ti)
+		local c = socket.udp(function() end)
+		socket.udp_connect(c, "127.0.0.1", PORT)
+		local msg = string.rep("x", size)
+		local count = 0
+		local stop = skynet.now() + ti * 100
+		while skynet.now() < stop do
+			for i = 1, 100 do
+				socket.write(c, msg)
+			end
+			count = count + 100
+			skynet.yield()
+		end
+		socket.close(c)
+		skynet.ret(skynet.pack(count))
+		skynet.exit()
+	end)
+end)
+
+else
+
+local senders, size, ti, batch = ...
+senders = tonumber(senders) or 4
+size = tonumber(size) or 64
+ti = tonumber(ti) or 5
+batch = batch == "batch"
+
+skynet.start(function()
+	local recv = 0
+	local host = socket.udp(function(str, from)
+		recv = recv + 1
+	end, "127.0.0.1", PORT)
+	if batch then
+		socket.udp_batch(host)
+	end
+	print(string.format("udp bench : senders = %d, size = %d, time = %ds, batch = %s", senders, size, ti, batch))
+	local sent = 0
+	local finish = 0
+	for i = 1, senders do
+		skynet.fork(function()
+			local s = skynet.newservice(SERVICE_NAME, "sender")
+			local n = skynet.call(s, "lua", size, ti)
+			sent = sent + n
+			finish = finish + 1
+		end)
+	end
+	local start = skynet.now()
+	while finish < senders do
+		skynet.sleep(10)
+	end
+	-- the receiver may fall behind, wait until all the packets in its message queue are handled
+	local last
+	repeat
+		last = recv
+		skynet.sleep(50)
+	until recv == last
+	local elapsed = (skynet.now() - start - 50) / 100
+	print(string.format("udp bench : sent %d (%.0f pps), recv %d (%.0f pps), lost %.2f%%",
+		sent, sent / ti, recv, recv / elapsed, (sent - recv) * 100 / sent))
+	socket.close(host)
+	skynet.exit()
+end)
+
+end
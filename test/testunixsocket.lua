@@ -0,0 +1,75 @@
+-- check unix domain socket, the address is "unix:path" ("unix:@name" for linux abstract namespace)
+-- usage : testunixsocket [path]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local path = ...
+path = path or "/tmp/skynet_testunixsocket.sock"
+
+local function test_stream(addr)
+	local id = assert(socket.listen(addr))
+	socket.start(id, function(fd, from)
+		print("accept", fd, from)
+		if not socket.start(fd) then
+			-- closed by the peer (the probe of the second listen)
+			return
+		end
+		while true do
+			local str = socket.read(fd)
+			if str then
+				socket.write(fd, str)
+			else
+				socket.close(fd)
+				return
+			end
+		end
+	end)
+	-- the path is bound by a live socket, don't remove it
+	assert(not pcall(socket.listen, addr))
+	local c = assert(socket.open(addr))
+	for i = 1, 10 do
+		local msg = string.rep(tostring(i), i * 100)
+		socket.write(c, msg)
+		assert(socket.read(c, #msg) == msg)
+	end
+	socket.close(c)
+	socket.close(id)
+	print("stream", addr, "ok")
+end
+
+local function test_dgram(addr)
+	local count = 0
+	local recv = socket.udp_listen(addr, 0, function(str, from)
+		assert(socket.udp_address(from) == "unix:")
+		assert(str == "hello" .. (count + 1))
+		count = count + 1
+	end)
+	local send = socket.udp_dial(addr, 0)
+	for i = 1, 10 do
+		socket.write(send, "hello" .. i)
+	end
+	for i = 1, 100 do
+		if count == 10 then
+			break
+		end
+		skynet.sleep(1)
+	end
+	assert(count == 10, count)
+	socket.close(send)
+	socket.close(recv)
+	print("dgram", addr, "ok")
+end
+
+skynet.start(function()
+	test_stream("unix:" .. path)
+	-- listen again on the same path, the stale socket file should be replaced
+	test_stream("unix:" .. path)
+	test_dgram("unix:" .. path .. ".udp")
+	if skynet.getenv "abstract" ~= "false" then
+		test_stream("unix:@skynet_testunixsocket")
+		test_dgram("unix:@skynet_testunixsocket.udp")
+	end
+	print("unix socket ok")
+	skynet.exit()
+end)
@@ -0,0 +1,134 @@
+-- check the websocket frame codec (skynet.websocket) used by http.websocket, and compare the unmasking with crypt.xor_str
+-- usage : testwebsocket [seconds per size]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+local crypt = require "skynet.crypt"
+local wscodec = require "skynet.websocket"
+local websocket = require "http.websocket"
+
+local mode, ti = ...
+
+local PORT = 8008
+
+if mode == "agent" then
+
+local handle = {}
+
+function handle.message(id, msg, op)
+	websocket.write(id, msg, op)
+end
+
+skynet.start(function()
+	skynet.dispatch("lua", function(_, _, id)
+		skynet.ret()
+		websocket.accept(id, handle)
+		skynet.exit()
+	end)
+end)
+
+else
+
+ti = tonumber(mode) or 0.5
+
+local function random_string(n)
+	local t = {}
+	for i = 1, n do
+		t[i] = string.char(math.random(0, 255))
+	end
+	return table.concat(t)
+end
+
+local function test_codec()
+	local codec = wscodec.new()
+	for _, n in ipairs { 0, 1, 3, 4, 7, 15, 16, 17, 31, 32, 33, 63, 64, 65, 125, 126, 1000, 65535, 65536, 100000 } do
+		local data = random_string(n)
+		local key = random_string(4)
+		local k = string.unpack(">I4", key)
+		assert(codec:unmask(key .. data) == crypt.xor_str(data, key), n)
+		-- frame : header, masking key and masked payload
+		local f = wscodec.frame(2, data, k)
+		local fin, op, mask, len = wscodec.header(f:sub(1, 2))
+		assert(fin and op == 2 and mask)
+		local off = 3
+		if len < 0 then
+			len, off = wscodec.length(f:sub(3, 2 - len)), 3 - len
+		end
+		assert(len == n)
+		assert(f:sub(off, off + 3) == key)
+		assert(codec:unmask(f:sub(off)) == data)
+		-- unmasked frame
+		f = wscodec.frame(1, data)
+		fin, op, mask = wscodec.header(f:sub(1, 2))
+		assert(fin and op == 1 and not mask)
+		assert(n == 0 or f:sub(-n) == data)
+	end
+	-- join the fragments
+	local parts = {}
+	for i = 1, 10 do
+		parts[i] = random_string(i * 1000)
+		local key = random_string(4)
+		if i % 2 == 0 then
+			codec:append(key .. crypt.xor_str(parts[i], key), true)
+		else
+			codec:append(parts[i])
+		end
+	end
+	assert(codec:message() == table.concat(parts))
+	assert(codec:message() == "")
+	print("codec ok")
+end
+
+local function test_echo()
+	local agent = skynet.newservice(SERVICE_NAME, "agent")
+	local id = socket.listen("127.0.0.1", PORT)
+	socket.start(id, function(fd)
+		skynet.call(agent, "lua", fd)
+	end)
+	local ws = websocket.connect(string.format("ws://127.0.0.1:%d/test", PORT))
+	for _, n in ipairs { 0, 10, 125, 126, 1000, 65535, 65536, 200000 } do
+		local data = random_string(n)
+		websocket.write(ws, data, "binary", math.random(0, 0xffffffff))
+		assert(websocket.read(ws) == data, n)
+	end
+	websocket.close(ws)
+	socket.close(id)
+	print("echo ok")
+end
+
+local function bench(f, data)
+	local n = 0
+	local t = skynet.hpc()
+	local stop = t + ti * 1e9
+	local now
+	repeat
+		for i = 1, 16 do
+			f(data)
+		end
+		n = n + 16
+		now = skynet.hpc()
+	until now >= stop
+	return n * #data / ((now - t) / 1e9) / 1024 / 1024
+end
+
+local function test_bench()
+	local codec = wscodec.new()
+	local key = random_string(4)
+	for _, n in ipairs { 16, 125, 1024, 16 * 1024, 256 * 1024 } do
+		local data = random_string(n)
+		local masked = key .. data
+		local xor = bench(function(s) return crypt.xor_str(s, key) end, data)
+		local c = bench(function(s) return codec:unmask(s) end, masked)
+		print(string.format("unmask %6d bytes : xor_str %8.1f MB/s, codec %8.1f MB/s (x%.1f)", n, xor, c, c / xor))
+	end
+end
+
+skynet.start(function()
+	test_codec()
+	test_echo()
+	test_bench()
+	print("websocket ok")
+	skynet.exit()
+end)
+
+end
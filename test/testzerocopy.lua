@@ -0,0 +1,85 @@
+-- check socket.zerocopy : large buffers are sent by MSG_ZEROCOPY, and freed after the completion
+-- usage : testzerocopy [size] [count]
+
+local skynet = require "skynet"
+local socket = require "skynet.socket"
+
+local size, count = ...
+size = tonumber(size) or 1024 * 1024
+count = tonumber(count) or 64
+
+local PORT = 8006
+
+local function netstat(id)
+	for _, v in ipairs(socket.netstat()) do
+		if v.id == id then
+			return v
+		end
+	end
+end
+
+skynet.start(function()
+	local id = socket.listen("127.0.0.1", PORT)
+	local server
+	socket.start(id, function(fd)
+		socket.start(fd)
+		server = fd
+	end)
+	local c = socket.open("127.0.0.1", PORT)
+	while not server do
+		skynet.sleep(1)
+	end
+	socket.zerocopy(server, 64 * 1024)
+
+	local t = skynet.now()
+	skynet.fork(function()
+		for i = 1, count do
+			-- mix small packets with the large ones, the small ones are sent by writev
+			socket.write(server, string.pack(">I4", i))
+			socket.write(server, string.rep(string.char(i % 256), size))
+		end
+		-- graceful close waits for the completions
+		socket.close(server)
+	end)
+	for i = 1, count do
+		local n = string.unpack(">I4", assert(socket.read(c, 4)))
+		assert(n == i)
+		local data = assert(socket.read(c, size))
+		assert(data == string.rep(string.char(i % 256), size))
+	end
+	local ti = (skynet.now() - t) / 100
+	print(string.format("zerocopy : %d x %d bytes in %.2fs", count, size, ti))
+	assert(socket.read(c) == false)
+	-- the server socket is released after all the buffers are completed
+	while netstat(server) do
+		skynet.sleep(1)
+	end
+	socket.close(c)
+
+	-- shutdown when the buffers are not completed (the peer doesn't read), the data sent is still intact
+	server = nil
+	c = socket.open("127.0.0.1", PORT)
+	while not server do
+		skynet.sleep(1)
+	end
+	socket.pause(c)
+	socket.zerocopy(server, 64 * 1024)
+	local block = 256 * 1024
+	for i = 1, 32 do
+		socket.write(server, string.rep(string.char(i), block))
+	end
+	skynet.sleep(10)
+	socket.shutdown(server)
+	socket.close(server)
+	local data = socket.readall(c)
+	assert(#data > 0)
+	for i = 1, #data, block do
+		local s = data:sub(i, i + block - 1)
+		assert(s == string.rep(string.char(i // block + 1), #s))
+	end
+	print(string.format("shutdown : %d bytes received", #data))
+	socket.close(c)
+	socket.close(id)
+	print("zerocopy ok")
+	skynet.exit()
+end)